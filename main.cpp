@@ -6,6 +6,7 @@
 
 #include <cmath>
 
+#include "src/common/cpu_dispatch.h"
 #include "src/common/font_loader.h"
 #include "src/common/logger.h"
 #include "src/dx12/dx12_framework.h"
@@ -18,9 +19,11 @@ int main() {
     // FontLoader loader("Lanting");
     // loader.GenerateFontTextureAndMeta();
     log_init("grek_render.log");
+    flight_init();
     atexit([]() {
         log_close();
     });
+    LOG_INFO("CPU kernels use {} (detected {})", cpu_level_name(cpu_active_level()), cpu_level_name(cpu_detect_level()));
     RenderPreset presets = {
         .width = 1280,
         .height = 720,
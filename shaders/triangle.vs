@@ -8,9 +8,14 @@ cbuffer Scene : register(b0)
     row_major float4x4 ViewMatrix;
 };
 
-cbuffer World: register(b1) {
-    row_major float4x4 WorldMatrix[2];
-}
+struct InstanceData {
+    row_major float4x4 WorldMatrix;
+    uint MaterialIndex;
+    uint Flags;
+    float2 Padding;
+};
+
+StructuredBuffer<InstanceData> Instances : register(t32);
 
 struct VSIn {
     float3 pos : POSITION;
@@ -23,18 +28,19 @@ struct PSIn {
     float4 rpos : POSITION;
     float2 uv  : TEXCOORD;
     float3 normal : NORMAL;
-    uint iid : ID;
+    nointerpolation uint material : MATERIAL;
 };
 
 PSIn main(VSIn v, uint instance : SV_InstanceID)
 {
     PSIn o;
-    row_major float4x4 wm = WorldMatrix[instance];
+    InstanceData inst = Instances[instance];
+    row_major float4x4 wm = inst.WorldMatrix;
     row_major float4x4 wvp = mul(wm, ViewMatrix);
     o.pos = mul(float4(v.pos, 1.0), wvp);
     o.rpos = mul(float4(v.pos, 1.0), wm);
     o.normal = mul(float4(v.normal, 0.0), wm);
     o.uv = v.uv;
-    o.iid = instance;
+    o.material = inst.MaterialIndex;
     return o;
 }
\ No newline at end of file
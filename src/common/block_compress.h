@@ -0,0 +1,588 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "job_pool.h"
+#include "simd_math.h"
+#include "texture.h"
+
+/* Block compressed texture, view.levels point into storage */
+struct compressed_texture_t {
+    texture_view_t view;
+    std::vector<std::vector<uint8_t>> storage;
+};
+
+/* One 4x4 block of RGBA pixels in row order, channels 0..255 */
+struct bc_block_t {
+    vec_t pixels[16];
+};
+
+/* Gather the block at (bx, by) of an R8, RG8 or RGBA8 level, pixels past the edge repeat the last row and column.
+ * Missing channels read 0 and alpha 255 */
+inline void bc_load_block(const texture_level_t& level, uint32_t channels, uint32_t bx, uint32_t by, bc_block_t& block) {
+    for (uint32_t y = 0; y < 4; ++y) {
+        const uint8_t* row = level.data + static_cast<size_t>(std::min(by * 4 + y, level.height - 1)) * level.row_pitch;
+        for (uint32_t x = 0; x < 4; ++x) {
+            const uint8_t* p = row + std::min(bx * 4 + x, level.width - 1) * channels;
+            block.pixels[y * 4 + x] = channels == 4 ? vec_set(p[0], p[1], p[2], p[3]) : vec_set(p[0], channels == 2 ? p[1] : 0.0f, 0.0f, 255.0f);
+        }
+    }
+}
+
+/* Principal axis of the pixels around mean through power iteration on their covariance. mask zeroes the channels to
+ * leave out; returns a zero vector for a flat block */
+inline vec_t bc_principal_axis(const vec_t* pixels, uint32_t count, vec_t mean, vec_t mask) {
+    vec_t cov[4] = {vec_splat(0.0f), vec_splat(0.0f), vec_splat(0.0f), vec_splat(0.0f)};
+    for (uint32_t i = 0; i < count; ++i) {
+        vec_t d = vec_mul(vec_sub(pixels[i], mean), mask);
+        for (int c = 0; c < 4; ++c) cov[c] = vec_mul_add(d, vec_splat_lane(d, c), cov[c]);
+    }
+    vec_t axis = vec_mul(vec_splat(1.0f), mask);
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        vec_t next = vec_mul(cov[0], vec_splat_lane(axis, 0));
+        for (int c = 1; c < 4; ++c) next = vec_mul_add(cov[c], vec_splat_lane(axis, c), next);
+        float length = std::sqrt(vec_get_x(vec_dot4(next, next)));
+        if (length < 1e-6f) return vec_splat(0.0f);
+        axis = vec_scale(next, 1.0f / length);
+    }
+    return axis;
+}
+
+/* Endpoints minimizing the squared error of pixels[i] against lerp(e0, e1, weights[i]), pixels with a negative weight
+ * are left out. Returns false when the weights leave the system singular, e.g. all pixels on one index */
+inline bool bc_fit_endpoints(const vec_t* pixels, const float* weights, uint32_t count, vec_t& e0, vec_t& e1) {
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    vec_t ax = vec_splat(0.0f), bx = vec_splat(0.0f);
+    for (uint32_t i = 0; i < count; ++i) {
+        float w = weights[i];
+        if (w < 0.0f) continue;
+        aa += (1.0f - w) * (1.0f - w);
+        ab += (1.0f - w) * w;
+        bb += w * w;
+        ax = vec_mul_add(vec_splat(1.0f - w), pixels[i], ax);
+        bx = vec_mul_add(vec_splat(w), pixels[i], bx);
+    }
+    float det = aa * bb - ab * ab;
+    if (std::fabs(det) < 1e-6f) return false;
+    float inv = 1.0f / det;
+    vec_t lo = vec_splat(0.0f), hi = vec_splat(255.0f);
+    e0 = vec_min(vec_max(vec_scale(vec_sub(vec_scale(ax, bb), vec_scale(bx, ab)), inv), lo), hi);
+    e1 = vec_min(vec_max(vec_scale(vec_sub(vec_scale(bx, aa), vec_scale(ax, ab)), inv), lo), hi);
+    return true;
+}
+
+/* Extremes of the pixels projected on axis through mean */
+inline void bc_axis_endpoints(const vec_t* pixels, uint32_t count, vec_t mean, vec_t axis, vec_t& e0, vec_t& e1) {
+    float t_min = std::numeric_limits<float>::max(), t_max = std::numeric_limits<float>::lowest();
+    for (uint32_t i = 0; i < count; ++i) {
+        float t = vec_get_x(vec_dot4(vec_sub(pixels[i], mean), axis));
+        t_min = std::min(t_min, t);
+        t_max = std::max(t_max, t);
+    }
+    vec_t lo = vec_splat(0.0f), hi = vec_splat(255.0f);
+    e0 = vec_min(vec_max(vec_mul_add(axis, vec_splat(t_min), mean), lo), hi);
+    e1 = vec_min(vec_max(vec_mul_add(axis, vec_splat(t_max), mean), lo), hi);
+}
+
+inline float bc_distance(vec_t a, vec_t b) {
+    vec_t d = vec_sub(a, b);
+    return vec_get_x(vec_dot4(d, d));
+}
+
+/* ---- BC1 ---- */
+
+inline uint16_t bc1_pack_565(vec_t c) {
+    auto q = [](float v, float max) { return static_cast<uint16_t>(std::clamp(v * max / 255.0f + 0.5f, 0.0f, max)); };
+    return static_cast<uint16_t>(q(vec_get_x(c), 31.0f) << 11 | q(vec_get_y(c), 63.0f) << 5 | q(vec_get_z(c), 31.0f));
+}
+
+/* The four colors of a BC1 block, RGBA8 */
+inline void bc1_palette(uint16_t c0, uint16_t c1, uint8_t palette[4][4]) {
+    auto unpack = [](uint16_t c, uint8_t out[4]) {
+        uint32_t r = c >> 11, g = (c >> 5) & 63, b = c & 31;
+        out[0] = static_cast<uint8_t>(r << 3 | r >> 2);
+        out[1] = static_cast<uint8_t>(g << 2 | g >> 4);
+        out[2] = static_cast<uint8_t>(b << 3 | b >> 2);
+        out[3] = 255;
+    };
+    unpack(c0, palette[0]);
+    unpack(c1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+        uint32_t a = palette[0][c], b = palette[1][c];
+        if (c0 > c1) {
+            palette[2][c] = static_cast<uint8_t>((2 * a + b) / 3);
+            palette[3][c] = static_cast<uint8_t>((a + 2 * b) / 3);
+        } else {
+            palette[2][c] = static_cast<uint8_t>((a + b) / 2);
+            palette[3][c] = 0;
+        }
+    }
+    palette[2][3] = 255;
+    palette[3][3] = c0 > c1 ? 255 : 0;
+}
+
+/* Encode a block with fixed endpoints, returns the error over the opaque pixels */
+inline float bc1_encode_endpoints(const bc_block_t& block, uint16_t c0, uint16_t c1, bool transparent, uint8_t out[8], uint8_t indices[16]) {
+    // Four colors need c0 > c1, three colors plus transparent black need c0 <= c1
+    if (transparent ? c0 > c1 : c0 < c1) std::swap(c0, c1);
+    uint8_t palette[4][4];
+    bc1_palette(c0, c1, palette);
+    vec_t colors[4];
+    for (int i = 0; i < 4; ++i) colors[i] = vec_set(palette[i][0], palette[i][1], palette[i][2], 0.0f);
+    const uint32_t choices = c0 > c1 ? 4 : 3;
+    const vec_t rgb = vec_set(1.0f, 1.0f, 1.0f, 0.0f);
+    float error = 0.0f;
+    uint32_t bits = 0;
+    for (uint32_t i = 0; i < 16; ++i) {
+        uint32_t best = 3;
+        if (!transparent || vec_get_w(block.pixels[i]) >= 128.0f) {
+            vec_t p = vec_mul(block.pixels[i], rgb);
+            float best_error = bc_distance(p, colors[0]);
+            best = 0;
+            for (uint32_t j = 1; j < choices; ++j) {
+                float e = bc_distance(p, colors[j]);
+                if (e < best_error) {
+                    best_error = e;
+                    best = j;
+                }
+            }
+            error += best_error;
+        }
+        indices[i] = static_cast<uint8_t>(best);
+        bits |= best << (2 * i);
+    }
+    memcpy(out, &c0, 2);
+    memcpy(out + 2, &c1, 2);
+    memcpy(out + 4, &bits, 4);
+    return error;
+}
+
+/* Pixels with alpha below 128 use the transparent color, the rest is treated as opaque */
+inline void bc1_encode_block(const bc_block_t& block, uint8_t out[8], bc_quality quality) {
+    const vec_t rgb = vec_set(1.0f, 1.0f, 1.0f, 0.0f);
+    vec_t pixels[16];
+    uint32_t count = 0;
+    vec_t sum = vec_splat(0.0f);
+    for (uint32_t i = 0; i < 16; ++i) {
+        if (vec_get_w(block.pixels[i]) < 128.0f) continue;
+        pixels[count] = vec_mul(block.pixels[i], rgb);
+        sum = vec_add(sum, pixels[count++]);
+    }
+    const bool transparent = count < 16;
+    if (count == 0) {
+        uint8_t indices[16];
+        bc1_encode_endpoints(block, 0, 0, true, out, indices);
+        return;
+    }
+    vec_t mean = vec_scale(sum, 1.0f / count);
+    vec_t e0 = mean, e1 = mean;
+    vec_t axis = bc_principal_axis(pixels, count, mean, rgb);
+    if (vec_get_x(vec_dot4(axis, axis)) > 0.0f) bc_axis_endpoints(pixels, count, mean, axis, e0, e1);
+
+    const int refinements = quality == bc_quality::FAST ? 0 : quality == bc_quality::NORMAL ? 1 : 4;
+    float best_error = std::numeric_limits<float>::max();
+    for (int iteration = 0; ; ++iteration) {
+        uint8_t candidate[8], indices[16];
+        uint16_t c0 = bc1_pack_565(e0), c1 = bc1_pack_565(e1);
+        float error = bc1_encode_endpoints(block, c0, c1, transparent, candidate, indices);
+        if (error < best_error) {
+            best_error = error;
+            memcpy(out, candidate, 8);
+        }
+        if (iteration == refinements || best_error == 0.0f) break;
+        // Refit against the palette positions the pixels landed on, in the order actually written
+        memcpy(&c0, candidate, 2);
+        memcpy(&c1, candidate + 2, 2);
+        static constexpr float four_color[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+        static constexpr float three_color[4] = {0.0f, 1.0f, 0.5f, -1.0f};
+        const float* position = c0 > c1 ? four_color : three_color;
+        float weights[16];
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < 16; ++i) {
+            if (transparent && vec_get_w(block.pixels[i]) < 128.0f) continue;
+            weights[n++] = position[indices[i]];
+        }
+        vec_t f0, f1;
+        if (!bc_fit_endpoints(pixels, weights, count, f0, f1)) break;
+        e0 = f0;
+        e1 = f1;
+    }
+}
+
+inline void bc1_decode_block(const uint8_t in[8], uint8_t rgba[16][4]) {
+    uint16_t c0, c1;
+    uint32_t bits;
+    memcpy(&c0, in, 2);
+    memcpy(&c1, in + 2, 2);
+    memcpy(&bits, in + 4, 4);
+    uint8_t palette[4][4];
+    bc1_palette(c0, c1, palette);
+    for (uint32_t i = 0; i < 16; ++i) memcpy(rgba[i], palette[(bits >> (2 * i)) & 3], 4);
+}
+
+/* ---- BC4 and BC5 ---- */
+
+/* The eight values of a BC4 block. a0 > a1 interpolates six values, otherwise four plus 0 and 255 */
+inline void bc4_palette(uint8_t a0, uint8_t a1, uint8_t palette[8]) {
+    palette[0] = a0;
+    palette[1] = a1;
+    if (a0 > a1) {
+        for (uint32_t i = 1; i < 7; ++i) palette[i + 1] = static_cast<uint8_t>(((7 - i) * a0 + i * a1 + 3) / 7);
+    } else {
+        for (uint32_t i = 1; i < 5; ++i) palette[i + 1] = static_cast<uint8_t>(((5 - i) * a0 + i * a1 + 2) / 5);
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+inline uint32_t bc4_encode_endpoints(const uint8_t values[16], uint8_t a0, uint8_t a1, uint8_t out[8]) {
+    uint8_t palette[8];
+    bc4_palette(a0, a1, palette);
+    uint32_t error = 0;
+    uint64_t bits = 0;
+    for (uint32_t i = 0; i < 16; ++i) {
+        uint32_t best = 0, best_error = 256 * 256;
+        for (uint32_t j = 0; j < 8; ++j) {
+            int d = static_cast<int>(values[i]) - palette[j];
+            uint32_t e = static_cast<uint32_t>(d * d);
+            if (e < best_error) {
+                best_error = e;
+                best = j;
+            }
+        }
+        error += best_error;
+        bits |= static_cast<uint64_t>(best) << (3 * i);
+    }
+    out[0] = a0;
+    out[1] = a1;
+    for (uint32_t i = 0; i < 6; ++i) out[2 + i] = static_cast<uint8_t>(bits >> (8 * i));
+    return error;
+}
+
+/* Encode channel of the block */
+inline void bc4_encode_block(const bc_block_t& block, int channel, uint8_t out[8], bc_quality quality) {
+    alignas(16) float lanes[4];
+    uint8_t values[16];
+    uint8_t lo = 255, hi = 0, inner_lo = 255, inner_hi = 0;
+    for (uint32_t i = 0; i < 16; ++i) {
+        vec_store4(lanes, block.pixels[i]);
+        values[i] = static_cast<uint8_t>(lanes[channel]);
+        lo = std::min(lo, values[i]);
+        hi = std::max(hi, values[i]);
+        if (values[i] != 0 && values[i] != 255) {
+            inner_lo = std::min(inner_lo, values[i]);
+            inner_hi = std::max(inner_hi, values[i]);
+        }
+    }
+    uint32_t best_error = bc4_encode_endpoints(values, hi, lo, out);
+    if (quality == bc_quality::FAST || best_error == 0) return;
+    uint8_t candidate[8];
+    auto attempt = [&](int a0, int a1) {
+        uint32_t error = bc4_encode_endpoints(values, static_cast<uint8_t>(a0), static_cast<uint8_t>(a1), candidate);
+        if (error < best_error) {
+            best_error = error;
+            memcpy(out, candidate, 8);
+        }
+    };
+    // Six-value mode spends its range on the values between the exact 0 and 255
+    if (inner_lo <= inner_hi) attempt(inner_lo, inner_hi);
+    if (quality == bc_quality::HIGH) {
+        // Pulling the endpoints in often lands the interpolated values closer to the clusters
+        for (int d0 = -2; d0 <= 2; ++d0) {
+            for (int d1 = -2; d1 <= 2; ++d1) {
+                int a0 = hi + d0, a1 = lo + d1;
+                if (a0 > a1 && a0 <= 255 && a1 >= 0) attempt(a0, a1);
+            }
+        }
+    }
+}
+
+inline void bc4_decode_block(const uint8_t in[8], uint8_t values[16], uint32_t stride = 1) {
+    uint8_t palette[8];
+    bc4_palette(in[0], in[1], palette);
+    uint64_t bits = 0;
+    for (uint32_t i = 0; i < 6; ++i) bits |= static_cast<uint64_t>(in[2 + i]) << (8 * i);
+    for (uint32_t i = 0; i < 16; ++i) values[i * stride] = palette[(bits >> (3 * i)) & 7];
+}
+
+/* Red and green as two BC4 blocks */
+inline void bc5_encode_block(const bc_block_t& block, uint8_t out[16], bc_quality quality) {
+    bc4_encode_block(block, 0, out, quality);
+    bc4_encode_block(block, 1, out + 8, quality);
+}
+
+/* ---- BC7 ---- */
+
+/* BC7 is written in mode 6: one subset, RGBA endpoints of 7 bits plus a p-bit each, 4-bit indices. The other modes
+ * trade index precision for partitions and are not produced */
+constexpr uint32_t bc7_weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+struct bc7_mode6_t {
+    uint8_t endpoints[2][4];    // 7 bits
+    uint8_t pbits[2];
+    uint8_t indices[16];
+};
+
+inline void bc7_mode6_palette(const bc7_mode6_t& block, vec_t palette[16]) {
+    uint32_t e[2][4];
+    for (int i = 0; i < 2; ++i) {
+        for (int c = 0; c < 4; ++c) e[i][c] = static_cast<uint32_t>(block.endpoints[i][c]) << 1 | block.pbits[i];
+    }
+    for (uint32_t j = 0; j < 16; ++j) {
+        uint32_t w = bc7_weights[j];
+        auto lerp = [&](int c) { return static_cast<float>(((64 - w) * e[0][c] + w * e[1][c] + 32) >> 6); };
+        palette[j] = vec_set(lerp(0), lerp(1), lerp(2), lerp(3));
+    }
+}
+
+/* Pick the indices of a quantized block, the projection on the endpoint line and its two neighbours are tried as the
+ * weights are not quite uniform. Returns the squared error */
+inline float bc7_mode6_select(const bc_block_t& block, bc7_mode6_t& out) {
+    vec_t palette[16];
+    bc7_mode6_palette(out, palette);
+    vec_t line = vec_sub(palette[15], palette[0]);
+    float line_length = vec_get_x(vec_dot4(line, line));
+    float error = 0.0f;
+    for (uint32_t i = 0; i < 16; ++i) {
+        const vec_t p = block.pixels[i];
+        float t = line_length > 0.0f ? vec_get_x(vec_dot4(vec_sub(p, palette[0]), line)) / line_length : 0.0f;
+        int guess = static_cast<int>(std::clamp(t * 15.0f + 0.5f, 0.0f, 15.0f));
+        float best_error = std::numeric_limits<float>::max();
+        for (int j = std::max(guess - 1, 0); j <= std::min(guess + 1, 15); ++j) {
+            float e = bc_distance(p, palette[j]);
+            if (e < best_error) {
+                best_error = e;
+                out.indices[i] = static_cast<uint8_t>(j);
+            }
+        }
+        error += best_error;
+    }
+    return error;
+}
+
+/* Quantize e0 and e1 with the given p-bits and pick indices */
+inline float bc7_mode6_encode(const bc_block_t& block, vec_t e0, vec_t e1, uint8_t p0, uint8_t p1, bc7_mode6_t& out) {
+    alignas(16) float lanes[2][4];
+    vec_store4(lanes[0], e0);
+    vec_store4(lanes[1], e1);
+    out.pbits[0] = p0;
+    out.pbits[1] = p1;
+    for (int i = 0; i < 2; ++i) {
+        for (int c = 0; c < 4; ++c) {
+            out.endpoints[i][c] = static_cast<uint8_t>(std::clamp((lanes[i][c] - out.pbits[i]) * 0.5f + 0.5f, 0.0f, 127.0f));
+        }
+    }
+    return bc7_mode6_select(block, out);
+}
+
+inline void bc7_mode6_pack(bc7_mode6_t block, uint8_t out[16]) {
+    // The anchor index is stored without its top bit, which must therefore be zero
+    if (block.indices[0] >= 8) {
+        std::swap(block.endpoints[0], block.endpoints[1]);
+        std::swap(block.pbits[0], block.pbits[1]);
+        for (auto& index : block.indices) index = static_cast<uint8_t>(15 - index);
+    }
+    uint64_t bits[2] = {0, 0};
+    uint32_t position = 0;
+    auto write = [&](uint64_t value, uint32_t count) {
+        for (uint32_t i = 0; i < count; ++i, ++position) bits[position / 64] |= ((value >> i) & 1) << (position % 64);
+    };
+    write(1u << 6, 7);
+    for (int c = 0; c < 4; ++c) {
+        write(block.endpoints[0][c], 7);
+        write(block.endpoints[1][c], 7);
+    }
+    write(block.pbits[0], 1);
+    write(block.pbits[1], 1);
+    write(block.indices[0], 3);
+    for (uint32_t i = 1; i < 16; ++i) write(block.indices[i], 4);
+    memcpy(out, bits, 16);
+}
+
+inline void bc7_encode_block(const bc_block_t& block, uint8_t out[16], bc_quality quality) {
+    vec_t sum = vec_splat(0.0f);
+    for (const auto& p : block.pixels) sum = vec_add(sum, p);
+    vec_t mean = vec_scale(sum, 1.0f / 16.0f);
+    vec_t e0 = mean, e1 = mean;
+    vec_t axis = bc_principal_axis(block.pixels, 16, mean, vec_splat(1.0f));
+    if (vec_get_x(vec_dot4(axis, axis)) > 0.0f) bc_axis_endpoints(block.pixels, 16, mean, axis, e0, e1);
+
+    const int refinements = quality == bc_quality::FAST ? 0 : quality == bc_quality::NORMAL ? 1 : 3;
+    bc7_mode6_t best = {}, candidate;
+    float best_error = std::numeric_limits<float>::max();
+    for (int iteration = 0; ; ++iteration) {
+        if (quality == bc_quality::FAST) {
+            // Per endpoint the p-bit that matches the parity of most channels
+            alignas(16) float lanes[2][4];
+            vec_store4(lanes[0], e0);
+            vec_store4(lanes[1], e1);
+            uint8_t pbits[2];
+            for (int i = 0; i < 2; ++i) {
+                int odd = 0;
+                for (int c = 0; c < 4; ++c) odd += static_cast<int>(lanes[i][c] + 0.5f) & 1;
+                pbits[i] = odd >= 2;
+            }
+            best_error = bc7_mode6_encode(block, e0, e1, pbits[0], pbits[1], best);
+        } else {
+            for (uint8_t p = 0; p < 4; ++p) {
+                float error = bc7_mode6_encode(block, e0, e1, p & 1, p >> 1, candidate);
+                if (error < best_error) {
+                    best_error = error;
+                    best = candidate;
+                }
+            }
+        }
+        if (iteration == refinements || best_error == 0.0f) break;
+        float weights[16];
+        for (uint32_t i = 0; i < 16; ++i) weights[i] = bc7_weights[best.indices[i]] / 64.0f;
+        if (!bc_fit_endpoints(block.pixels, weights, 16, e0, e1)) break;
+    }
+    if (quality == bc_quality::HIGH) {
+        // Rounding each endpoint channel on its own is not optimal, nudge them one step while that lowers the error
+        for (int pass = 0; pass < 2 && best_error > 0.0f; ++pass) {
+            for (int i = 0; i < 2; ++i) {
+                for (int c = 0; c < 4; ++c) {
+                    for (int step : {-1, 1}) {
+                        int v = best.endpoints[i][c] + step;
+                        if (v < 0 || v > 127) continue;
+                        candidate = best;
+                        candidate.endpoints[i][c] = static_cast<uint8_t>(v);
+                        float error = bc7_mode6_select(block, candidate);
+                        if (error < best_error) {
+                            best_error = error;
+                            best = candidate;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    bc7_mode6_pack(best, out);
+}
+
+/* Decodes mode 6 blocks, returns false for the modes the encoder does not write */
+inline bool bc7_decode_block(const uint8_t in[16], uint8_t rgba[16][4]) {
+    uint64_t bits[2];
+    memcpy(bits, in, 16);
+    if ((bits[0] & 0x7f) != 1u << 6) return false;
+    uint32_t position = 7;
+    auto read = [&](uint32_t count) {
+        uint32_t value = 0;
+        for (uint32_t i = 0; i < count; ++i, ++position) value |= static_cast<uint32_t>((bits[position / 64] >> (position % 64)) & 1) << i;
+        return value;
+    };
+    bc7_mode6_t block;
+    for (int c = 0; c < 4; ++c) {
+        block.endpoints[0][c] = static_cast<uint8_t>(read(7));
+        block.endpoints[1][c] = static_cast<uint8_t>(read(7));
+    }
+    block.pbits[0] = static_cast<uint8_t>(read(1));
+    block.pbits[1] = static_cast<uint8_t>(read(1));
+    block.indices[0] = static_cast<uint8_t>(read(3));
+    for (uint32_t i = 1; i < 16; ++i) block.indices[i] = static_cast<uint8_t>(read(4));
+    vec_t palette[16];
+    bc7_mode6_palette(block, palette);
+    for (uint32_t i = 0; i < 16; ++i) {
+        const vec_t& p = palette[block.indices[i]];
+        rgba[i][0] = static_cast<uint8_t>(vec_get_x(p));
+        rgba[i][1] = static_cast<uint8_t>(vec_get_y(p));
+        rgba[i][2] = static_cast<uint8_t>(vec_get_z(p));
+        rgba[i][3] = static_cast<uint8_t>(vec_get_w(p));
+    }
+    return true;
+}
+
+/* ---- Textures ---- */
+
+inline void bc_encode_block(texture_format format, const bc_block_t& block, uint8_t* out, bc_quality quality) {
+    switch (format) {
+        case texture_format::BC1_UNORM: bc1_encode_block(block, out, quality); break;
+        case texture_format::BC4_UNORM: bc4_encode_block(block, 0, out, quality); break;
+        case texture_format::BC5_UNORM: bc5_encode_block(block, out, quality); break;
+        default: bc7_encode_block(block, out, quality); break;
+    }
+}
+
+/* Decode one block to RGBA8, channels the format does not store read 0 and alpha 255 */
+inline bool bc_decode_block(texture_format format, const uint8_t* in, uint8_t rgba[16][4]) {
+    switch (format) {
+        case texture_format::BC1_UNORM:
+            bc1_decode_block(in, rgba);
+            return true;
+        case texture_format::BC4_UNORM:
+        case texture_format::BC5_UNORM:
+            memset(rgba, 0, 64);
+            for (uint32_t i = 0; i < 16; ++i) rgba[i][3] = 255;
+            bc4_decode_block(in, &rgba[0][0], 4);
+            if (format == texture_format::BC5_UNORM) bc4_decode_block(in + 8, &rgba[0][1], 4);
+            return true;
+        case texture_format::BC7_UNORM:
+            return bc7_decode_block(in, rgba);
+        default:
+            return false;
+    }
+}
+
+/* Compress every level of an R8, RG8 or RGBA8 view. Block rows are split across pool when one is given. The top level
+ * must be a multiple of 4 in both dimensions for D3D12 to accept the texture, smaller levels are padded by the encoder */
+inline compressed_texture_t compress_texture(const texture_view_t& source, texture_format format, bc_quality quality, JobPool* pool = nullptr) {
+    compressed_texture_t result = {{format, source.width, source.height, {}}, {}};
+    result.storage.resize(source.levels.size());
+    const uint32_t block_bytes = texture_format_pixel_bytes(format);
+    const uint32_t channels = texture_format_channels(source.format);
+    for (size_t l = 0; l < source.levels.size(); ++l) {
+        const texture_level_t& level = source.levels[l];
+        const uint32_t columns = (level.width + 3) / 4, rows = (level.height + 3) / 4;
+        auto& bytes = result.storage[l];
+        bytes.resize(static_cast<size_t>(columns) * rows * block_bytes);
+        auto encode_rows = [&](uint32_t begin, uint32_t end) {
+            bc_block_t block;
+            for (uint32_t by = begin; by < end; ++by) {
+                for (uint32_t bx = 0; bx < columns; ++bx) {
+                    bc_load_block(level, channels, bx, by, block);
+                    bc_encode_block(format, block, &bytes[(static_cast<size_t>(by) * columns + bx) * block_bytes], quality);
+                }
+            }
+        };
+        if (pool) pool->ParallelFor(rows, 4, encode_rows);
+        else encode_rows(0, rows);
+        result.view.levels.push_back({level.width, level.height, columns * block_bytes, bytes.data()});
+    }
+    return result;
+}
+
+/* Peak signal-to-noise ratio in dB of the top level of a compressed view against its 8-bit source, over the channels
+ * both keep. Infinite for a lossless result, 0 when the level cannot be decoded */
+inline float texture_psnr(const texture_view_t& reference, const texture_view_t& compressed_view) {
+    const texture_level_t& source = reference.levels[0];
+    const texture_level_t& compressed = compressed_view.levels[0];
+    const texture_format format = compressed_view.format;
+    const uint32_t source_channels = texture_format_channels(reference.format);
+    const uint32_t channels = std::min(texture_format_channels(format), source_channels);
+    const uint32_t block_bytes = texture_format_pixel_bytes(format);
+    const uint32_t columns = (source.width + 3) / 4, rows = (source.height + 3) / 4;
+    double squared_error = 0.0;
+    uint8_t decoded[16][4];
+    for (uint32_t by = 0; by < rows; ++by) {
+        for (uint32_t bx = 0; bx < columns; ++bx) {
+            if (!bc_decode_block(format, compressed.data + static_cast<size_t>(by) * compressed.row_pitch + bx * block_bytes, decoded)) return 0.0f;
+            for (uint32_t y = 0; y < 4 && by * 4 + y < source.height; ++y) {
+                const uint8_t* row = source.data + static_cast<size_t>(by * 4 + y) * source.row_pitch;
+                for (uint32_t x = 0; x < 4 && bx * 4 + x < source.width; ++x) {
+                    for (uint32_t c = 0; c < channels; ++c) {
+                        double d = static_cast<double>(row[(bx * 4 + x) * source_channels + c]) - decoded[y * 4 + x][c];
+                        squared_error += d * d;
+                    }
+                }
+            }
+        }
+    }
+    double mse = squared_error / (static_cast<double>(source.width) * source.height * channels);
+    if (mse == 0.0) return std::numeric_limits<float>::infinity();
+    return static_cast<float>(10.0 * std::log10(255.0 * 255.0 / mse));
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CPU_DISPATCH_X86 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <immintrin.h>
+#endif
+
+// Kernels built for a higher level than the compiler's baseline carry these, MSVC accepts the intrinsics anywhere
+#if defined(CPU_DISPATCH_X86) && (defined(__GNUC__) || defined(__clang__))
+#define CPU_TARGET_SSE4 __attribute__((target("sse4.1")))
+#define CPU_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define CPU_TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define CPU_TARGET_SSE4
+#define CPU_TARGET_AVX2
+#define CPU_TARGET_AVX512
+#endif
+
+/* Instruction set levels kernels can be specialized for, each implies the previous ones */
+enum class cpu_level {
+    SCALAR,
+    SSE4,
+    AVX2,
+    AVX512,
+};
+
+constexpr uint32_t cpu_level_count = 4;
+
+inline const char* cpu_level_name(cpu_level level) {
+    switch (level) {
+        case cpu_level::SSE4: return "sse4";
+        case cpu_level::AVX2: return "avx2";
+        case cpu_level::AVX512: return "avx512";
+        default: return "scalar";
+    }
+}
+
+/* Highest level supported by both the CPU and the OS, queried once */
+inline cpu_level cpu_detect_level() {
+    static const cpu_level level = [] {
+#ifdef CPU_DISPATCH_X86
+        auto cpuid = [](uint32_t leaf, uint32_t sub, uint32_t (&r)[4]) {
+#ifdef _MSC_VER
+            int regs[4];
+            __cpuidex(regs, static_cast<int>(leaf), static_cast<int>(sub));
+            for (int i = 0; i < 4; ++i) r[i] = static_cast<uint32_t>(regs[i]);
+#else
+            if (!__get_cpuid_count(leaf, sub, &r[0], &r[1], &r[2], &r[3])) r[0] = r[1] = r[2] = r[3] = 0;
+#endif
+        };
+        uint32_t leaf1[4], leaf7[4];
+        cpuid(1, 0, leaf1);
+        cpuid(7, 0, leaf7);
+        if (!(leaf1[2] & (1u << 19))) return cpu_level::SCALAR;
+        // AVX state has to be enabled by the OS as well, checked through XCR0
+        if (!(leaf1[2] & (1u << 27)) || !(leaf1[2] & (1u << 28))) return cpu_level::SSE4;
+#ifdef _MSC_VER
+        uint64_t xcr0 = _xgetbv(0);
+#else
+        uint32_t lo, hi;
+        __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        uint64_t xcr0 = (static_cast<uint64_t>(hi) << 32) | lo;
+#endif
+        bool avx2 = (xcr0 & 0x6) == 0x6 && (leaf7[1] & (1u << 5)) && (leaf1[2] & (1u << 12));
+        if (!avx2) return cpu_level::SSE4;
+        bool avx512 = (xcr0 & 0xe6) == 0xe6 && (leaf7[1] & (1u << 16));
+        return avx512 ? cpu_level::AVX512 : cpu_level::AVX2;
+#else
+        return cpu_level::SCALAR;
+#endif
+    }();
+    return level;
+}
+
+class CPUDispatchBase;
+
+inline std::vector<CPUDispatchBase*>& cpu_dispatch_registry() {
+    static std::vector<CPUDispatchBase*> registry;
+    return registry;
+}
+
+/* Level kernels are bound to. Defaults to the detected level, GERK_CPU_LEVEL=scalar|sse4|avx2|avx512 lowers it */
+inline cpu_level& cpu_active_level() {
+    static cpu_level level = [] {
+        cpu_level detected = cpu_detect_level();
+        const char* env = std::getenv("GERK_CPU_LEVEL");
+        if (!env) return detected;
+        for (uint32_t i = 0; i < cpu_level_count; ++i) {
+            if (std::string_view(env) == cpu_level_name(static_cast<cpu_level>(i))) {
+                return static_cast<cpu_level>(i) < detected ? static_cast<cpu_level>(i) : detected;
+            }
+        }
+        return detected;
+    }();
+    return level;
+}
+
+class CPUDispatchBase {
+public:
+    CPUDispatchBase() {
+        cpu_dispatch_registry().push_back(this);
+    }
+    CPUDispatchBase(CPUDispatchBase&) = delete;
+    virtual void Bind(cpu_level level) = 0;
+};
+
+/* Force every dispatched kernel to a level, clamped to what the CPU supports. Meant for tests and benchmarks,
+ * call while no kernel is running */
+inline void cpu_force_level(cpu_level level) {
+    cpu_active_level() = level < cpu_detect_level() ? level : cpu_detect_level();
+    for (auto* d : cpu_dispatch_registry()) d->Bind(cpu_active_level());
+}
+
+/* Function pointer bound to the best variant of a kernel. Variants may be null except the scalar one, a missing
+ * level falls back to the next lower variant */
+template<typename Fn>
+class CPUDispatch : public CPUDispatchBase {
+private:
+    std::array<Fn*, cpu_level_count> variants_;
+    Fn* bound_{};
+public:
+    CPUDispatch(Fn* scalar, Fn* sse4, Fn* avx2, Fn* avx512) : variants_{scalar, sse4, avx2, avx512} {
+        Bind(cpu_active_level());
+    }
+
+    void Bind(cpu_level level) override {
+        bound_ = Get(level);
+    }
+
+    /* Variant used at level, lets benchmarks run every variant the CPU supports */
+    Fn* Get(cpu_level level) const {
+        for (uint32_t i = static_cast<uint32_t>(level) + 1; i > 0; --i) {
+            if (variants_[i - 1]) return variants_[i - 1];
+        }
+        return variants_[0];
+    }
+
+    template<typename... Args>
+    auto operator()(Args&&... args) const {
+        return bound_(std::forward<Args>(args)...);
+    }
+};
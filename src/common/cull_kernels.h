@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "cpu_dispatch.h"
+#include "geometry.h"
+
+/* Bounds stored as one array per coordinate, the layout the wide culling kernels consume */
+struct aabb_soa_t {
+    std::vector<float> min_x, min_y, min_z;
+    std::vector<float> max_x, max_y, max_z;
+
+    void push_back(const aabb_t& b) {
+        min_x.push_back(b.min.x); min_y.push_back(b.min.y); min_z.push_back(b.min.z);
+        max_x.push_back(b.max.x); max_y.push_back(b.max.y); max_z.push_back(b.max.z);
+    }
+
+    void clear() {
+        for (auto* v : {&min_x, &min_y, &min_z, &max_x, &max_y, &max_z}) v->clear();
+    }
+
+    uint32_t size() const {
+        return static_cast<uint32_t>(min_x.size());
+    }
+};
+
+// visible[i] = 1 when box i is at least partially inside the frustum, else 0
+using frustum_cull_fn_t = void(const frustum_t&, const aabb_soa_t&, uint8_t*);
+
+// Per plane the corner furthest along its normal is fixed, so each plane picks whole arrays instead of blending
+inline void frustum_cull_planes(const plane_t& p, const aabb_soa_t& b, const float*& x, const float*& y, const float*& z) {
+    x = p.a >= 0.0f ? b.max_x.data() : b.min_x.data();
+    y = p.b >= 0.0f ? b.max_y.data() : b.min_y.data();
+    z = p.c >= 0.0f ? b.max_z.data() : b.min_z.data();
+}
+
+inline void frustum_cull_tail(const frustum_t& f, const aabb_soa_t& b, uint8_t* visible, uint32_t begin) {
+    for (uint32_t i = begin; i < b.size(); ++i) {
+        uint8_t v = 1;
+        for (const auto& p : f.planes) {
+            const float *x, *y, *z;
+            frustum_cull_planes(p, b, x, y, z);
+            v &= p.a * x[i] + p.b * y[i] + p.c * z[i] + p.d >= 0.0f;
+        }
+        visible[i] = v;
+    }
+}
+
+inline void frustum_cull_scalar(const frustum_t& f, const aabb_soa_t& b, uint8_t* visible) {
+    frustum_cull_tail(f, b, visible, 0);
+}
+
+#ifdef CPU_DISPATCH_X86
+CPU_TARGET_SSE4 inline void frustum_cull_sse4(const frustum_t& f, const aabb_soa_t& b, uint8_t* visible) {
+    uint32_t n = b.size() & ~3u;
+    for (uint32_t i = 0; i < n; i += 4) {
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (const auto& p : f.planes) {
+            const float *x, *y, *z;
+            frustum_cull_planes(p, b, x, y, z);
+            __m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.a), _mm_loadu_ps(x + i)), _mm_set1_ps(p.d));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(p.b), _mm_loadu_ps(y + i)));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(p.c), _mm_loadu_ps(z + i)));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, _mm_setzero_ps()));
+        }
+        int mask = _mm_movemask_ps(inside);
+        for (int l = 0; l < 4; ++l) visible[i + l] = (mask >> l) & 1;
+    }
+    frustum_cull_tail(f, b, visible, n);
+}
+
+CPU_TARGET_AVX2 inline void frustum_cull_avx2(const frustum_t& f, const aabb_soa_t& b, uint8_t* visible) {
+    uint32_t n = b.size() & ~7u;
+    for (uint32_t i = 0; i < n; i += 8) {
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (const auto& p : f.planes) {
+            const float *x, *y, *z;
+            frustum_cull_planes(p, b, x, y, z);
+            __m256 d = _mm256_fmadd_ps(_mm256_set1_ps(p.a), _mm256_loadu_ps(x + i), _mm256_set1_ps(p.d));
+            d = _mm256_fmadd_ps(_mm256_set1_ps(p.b), _mm256_loadu_ps(y + i), d);
+            d = _mm256_fmadd_ps(_mm256_set1_ps(p.c), _mm256_loadu_ps(z + i), d);
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+        int mask = _mm256_movemask_ps(inside);
+        for (int l = 0; l < 8; ++l) visible[i + l] = (mask >> l) & 1;
+    }
+    frustum_cull_tail(f, b, visible, n);
+}
+
+CPU_TARGET_AVX512 inline void frustum_cull_avx512(const frustum_t& f, const aabb_soa_t& b, uint8_t* visible) {
+    uint32_t n = b.size() & ~15u;
+    for (uint32_t i = 0; i < n; i += 16) {
+        __mmask16 inside = 0xffff;
+        for (const auto& p : f.planes) {
+            const float *x, *y, *z;
+            frustum_cull_planes(p, b, x, y, z);
+            __m512 d = _mm512_fmadd_ps(_mm512_set1_ps(p.a), _mm512_loadu_ps(x + i), _mm512_set1_ps(p.d));
+            d = _mm512_fmadd_ps(_mm512_set1_ps(p.b), _mm512_loadu_ps(y + i), d);
+            d = _mm512_fmadd_ps(_mm512_set1_ps(p.c), _mm512_loadu_ps(z + i), d);
+            inside &= _mm512_cmp_ps_mask(d, _mm512_setzero_ps(), _CMP_GE_OQ);
+        }
+        for (int l = 0; l < 16; ++l) visible[i + l] = (inside >> l) & 1;
+    }
+    frustum_cull_tail(f, b, visible, n);
+}
+
+inline CPUDispatch<frustum_cull_fn_t> frustum_cull_aabbs(frustum_cull_scalar, frustum_cull_sse4, frustum_cull_avx2, frustum_cull_avx512);
+#else
+inline CPUDispatch<frustum_cull_fn_t> frustum_cull_aabbs(frustum_cull_scalar, nullptr, nullptr, nullptr);
+#endif
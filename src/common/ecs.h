@@ -0,0 +1,375 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "job_pool.h"
+
+/* Components are plain data, they are moved between chunks with memcpy */
+template<typename T>
+concept Component = std::is_trivially_copyable_v<T> && std::is_default_constructible_v<T>;
+
+struct entity_t {
+    uint32_t index;
+    uint32_t generation;
+};
+
+/* Archetype based entity store. Entities with the same set of components share an archetype, which keeps them in
+ * fixed size chunks with one contiguous array per component, so iterating a few components over many entities reads
+ * memory linearly. Adding or removing a component moves the entity to another archetype; while systems run, such
+ * structural changes go through a CommandBuffer and are applied at a sync point. At most 64 component types, using
+ * one more throws. */
+class EntityRegistry {
+public:
+    using signature_t = uint64_t;
+    static constexpr size_t chunk_bytes = 16 * 1024;
+    static constexpr uint32_t max_component_types = 64;     // one bit each in signature_t
+private:
+    using component_info_t = struct {
+        uint32_t size;
+        uint32_t align;
+    };
+
+    static uint32_t next_component_id() {
+        static std::atomic<uint32_t> next{0};
+        uint32_t id = next.fetch_add(1);
+        if (id >= max_component_types) {
+            throw std::runtime_error(std::format("Failed to register component type {} because signatures hold {} types", id, max_component_types));
+        }
+        return id;
+    }
+
+    static std::vector<component_info_t>& component_infos() {
+        static std::vector<component_info_t> infos(max_component_types);
+        return infos;
+    }
+
+    template<Component T>
+    static uint32_t component_id() {
+        static const uint32_t id = [] {
+            uint32_t i = next_component_id();
+            component_infos()[i] = {static_cast<uint32_t>(sizeof(T)), static_cast<uint32_t>(alignof(T))};
+            return i;
+        }();
+        return id;
+    }
+
+    struct aligned_delete_t {
+        void operator()(uint8_t* p) const {
+            ::operator delete[](p, std::align_val_t(64));
+        }
+    };
+
+    struct chunk_t {
+        std::unique_ptr<uint8_t[], aligned_delete_t> data;
+        uint32_t count{0};
+    };
+
+    struct archetype_t {
+        signature_t signature;
+        uint32_t capacity;
+        // Byte offset of each component array inside a chunk, indexed by component id, the entity array is at 0
+        uint32_t offsets[max_component_types];
+        std::vector<uint32_t> components;
+        std::vector<chunk_t> chunks;
+
+        uint8_t* column(chunk_t& chunk, uint32_t component) {
+            return chunk.data.get() + offsets[component];
+        }
+
+        entity_t* entities(chunk_t& chunk) {
+            return reinterpret_cast<entity_t*>(chunk.data.get());
+        }
+    };
+
+    using record_t = struct {
+        archetype_t* archetype;
+        uint32_t chunk;
+        uint32_t row;
+        uint32_t generation;
+    };
+
+    std::map<signature_t, std::unique_ptr<archetype_t>> archetypes_;
+    std::vector<record_t> records_;
+    std::vector<uint32_t> free_indices_;
+    uint32_t alive_{0};
+
+    archetype_t* archetype_of(signature_t signature) {
+        auto& slot = archetypes_[signature];
+        if (slot) return slot.get();
+        slot = std::make_unique<archetype_t>();
+        archetype_t* a = slot.get();
+        a->signature = signature;
+        uint32_t row_bytes = sizeof(entity_t);
+        for (uint32_t c = 0; c < max_component_types; ++c) {
+            if (signature & (signature_t(1) << c)) {
+                a->components.push_back(c);
+                row_bytes += component_infos()[c].size;
+            }
+        }
+        // Leave room for aligning every column to a cache line
+        uint32_t padding = static_cast<uint32_t>(a->components.size() + 1) * 64;
+        a->capacity = std::max(1u, static_cast<uint32_t>((chunk_bytes - padding) / row_bytes));
+        uint32_t offset = a->capacity * sizeof(entity_t);
+        for (uint32_t c : a->components) {
+            offset = (offset + 63) & ~63u;
+            a->offsets[c] = offset;
+            offset += a->capacity * component_infos()[c].size;
+        }
+        return a;
+    }
+
+    // Append a row for e, component data is left for the caller to fill
+    void place(uint32_t index, archetype_t* a) {
+        if (a->chunks.empty() || a->chunks.back().count == a->capacity) {
+            chunk_t chunk;
+            chunk.data.reset(static_cast<uint8_t*>(::operator new[](chunk_bytes, std::align_val_t(64))));
+            a->chunks.push_back(std::move(chunk));
+        }
+        uint32_t ci = static_cast<uint32_t>(a->chunks.size() - 1);
+        chunk_t& chunk = a->chunks[ci];
+        uint32_t row = chunk.count++;
+        a->entities(chunk)[row] = {index, records_[index].generation};
+        records_[index].archetype = a;
+        records_[index].chunk = ci;
+        records_[index].row = row;
+    }
+
+    // Fill the hole of a removed row with the archetype's very last row, keeping chunks dense
+    void erase_row(archetype_t* a, uint32_t ci, uint32_t row) {
+        chunk_t& last_chunk = a->chunks.back();
+        uint32_t last_ci = static_cast<uint32_t>(a->chunks.size() - 1);
+        uint32_t last_row = last_chunk.count - 1;
+        if (ci != last_ci || row != last_row) {
+            chunk_t& chunk = a->chunks[ci];
+            for (uint32_t c : a->components) {
+                uint32_t size = component_infos()[c].size;
+                memcpy(a->column(chunk, c) + row * size, a->column(last_chunk, c) + last_row * size, size);
+            }
+            entity_t moved = a->entities(last_chunk)[last_row];
+            a->entities(chunk)[row] = moved;
+            records_[moved.index].chunk = ci;
+            records_[moved.index].row = row;
+        }
+        if (--last_chunk.count == 0) a->chunks.pop_back();
+    }
+
+    void move_to(uint32_t index, signature_t signature) {
+        record_t from = records_[index];
+        archetype_t* to = archetype_of(signature);
+        if (to == from.archetype) return;
+        place(index, to);
+        const record_t& rec = records_[index];
+        chunk_t& dst = to->chunks[rec.chunk];
+        if (from.archetype) {
+            chunk_t& src = from.archetype->chunks[from.chunk];
+            for (uint32_t c : to->components) {
+                if (!(from.archetype->signature & (signature_t(1) << c))) continue;
+                uint32_t size = component_infos()[c].size;
+                memcpy(to->column(dst, c) + rec.row * size, from.archetype->column(src, c) + from.row * size, size);
+            }
+            erase_row(from.archetype, from.chunk, from.row);
+        }
+    }
+
+    template<Component T>
+    T* column_of(archetype_t* a, chunk_t& chunk) {
+        return reinterpret_cast<T*>(a->column(chunk, component_id<T>()));
+    }
+
+    template<Component... Ts>
+    static signature_t signature_of() {
+        return ((signature_t(1) << component_id<Ts>()) | ... | signature_t(0));
+    }
+public:
+    EntityRegistry() = default;
+    EntityRegistry(EntityRegistry&) = delete;
+
+    template<Component... Ts>
+    entity_t Create(const Ts&... values) {
+        uint32_t index;
+        if (!free_indices_.empty()) {
+            index = free_indices_.back();
+            free_indices_.pop_back();
+        } else {
+            index = static_cast<uint32_t>(records_.size());
+            records_.push_back({nullptr, 0, 0, 0});
+        }
+        ++alive_;
+        move_to(index, signature_of<Ts...>());
+        ((Get<Ts>(entity_t{index, records_[index].generation}) = values), ...);
+        return {index, records_[index].generation};
+    }
+
+    bool IsAlive(entity_t e) const {
+        return e.index < records_.size() && records_[e.index].generation == e.generation && records_[e.index].archetype;
+    }
+
+    void Destroy(entity_t e) {
+        if (!IsAlive(e)) return;
+        record_t& rec = records_[e.index];
+        erase_row(rec.archetype, rec.chunk, rec.row);
+        rec = {nullptr, 0, 0, rec.generation + 1};
+        free_indices_.push_back(e.index);
+        --alive_;
+    }
+
+    template<Component T>
+    void Add(entity_t e, const T& value) {
+        if (!IsAlive(e)) return;
+        move_to(e.index, records_[e.index].archetype->signature | signature_of<T>());
+        Get<T>(e) = value;
+    }
+
+    template<Component T>
+    void Remove(entity_t e) {
+        if (!IsAlive(e) || !Has<T>(e)) return;
+        move_to(e.index, records_[e.index].archetype->signature & ~signature_of<T>());
+    }
+
+    template<Component T>
+    bool Has(entity_t e) const {
+        return IsAlive(e) && (records_[e.index].archetype->signature & (signature_t(1) << component_id<T>()));
+    }
+
+    /* Only valid until the next structural change */
+    template<Component T>
+    T& Get(entity_t e) {
+        record_t& rec = records_[e.index];
+        return column_of<T>(rec.archetype, rec.archetype->chunks[rec.chunk])[rec.row];
+    }
+
+    /* f(count, entities, Ts*...) once per chunk holding all of Ts, the arrays are contiguous and suit SIMD loops */
+    template<Component... Ts, typename F>
+    void ForEachChunk(F&& f) {
+        signature_t sig = signature_of<Ts...>();
+        for (auto& [signature, a] : archetypes_) {
+            if ((signature & sig) != sig) continue;
+            for (auto& chunk : a->chunks) {
+                f(chunk.count, a->entities(chunk), column_of<Ts>(a.get(), chunk)...);
+            }
+        }
+    }
+
+    /* f(Ts&...) for every entity holding all of Ts */
+    template<Component... Ts, typename F>
+    void ForEach(F&& f) {
+        ForEachChunk<Ts...>([&](uint32_t count, entity_t*, Ts*... columns) {
+            for (uint32_t i = 0; i < count; ++i) f(columns[i]...);
+        });
+    }
+
+    /* ForEachChunk with the chunks spread over pool. Structural changes must go through a CommandBuffer meanwhile */
+    template<Component... Ts, typename F>
+    void ParallelForEachChunk(JobPool& pool, F&& f) {
+        signature_t sig = signature_of<Ts...>();
+        std::vector<std::pair<archetype_t*, chunk_t*>> work;
+        for (auto& [signature, a] : archetypes_) {
+            if ((signature & sig) != sig) continue;
+            for (auto& chunk : a->chunks) work.push_back({a.get(), &chunk});
+        }
+        pool.ParallelFor(static_cast<uint32_t>(work.size()), 1, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; ++i) {
+                auto [a, chunk] = work[i];
+                f(chunk->count, a->entities(*chunk), column_of<Ts>(a, *chunk)...);
+            }
+        });
+    }
+
+    template<Component... Ts, typename F>
+    void ParallelForEach(JobPool& pool, F&& f) {
+        ParallelForEachChunk<Ts...>(pool, [&](uint32_t count, entity_t*, Ts*... columns) {
+            for (uint32_t i = 0; i < count; ++i) f(columns[i]...);
+        });
+    }
+
+    uint32_t GetEntityCount() const {
+        return alive_;
+    }
+
+    uint32_t GetArchetypeCount() const {
+        return static_cast<uint32_t>(archetypes_.size());
+    }
+
+    /* Structural changes recorded from systems, possibly on several threads, and applied in order by Sync */
+    class CommandBuffer {
+    private:
+        using apply_t = void (*)(EntityRegistry&, entity_t, const uint8_t*);
+        using command_t = struct {
+            apply_t apply;
+            entity_t entity;
+            size_t offset;
+        };
+        std::mutex mutex_;
+        std::vector<command_t> commands_;
+        std::vector<uint8_t> payload_;
+
+        // Values are stored back to back, each at a max_align_t boundary
+        template<typename T>
+        void append(const T& value) {
+            size_t offset = (payload_.size() + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+            payload_.resize(offset + sizeof(T));
+            memcpy(payload_.data() + offset, &value, sizeof(T));
+        }
+
+        template<typename... Ps>
+        void record(apply_t apply, entity_t e, const Ps&... payload) {
+            std::lock_guard lock(mutex_);
+            commands_.push_back({apply, e, payload_.size()});
+            (append(payload), ...);
+        }
+
+        template<typename T>
+        static T load(const uint8_t*& data) {
+            data = reinterpret_cast<const uint8_t*>((reinterpret_cast<uintptr_t>(data) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1));
+            T value;
+            memcpy(&value, data, sizeof(T));
+            data += sizeof(T);
+            return value;
+        }
+    public:
+        template<Component... Ts>
+        void Create(const Ts&... values) {
+            record(+[](EntityRegistry& reg, entity_t, const uint8_t* data) {
+                // Braced initialization keeps the loads in order
+                std::tuple<Ts...> v{load<Ts>(data)...};
+                std::apply([&](const Ts&... c) { reg.Create<Ts...>(c...); }, v);
+            }, {}, values...);
+        }
+
+        void Destroy(entity_t e) {
+            record(+[](EntityRegistry& reg, entity_t e, const uint8_t*) { reg.Destroy(e); }, e);
+        }
+
+        template<Component T>
+        void Add(entity_t e, const T& value) {
+            record(+[](EntityRegistry& reg, entity_t e, const uint8_t* data) { reg.Add<T>(e, load<T>(data)); }, e, value);
+        }
+
+        template<Component T>
+        void Remove(entity_t e) {
+            record(+[](EntityRegistry& reg, entity_t e, const uint8_t*) { reg.Remove<T>(e); }, e);
+        }
+
+        /* Apply and clear the recorded commands, call between systems */
+        void Sync(EntityRegistry& registry) {
+            std::lock_guard lock(mutex_);
+            for (const auto& c : commands_) c.apply(registry, c.entity, payload_.data() + c.offset);
+            commands_.clear();
+            payload_.clear();
+        }
+    };
+};
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class trace_event_type : uint8_t {
+    FRAME_BEGIN,
+    FRAME_END,
+    UPLOAD,
+    FENCE_WAIT,
+    PIPELINE_BUILD,
+    LOG,
+};
+
+inline const char* trace_event_type_name(trace_event_type type) {
+    switch (type) {
+        case trace_event_type::FRAME_BEGIN: return "frame_begin";
+        case trace_event_type::FRAME_END: return "frame";
+        case trace_event_type::UPLOAD: return "upload";
+        case trace_event_type::FENCE_WAIT: return "fence_wait";
+        case trace_event_type::PIPELINE_BUILD: return "pipeline_build";
+        default: return "log";
+    }
+}
+
+/* One recorded event. name must have static storage, string literals and log format strings do */
+struct trace_event_t {
+    int64_t time_ns;        // start of the event
+    int64_t duration_ns;    // 0 for instant events
+    const char* name;
+    uint64_t value;         // bytes for uploads, frame index for frames
+    uint32_t thread;
+    trace_event_type type;
+};
+
+struct flight_config_t {
+    uint32_t capacity;          // events kept, rounded up to a power of two
+    uint32_t dump_frames;       // frames written to the trace when a hitch is detected
+    uint32_t median_frames;     // frames the rolling median is taken over
+    float hitch_ratio;          // a frame longer than median * hitch_ratio is a hitch
+    float min_hitch_ms;         // ignore hitches shorter than this
+    const char* trace_prefix;   // traces are written to <prefix><frame>.json
+};
+
+inline int64_t trace_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline uint32_t trace_thread_id() {
+    static std::atomic<uint32_t> next{0};
+    static thread_local uint32_t id = next.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+
+/* Always-on ring of recent events. Recording claims a slot with one fetch_add and writes it as a seqlock, so any
+ * thread may record while the main thread dumps. Frame boundaries feed a rolling median; when a frame exceeds it by
+ * hitch_ratio the last dump_frames frames are written as a Chrome trace (chrome://tracing or Perfetto). */
+class FlightRecorder {
+private:
+    struct slot_t {
+        std::atomic<uint64_t> sequence{0};  // odd while being written, else 2 * lap
+        std::atomic<int64_t> time_ns;
+        std::atomic<int64_t> duration_ns;
+        std::atomic<const char*> name;
+        std::atomic<uint64_t> value;
+        std::atomic<uint32_t> thread;
+        std::atomic<trace_event_type> type;
+    };
+    flight_config_t config_;
+    std::unique_ptr<slot_t[]> slots_;
+    uint64_t mask_;
+    alignas(64) std::atomic<uint64_t> next_{0};
+    // Main thread only
+    uint64_t frame_{0};
+    int64_t frame_begin_ns_{0};
+    std::vector<int64_t> frame_starts_;     // ring of the last dump_frames frame starts
+    std::vector<float> frame_ms_;           // ring of the last median_frames frame times
+    std::vector<float> median_scratch_;
+    uint64_t last_dump_frame_{0};
+
+    bool read(uint64_t index, trace_event_t& e) const {
+        const slot_t& slot = slots_[index & mask_];
+        uint64_t expected = 2 * (index / (mask_ + 1) + 1);
+        if (slot.sequence.load(std::memory_order_acquire) != expected) return false;
+        e.time_ns = slot.time_ns.load(std::memory_order_relaxed);
+        e.duration_ns = slot.duration_ns.load(std::memory_order_relaxed);
+        e.name = slot.name.load(std::memory_order_relaxed);
+        e.value = slot.value.load(std::memory_order_relaxed);
+        e.thread = slot.thread.load(std::memory_order_relaxed);
+        e.type = slot.type.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.sequence.load(std::memory_order_relaxed) == expected;
+    }
+
+    static void write_json_string(std::ofstream& out, const char* s) {
+        out << '"';
+        for (; s && *s; ++s) {
+            char c = *s;
+            if (c == '"' || c == '\\') out << '\\' << c;
+            else if (static_cast<unsigned char>(c) < 0x20) out << ' ';
+            else out << c;
+        }
+        out << '"';
+    }
+
+    float median_ms() {
+        median_scratch_ = frame_ms_;
+        auto mid = median_scratch_.begin() + median_scratch_.size() / 2;
+        std::nth_element(median_scratch_.begin(), mid, median_scratch_.end());
+        return *mid;
+    }
+public:
+    FlightRecorder(const flight_config_t& config) : config_(config) {
+        uint64_t capacity = 1;
+        while (capacity < config.capacity) capacity <<= 1;
+        mask_ = capacity - 1;
+        slots_ = std::make_unique<slot_t[]>(capacity);
+        frame_starts_.assign(std::max(1u, config.dump_frames), 0);
+        frame_ms_.reserve(config.median_frames);
+    }
+    FlightRecorder(FlightRecorder&) = delete;
+
+    void Record(trace_event_type type, const char* name, int64_t time_ns, int64_t duration_ns = 0, uint64_t value = 0) {
+        uint64_t index = next_.fetch_add(1, std::memory_order_relaxed);
+        slot_t& slot = slots_[index & mask_];
+        uint64_t lap = index / (mask_ + 1);
+        slot.sequence.store(2 * lap + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.time_ns.store(time_ns, std::memory_order_relaxed);
+        slot.duration_ns.store(duration_ns, std::memory_order_relaxed);
+        slot.name.store(name, std::memory_order_relaxed);
+        slot.value.store(value, std::memory_order_relaxed);
+        slot.thread.store(trace_thread_id(), std::memory_order_relaxed);
+        slot.type.store(type, std::memory_order_relaxed);
+        slot.sequence.store(2 * lap + 2, std::memory_order_release);
+    }
+
+    void BeginFrame() {
+        frame_begin_ns_ = trace_now_ns();
+        frame_starts_[frame_ % frame_starts_.size()] = frame_begin_ns_;
+        Record(trace_event_type::FRAME_BEGIN, "frame", frame_begin_ns_, 0, frame_);
+    }
+
+    /* Closes the frame, returns the trace file name when it was a hitch and got dumped, else an empty string */
+    std::string EndFrame() {
+        int64_t end = trace_now_ns();
+        Record(trace_event_type::FRAME_END, "frame", frame_begin_ns_, end - frame_begin_ns_, frame_);
+        float ms = static_cast<float>(end - frame_begin_ns_) * 1e-6f;
+        std::string trace;
+        if (frame_ms_.size() == config_.median_frames) {
+            float threshold = median_ms() * config_.hitch_ratio;
+            // Skip hitches right after a dump, writing the trace is the likely cause
+            bool cooled_down = frame_ >= last_dump_frame_ + config_.dump_frames || last_dump_frame_ == 0;
+            if (ms > threshold && ms >= config_.min_hitch_ms && cooled_down) {
+                trace = std::string(config_.trace_prefix) + std::to_string(frame_) + ".json";
+                if (!Dump(trace)) trace.clear();
+                last_dump_frame_ = frame_;
+            }
+            frame_ms_[frame_ % config_.median_frames] = ms;
+        } else {
+            frame_ms_.push_back(ms);
+        }
+        ++frame_;
+        return trace;
+    }
+
+    /* Write every event since the start of the oldest kept frame. Call from the thread driving the frames */
+    bool Dump(const std::string& file_name) const {
+        uint64_t frames = std::min<uint64_t>(frame_ + 1, frame_starts_.size());
+        int64_t since = frame_starts_[(frame_ + 1 - frames) % frame_starts_.size()];
+        std::vector<trace_event_t> events;
+        uint64_t end = next_.load(std::memory_order_acquire);
+        uint64_t begin = end > mask_ + 1 ? end - (mask_ + 1) : 0;
+        for (uint64_t i = begin; i < end; ++i) {
+            trace_event_t e;
+            if (read(i, e) && e.time_ns >= since) events.push_back(e);
+        }
+        std::sort(events.begin(), events.end(), [](const auto& a, const auto& b) { return a.time_ns < b.time_ns; });
+        std::ofstream out(file_name);
+        if (!out) return false;
+        out << "{\"traceEvents\":[";
+        bool first = true;
+        for (const auto& e : events) {
+            if (e.type == trace_event_type::FRAME_BEGIN) continue;
+            out << (first ? "\n" : ",\n") << "{\"name\":";
+            first = false;
+            write_json_string(out, e.name);
+            out << ",\"cat\":\"" << trace_event_type_name(e.type) << "\",\"pid\":1,\"tid\":" << e.thread;
+            out << ",\"ts\":" << (e.time_ns - since) / 1000.0;
+            if (e.type == trace_event_type::LOG) {
+                out << ",\"ph\":\"i\",\"s\":\"t\"";
+            } else {
+                out << ",\"ph\":\"X\",\"dur\":" << e.duration_ns / 1000.0;
+            }
+            out << ",\"args\":{\"value\":" << e.value << "}}";
+        }
+        out << "\n]}\n";
+        return out.good();
+    }
+
+    uint64_t GetFrame() const {
+        return frame_;
+    }
+};
+
+inline std::unique_ptr<FlightRecorder>& g_flight_recorder() {
+    static std::unique_ptr<FlightRecorder> recorder;
+    return recorder;
+}
+
+inline void flight_init(const flight_config_t& config = {1 << 16, 8, 120, 2.0f, 8.0f, "hitch_"}) {
+    g_flight_recorder() = std::make_unique<FlightRecorder>(config);
+}
+
+inline void flight_record(trace_event_type type, const char* name, uint64_t value = 0) {
+    if (auto& recorder = g_flight_recorder()) recorder->Record(type, name, trace_now_ns(), 0, value);
+}
+
+/* Records the lifetime of the scope as one event, costs a null check when the recorder is off */
+class TraceScope {
+private:
+    trace_event_type type_;
+    const char* name_;
+    uint64_t value_;
+    int64_t begin_;
+public:
+    TraceScope(trace_event_type type, const char* name, uint64_t value = 0) : type_(type), name_(name), value_(value) {
+        begin_ = g_flight_recorder() ? trace_now_ns() : 0;
+    }
+    TraceScope(TraceScope&) = delete;
+
+    ~TraceScope() {
+        if (auto& recorder = g_flight_recorder()) {
+            if (begin_) recorder->Record(type_, name_, begin_, trace_now_ns() - begin_, value_);
+        }
+    }
+};
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+// Plain bounding volumes shared by culling, batching and spatial queries. Matrices are row-major with row vectors,
+// the same convention as the shaders and DirectXMath.
+
+struct float3_t {
+    float x, y, z;
+};
+
+struct aabb_t {
+    float3_t min;
+    float3_t max;
+};
+
+struct sphere_t {
+    float3_t center;
+    float radius;
+};
+
+// Plane as (a, b, c, d) with a*x + b*y + c*z + d >= 0 on the inner side
+struct plane_t {
+    float a, b, c, d;
+};
+
+struct frustum_t {
+    plane_t planes[6];
+};
+
+inline aabb_t aabb_empty() {
+    constexpr float inf = std::numeric_limits<float>::infinity();
+    return {{inf, inf, inf}, {-inf, -inf, -inf}};
+}
+
+inline bool aabb_is_empty(const aabb_t& b) {
+    return b.min.x > b.max.x || b.min.y > b.max.y || b.min.z > b.max.z;
+}
+
+inline void aabb_extend(aabb_t& b, const float3_t& p) {
+    b.min = {std::min(b.min.x, p.x), std::min(b.min.y, p.y), std::min(b.min.z, p.z)};
+    b.max = {std::max(b.max.x, p.x), std::max(b.max.y, p.y), std::max(b.max.z, p.z)};
+}
+
+inline void aabb_merge(aabb_t& b, const aabb_t& o) {
+    aabb_extend(b, o.min);
+    aabb_extend(b, o.max);
+}
+
+inline float3_t aabb_center(const aabb_t& b) {
+    return {(b.min.x + b.max.x) * 0.5f, (b.min.y + b.max.y) * 0.5f, (b.min.z + b.max.z) * 0.5f};
+}
+
+inline float3_t aabb_extent(const aabb_t& b) {
+    return {(b.max.x - b.min.x) * 0.5f, (b.max.y - b.min.y) * 0.5f, (b.max.z - b.min.z) * 0.5f};
+}
+
+inline bool aabb_overlaps(const aabb_t& a, const aabb_t& b) {
+    return a.min.x <= b.max.x && a.max.x >= b.min.x &&
+        a.min.y <= b.max.y && a.max.y >= b.min.y &&
+        a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
+
+inline bool aabb_contains(const aabb_t& b, const float3_t& p) {
+    return p.x >= b.min.x && p.x <= b.max.x && p.y >= b.min.y && p.y <= b.max.y && p.z >= b.min.z && p.z <= b.max.z;
+}
+
+inline sphere_t aabb_bounding_sphere(const aabb_t& b) {
+    float3_t e = aabb_extent(b);
+    return {aabb_center(b), std::sqrt(e.x * e.x + e.y * e.y + e.z * e.z)};
+}
+
+inline float distance_squared(const float3_t& a, const float3_t& b) {
+    float dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+    return dx * dx + dy * dy + dz * dz;
+}
+
+inline bool sphere_overlaps_aabb(const sphere_t& s, const aabb_t& b) {
+    float3_t p = {
+        std::clamp(s.center.x, b.min.x, b.max.x),
+        std::clamp(s.center.y, b.min.y, b.max.y),
+        std::clamp(s.center.z, b.min.z, b.max.z),
+    };
+    return distance_squared(p, s.center) <= s.radius * s.radius;
+}
+
+// Transform a point by a row-major matrix as a row vector
+inline float3_t transform_point(const float m[4][4], const float3_t& p) {
+    return {
+        p.x * m[0][0] + p.y * m[1][0] + p.z * m[2][0] + m[3][0],
+        p.x * m[0][1] + p.y * m[1][1] + p.z * m[2][1] + m[3][1],
+        p.x * m[0][2] + p.y * m[1][2] + p.z * m[2][2] + m[3][2],
+    };
+}
+
+// Cofactors of the upper 3x3, the inverse transpose up to 1/det. sign keeps the determinant's sign so mirrored
+// transforms still produce outward normals
+struct normal_matrix_t {
+    float m[3][3];
+    float sign;
+};
+
+inline normal_matrix_t normal_matrix(const float m[4][4]) {
+    normal_matrix_t n{};
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            n.m[i][j] = m[(i + 1) % 3][(j + 1) % 3] * m[(i + 2) % 3][(j + 2) % 3] - m[(i + 1) % 3][(j + 2) % 3] * m[(i + 2) % 3][(j + 1) % 3];
+        }
+    }
+    float det = m[0][0] * n.m[0][0] + m[0][1] * n.m[0][1] + m[0][2] * n.m[0][2];
+    n.sign = det < 0.0f ? -1.0f : 1.0f;
+    return n;
+}
+
+inline float3_t transform_normal(const normal_matrix_t& n, const float3_t& v) {
+    float3_t r = {
+        (v.x * n.m[0][0] + v.y * n.m[1][0] + v.z * n.m[2][0]) * n.sign,
+        (v.x * n.m[0][1] + v.y * n.m[1][1] + v.z * n.m[2][1]) * n.sign,
+        (v.x * n.m[0][2] + v.y * n.m[1][2] + v.z * n.m[2][2]) * n.sign,
+    };
+    float len = std::sqrt(r.x * r.x + r.y * r.y + r.z * r.z);
+    if (len > 0.0f) {
+        r.x /= len; r.y /= len; r.z /= len;
+    }
+    return r;
+}
+
+// World space bounds of a transformed box (Arvo's method)
+inline aabb_t transform_aabb(const float m[4][4], const aabb_t& b) {
+    aabb_t r = {{m[3][0], m[3][1], m[3][2]}, {m[3][0], m[3][1], m[3][2]}};
+    const float bmin[3] = {b.min.x, b.min.y, b.min.z};
+    const float bmax[3] = {b.max.x, b.max.y, b.max.z};
+    float* rmin = &r.min.x;
+    float* rmax = &r.max.x;
+    for (int j = 0; j < 3; ++j) {
+        for (int i = 0; i < 3; ++i) {
+            float e = m[i][j] * bmin[i];
+            float f = m[i][j] * bmax[i];
+            rmin[j] += std::min(e, f);
+            rmax[j] += std::max(e, f);
+        }
+    }
+    return r;
+}
+
+// Extract the clip planes of a row-major view-projection matrix with D3D depth range [0, w]
+inline frustum_t frustum_from_matrix(const float m[4][4]) {
+    auto column = [&](int j) -> plane_t {
+        return {m[0][j], m[1][j], m[2][j], m[3][j]};
+    };
+    auto combine = [](const plane_t& a, const plane_t& b, float s) -> plane_t {
+        return {a.a + s * b.a, a.b + s * b.b, a.c + s * b.c, a.d + s * b.d};
+    };
+    plane_t c0 = column(0), c1 = column(1), c2 = column(2), c3 = column(3);
+    frustum_t f{};
+    f.planes[0] = combine(c3, c0, 1.0f);   // left
+    f.planes[1] = combine(c3, c0, -1.0f);  // right
+    f.planes[2] = combine(c3, c1, 1.0f);   // bottom
+    f.planes[3] = combine(c3, c1, -1.0f);  // top
+    f.planes[4] = c2;                      // near
+    f.planes[5] = combine(c3, c2, -1.0f);  // far
+    for (auto& p : f.planes) {
+        float len = std::sqrt(p.a * p.a + p.b * p.b + p.c * p.c);
+        if (len > 0.0f) {
+            p.a /= len; p.b /= len; p.c /= len; p.d /= len;
+        }
+    }
+    return f;
+}
+
+// Bounds of the frustum's eight corners, each the intersection of a side, a top/bottom and a near/far plane
+inline aabb_t frustum_bounds(const frustum_t& f) {
+    auto intersect = [](const plane_t& p1, const plane_t& p2, const plane_t& p3) -> float3_t {
+        auto cross = [](const plane_t& a, const plane_t& b) -> float3_t {
+            return {a.b * b.c - a.c * b.b, a.c * b.a - a.a * b.c, a.a * b.b - a.b * b.a};
+        };
+        float3_t c23 = cross(p2, p3), c31 = cross(p3, p1), c12 = cross(p1, p2);
+        float denom = p1.a * c23.x + p1.b * c23.y + p1.c * c23.z;
+        return {
+            -(p1.d * c23.x + p2.d * c31.x + p3.d * c12.x) / denom,
+            -(p1.d * c23.y + p2.d * c31.y + p3.d * c12.y) / denom,
+            -(p1.d * c23.z + p2.d * c31.z + p3.d * c12.z) / denom,
+        };
+    };
+    aabb_t b = aabb_empty();
+    for (int x = 0; x < 2; ++x) {
+        for (int y = 2; y < 4; ++y) {
+            for (int z = 4; z < 6; ++z) {
+                aabb_extend(b, intersect(f.planes[x], f.planes[y], f.planes[z]));
+            }
+        }
+    }
+    return b;
+}
+
+inline bool frustum_overlaps_aabb(const frustum_t& f, const aabb_t& b) {
+    for (const auto& p : f.planes) {
+        // Test the corner furthest along the plane normal
+        float x = p.a >= 0.0f ? b.max.x : b.min.x;
+        float y = p.b >= 0.0f ? b.max.y : b.min.y;
+        float z = p.c >= 0.0f ? b.max.z : b.min.z;
+        if (p.a * x + p.b * y + p.c * z + p.d < 0.0f) return false;
+    }
+    return true;
+}
+
+inline bool frustum_overlaps_sphere(const frustum_t& f, const sphere_t& s) {
+    for (const auto& p : f.planes) {
+        if (p.a * s.center.x + p.b * s.center.y + p.c * s.center.z + p.d < -s.radius) return false;
+    }
+    return true;
+}
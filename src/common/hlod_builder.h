@@ -0,0 +1,249 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include "geometry.h"
+#include "memory_stats.h"
+
+template<typename V>
+concept HLODVertex = requires(V v) {
+    v.x; v.y; v.z;
+    v.nx; v.ny; v.nz;
+    v.u; v.v;
+};
+
+struct hlod_param_t {
+    float cluster_size;         // edge of the grid cell objects are clustered by
+    float simplify_cell_size;   // vertices closer than this collapse in the proxy mesh
+    uint32_t atlas_tile_size;   // texels per child texture in the cluster atlas
+    float switch_distance;      // camera distance to the cluster bounds where the proxy takes over
+};
+
+template<HLODVertex V>
+struct hlod_object_t {
+    const V* vertices;
+    uint32_t vertex_count;
+    const uint32_t* indices;
+    uint32_t index_count;
+    float world_matrix[4][4];
+    const uint8_t* texture;     // RGBA8, nullptr for untextured
+    uint32_t texture_width;
+    uint32_t texture_height;
+    uint32_t drawcall_index;    // drawcall rendering the object at full detail
+};
+
+/* Objects merged into one proxy: the proxy mesh in world space and its RGBA8 atlas, one tile per child */
+template<HLODVertex V>
+struct hlod_cluster_t {
+    aabb_t bounds;
+    std::vector<uint32_t> children;     // drawcall_index of every child
+    std::vector<aabb_t> children_bounds;
+    std::vector<uint32_t> children_triangle_counts;
+    uint32_t children_triangles;
+    uint32_t proxy_triangles;
+    std::vector<V> vertices;
+    std::vector<uint32_t> indices;
+    uint32_t atlas_width;
+    uint32_t atlas_height;
+    std::vector<uint8_t> atlas;
+};
+
+/* Draws and triangles submitted vs. drawing every visible cluster's children */
+struct hlod_stats_t {
+    uint32_t draws;
+    uint32_t full_draws;
+    uint64_t triangles;
+    uint64_t full_triangles;
+    uint32_t proxies;
+};
+
+// Box filter a child texture into its atlas tile, untextured children get a neutral gray
+template<HLODVertex V>
+inline void hlod_bake_tile(std::vector<uint8_t>& atlas, uint32_t atlas_width, uint32_t tile, const hlod_object_t<V>& obj, uint32_t tx, uint32_t ty) {
+    for (uint32_t y = 0; y < tile; ++y) {
+        for (uint32_t x = 0; x < tile; ++x) {
+            uint8_t* dst = &atlas[((ty * tile + y) * atlas_width + tx * tile + x) * 4];
+            if (obj.texture == nullptr || obj.texture_width == 0 || obj.texture_height == 0) {
+                dst[0] = dst[1] = dst[2] = 128;
+                dst[3] = 255;
+                continue;
+            }
+            uint32_t x0 = x * obj.texture_width / tile;
+            uint32_t x1 = std::max(x0 + 1, (x + 1) * obj.texture_width / tile);
+            uint32_t y0 = y * obj.texture_height / tile;
+            uint32_t y1 = std::max(y0 + 1, (y + 1) * obj.texture_height / tile);
+            uint32_t sum[4] = {};
+            for (uint32_t sy = y0; sy < y1; ++sy) {
+                for (uint32_t sx = x0; sx < x1; ++sx) {
+                    const uint8_t* src = &obj.texture[(static_cast<size_t>(sy) * obj.texture_width + sx) * 4];
+                    for (int c = 0; c < 4; ++c) sum[c] += src[c];
+                }
+            }
+            uint32_t n = (x1 - x0) * (y1 - y0);
+            for (int c = 0; c < 4; ++c) dst[c] = static_cast<uint8_t>(sum[c] / n);
+        }
+    }
+}
+
+/* UV folded into [0, 1]. Coordinates inside the range are kept so the far edge stays at 1 instead of wrapping to
+ * 0, tiling UVs outside it keep their fractional part and whole numbers past 1 land on 1 */
+inline float hlod_wrap_uv(float x) {
+    if (x >= 0.0f && x <= 1.0f) return x;
+    float f = x - std::floor(x);
+    return f == 0.0f && x > 0.0f ? 1.0f : f;
+}
+
+/* Merge objects[members] into cluster: bake the atlas and simplify the combined mesh by vertex clustering */
+template<HLODVertex V>
+inline void hlod_build_cluster(hlod_cluster_t<V>& cluster, const std::vector<hlod_object_t<V>>& objects, const std::vector<uint32_t>& members, const hlod_param_t& param) {
+    uint32_t tile = param.atlas_tile_size;
+    uint32_t cols = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(members.size()))));
+    uint32_t rows = (static_cast<uint32_t>(members.size()) + cols - 1) / cols;
+    cluster.atlas_width = cols * tile;
+    cluster.atlas_height = rows * tile;
+    cluster.atlas.assign(static_cast<size_t>(cluster.atlas_width) * cluster.atlas_height * 4, 0);
+    g_memory_stats().AddCPU(memory_category::TEXTURE, cluster.atlas.size());
+    cluster.bounds = aabb_empty();
+    cluster.children_triangles = 0;
+
+    struct accum_t {
+        float3_t pos;
+        float3_t normal;
+        float u, v;
+        uint32_t count;
+        V first;
+    };
+    // Vertices collapse per (simplification cell, child) so every proxy vertex keeps UVs inside one atlas tile
+    std::map<std::tuple<int32_t, int32_t, int32_t, uint32_t>, uint32_t> lookup;
+    std::vector<accum_t> accums;
+    std::vector<uint32_t> triangles;
+    float inv_cell = 1.0f / param.simplify_cell_size;
+    for (uint32_t k = 0; k < members.size(); ++k) {
+        const hlod_object_t<V>& obj = objects[members[k]];
+        uint32_t tx = k % cols;
+        uint32_t ty = k / cols;
+        hlod_bake_tile(cluster.atlas, cluster.atlas_width, tile, obj, tx, ty);
+        normal_matrix_t nm = normal_matrix(obj.world_matrix);
+        aabb_t child_bounds = aabb_empty();
+        std::vector<uint32_t> remap(obj.vertex_count);
+        for (uint32_t i = 0; i < obj.vertex_count; ++i) {
+            const V& src = obj.vertices[i];
+            float3_t p = transform_point(obj.world_matrix, {src.x, src.y, src.z});
+            float3_t n = transform_normal(nm, {src.nx, src.ny, src.nz});
+            aabb_extend(child_bounds, p);
+            // Remap UVs into the child's tile with a half texel inset against bleeding
+            float fu = hlod_wrap_uv(src.u);
+            float fv = hlod_wrap_uv(src.v);
+            float u = (tx * tile + 0.5f + fu * (tile - 1)) / cluster.atlas_width;
+            float v = (ty * tile + 0.5f + fv * (tile - 1)) / cluster.atlas_height;
+            auto key = std::make_tuple(
+                static_cast<int32_t>(std::floor(p.x * inv_cell)),
+                static_cast<int32_t>(std::floor(p.y * inv_cell)),
+                static_cast<int32_t>(std::floor(p.z * inv_cell)), k);
+            auto it = lookup.find(key);
+            if (it == lookup.end()) {
+                it = lookup.emplace(key, static_cast<uint32_t>(accums.size())).first;
+                accums.push_back({{0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, 0.0f, 0.0f, 0, src});
+            }
+            accum_t& a = accums[it->second];
+            a.pos = {a.pos.x + p.x, a.pos.y + p.y, a.pos.z + p.z};
+            a.normal = {a.normal.x + n.x, a.normal.y + n.y, a.normal.z + n.z};
+            a.u += u;
+            a.v += v;
+            ++a.count;
+            remap[i] = it->second;
+        }
+        for (uint32_t i = 0; i + 2 < obj.index_count; i += 3) {
+            uint32_t a = remap[obj.indices[i]];
+            uint32_t b = remap[obj.indices[i + (nm.sign < 0.0f ? 2 : 1)]];
+            uint32_t c = remap[obj.indices[i + (nm.sign < 0.0f ? 1 : 2)]];
+            // Triangles collapsed into an edge or a point disappear
+            if (a == b || b == c || a == c) continue;
+            triangles.insert(triangles.end(), {a, b, c});
+        }
+        cluster.children.push_back(obj.drawcall_index);
+        cluster.children_bounds.push_back(child_bounds);
+        cluster.children_triangle_counts.push_back(obj.index_count / 3);
+        cluster.children_triangles += obj.index_count / 3;
+        aabb_merge(cluster.bounds, child_bounds);
+    }
+    cluster.vertices.reserve(accums.size());
+    for (auto& a : accums) {
+        V v = a.first;
+        float inv = 1.0f / static_cast<float>(a.count);
+        float3_t n = a.normal;
+        float len = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+        if (len > 0.0f) n = {n.x / len, n.y / len, n.z / len};
+        v.x = a.pos.x * inv; v.y = a.pos.y * inv; v.z = a.pos.z * inv;
+        v.nx = n.x; v.ny = n.y; v.nz = n.z;
+        v.u = a.u * inv; v.v = a.v * inv;
+        cluster.vertices.push_back(v);
+    }
+    cluster.indices = std::move(triangles);
+    cluster.proxy_triangles = static_cast<uint32_t>(cluster.indices.size() / 3);
+}
+
+/* Cluster objects on a uniform grid and build a proxy per cell of two or more objects, a lone object gains nothing
+ * from a proxy and keeps its own LODs. Cluster extends hlod_cluster_t<V> with whatever the caller attaches to it */
+template<HLODVertex V, typename Cluster = hlod_cluster_t<V>>
+inline std::vector<Cluster> build_hlod_clusters(const std::vector<hlod_object_t<V>>& objects, const hlod_param_t& param) {
+    std::map<std::tuple<int32_t, int32_t, int32_t>, std::vector<uint32_t>> cells;
+    for (uint32_t i = 0; i < objects.size(); ++i) {
+        const auto& obj = objects[i];
+        aabb_t bounds = aabb_empty();
+        for (uint32_t j = 0; j < obj.vertex_count; ++j) {
+            aabb_extend(bounds, transform_point(obj.world_matrix, {obj.vertices[j].x, obj.vertices[j].y, obj.vertices[j].z}));
+        }
+        float3_t c = aabb_center(bounds);
+        cells[{static_cast<int32_t>(std::floor(c.x / param.cluster_size)),
+               static_cast<int32_t>(std::floor(c.y / param.cluster_size)),
+               static_cast<int32_t>(std::floor(c.z / param.cluster_size))}].push_back(i);
+    }
+    std::vector<Cluster> clusters;
+    for (auto& [cell, members] : cells) {
+        if (members.size() < 2) continue;
+        Cluster cluster{};
+        hlod_build_cluster<V>(cluster, objects, members, param);
+        clusters.push_back(std::move(cluster));
+    }
+    return clusters;
+}
+
+/* Pick what a cluster draws this frame: its proxy beyond switch_distance, otherwise its children inside frustum.
+ * show_child(child, visible) is called for every child, the result tells whether the proxy is drawn. Counts what
+ * is drawn into stats */
+template<HLODVertex V, typename F>
+inline bool select_hlod_cluster(const hlod_cluster_t<V>& cluster, const float3_t& camera_position, const frustum_t& frustum, float switch_distance, hlod_stats_t& stats, F&& show_child) {
+    float3_t nearest = {
+        std::clamp(camera_position.x, cluster.bounds.min.x, cluster.bounds.max.x),
+        std::clamp(camera_position.y, cluster.bounds.min.y, cluster.bounds.max.y),
+        std::clamp(camera_position.z, cluster.bounds.min.z, cluster.bounds.max.z),
+    };
+    bool far = distance_squared(nearest, camera_position) > switch_distance * switch_distance;
+    bool in_frustum = frustum_overlaps_aabb(frustum, cluster.bounds);
+    for (uint32_t i = 0; i < cluster.children.size(); ++i) {
+        bool child_in_frustum = frustum_overlaps_aabb(frustum, cluster.children_bounds[i]);
+        bool visible = !far && child_in_frustum;
+        show_child(i, visible);
+        if (visible) {
+            ++stats.draws;
+            stats.triangles += cluster.children_triangle_counts[i];
+        }
+        if (child_in_frustum) {
+            ++stats.full_draws;
+            stats.full_triangles += cluster.children_triangle_counts[i];
+        }
+    }
+    if (far && in_frustum) {
+        ++stats.draws;
+        ++stats.proxies;
+        stats.triangles += cluster.proxy_triangles;
+    }
+    return far && in_frustum;
+}
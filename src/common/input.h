@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string_view>
+
+/* One frame of camera input. Cursor movement is in whole pixels as the OS reports it, so a replay reproduces it
+ * exactly */
+struct input_frame_t {
+    float delta_ms;
+    int16_t cursor_dx;
+    int16_t cursor_dy;
+    uint8_t keys;
+};
+
+enum input_key : uint8_t {
+    INPUT_KEY_FORWARD = 1 << 0,
+    INPUT_KEY_LEFT = 1 << 1,
+    INPUT_KEY_BACK = 1 << 2,
+    INPUT_KEY_RIGHT = 1 << 3,
+    INPUT_KEY_UP = 1 << 4,
+    INPUT_KEY_DOWN = 1 << 5,
+};
+
+class InputSource {
+public:
+    virtual ~InputSource() = default;
+    /* Fill frame for a frame that took delta_ms, returns false when no more input is available */
+    virtual bool Poll(float delta_ms, input_frame_t& frame) = 0;
+    virtual void SetActive(bool) {}
+};
+
+/* Passes another source through and appends every frame to a file. Each frame takes 9 bytes */
+class InputRecorder : public InputSource {
+private:
+    InputSource& source_;
+    std::ofstream out_;
+public:
+    InputRecorder(InputSource& source, std::string_view file_name) : source_(source), out_(file_name.data(), std::ios::out | std::ios::binary) {
+        uint32_t magic = 0x504e4947; // GINP
+        out_.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+    }
+
+    bool IsOpen() const {
+        return out_.good();
+    }
+
+    bool Poll(float delta_ms, input_frame_t& frame) override {
+        if (!source_.Poll(delta_ms, frame)) return false;
+        out_.write(reinterpret_cast<const char*>(&frame.delta_ms), sizeof(frame.delta_ms));
+        out_.write(reinterpret_cast<const char*>(&frame.cursor_dx), sizeof(frame.cursor_dx));
+        out_.write(reinterpret_cast<const char*>(&frame.cursor_dy), sizeof(frame.cursor_dy));
+        out_.write(reinterpret_cast<const char*>(&frame.keys), sizeof(frame.keys));
+        return true;
+    }
+
+    void SetActive(bool active) override {
+        source_.SetActive(active);
+    }
+};
+
+/* Plays a recording back frame by frame. The recorded delta time replaces the real one, so the camera follows the
+ * same path regardless of how fast the frames are rendered */
+class InputReplayer : public InputSource {
+private:
+    std::ifstream in_;
+    uint32_t frame_{0};
+    bool finished_{false};
+public:
+    InputReplayer(std::string_view file_name) : in_(file_name.data(), std::ios::in | std::ios::binary) {
+        uint32_t magic = 0;
+        in_.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+        finished_ = !in_.good() || magic != 0x504e4947;
+    }
+
+    bool IsOpen() const {
+        return !finished_ || frame_ > 0;
+    }
+
+    bool Poll(float, input_frame_t& frame) override {
+        if (finished_) return false;
+        in_.read(reinterpret_cast<char*>(&frame.delta_ms), sizeof(frame.delta_ms));
+        in_.read(reinterpret_cast<char*>(&frame.cursor_dx), sizeof(frame.cursor_dx));
+        in_.read(reinterpret_cast<char*>(&frame.cursor_dy), sizeof(frame.cursor_dy));
+        in_.read(reinterpret_cast<char*>(&frame.keys), sizeof(frame.keys));
+        if (!in_.good()) {
+            finished_ = true;
+            return false;
+        }
+        ++frame_;
+        return true;
+    }
+
+    bool IsFinished() const {
+        return finished_;
+    }
+
+    uint32_t GetFrame() const {
+        return frame_;
+    }
+};
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Fixed set of worker threads fed from one queue. Threads waiting on the pool run queued jobs themselves instead of
+ * sleeping, so ParallelFor may be called from inside a job without starving the workers. */
+class JobPool {
+private:
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> queue_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    uint32_t pending_{0};
+    bool stop_{false};
+
+    bool try_run_one() {
+        std::function<void()> job;
+        {
+            std::lock_guard lock(mutex_);
+            if (queue_.empty()) return false;
+            job = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        job();
+        finish_one();
+        return true;
+    }
+
+    void finish_one() {
+        std::lock_guard lock(mutex_);
+        if (--pending_ == 0) idle_.notify_all();
+    }
+
+    void worker_loop() {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock lock(mutex_);
+                wake_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+                if (stop_ && queue_.empty()) return;
+                job = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            job();
+            finish_one();
+        }
+    }
+public:
+    /* The calling thread takes part in ParallelFor, so by default one worker fewer than the hardware threads */
+    JobPool(uint32_t worker_count = std::max(1u, std::thread::hardware_concurrency()) - 1) {
+        for (uint32_t i = 0; i < worker_count; ++i) {
+            workers_.emplace_back([this]() { worker_loop(); });
+        }
+    }
+    JobPool(JobPool&) = delete;
+
+    ~JobPool() {
+        {
+            std::lock_guard lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& w : workers_) w.join();
+    }
+
+    void Submit(std::function<void()> job) {
+        if (workers_.empty()) {
+            job();
+            return;
+        }
+        {
+            std::lock_guard lock(mutex_);
+            queue_.push_back(std::move(job));
+            ++pending_;
+        }
+        wake_.notify_one();
+    }
+
+    /* Block until every submitted job finished, helping with the queue meanwhile */
+    void Wait() {
+        while (try_run_one()) {}
+        std::unique_lock lock(mutex_);
+        idle_.wait(lock, [this]() { return pending_ == 0; });
+    }
+
+    /* Call f(begin, end) over [0, count) in chunks of grain items, returns once all chunks are done */
+    template<typename F>
+    void ParallelFor(uint32_t count, uint32_t grain, F&& f) {
+        grain = std::max(1u, grain);
+        uint32_t chunks = (count + grain - 1) / grain;
+        if (chunks <= 1 || workers_.empty()) {
+            if (count) f(0u, count);
+            return;
+        }
+        struct shared_t {
+            std::atomic<uint32_t> next{0};
+            std::atomic<uint32_t> helpers{0};
+        } shared;
+        auto run = [&]() {
+            for (uint32_t c = shared.next.fetch_add(1); c < chunks; c = shared.next.fetch_add(1)) {
+                f(c * grain, std::min(count, (c + 1) * grain));
+            }
+        };
+        uint32_t helpers = std::min(static_cast<uint32_t>(workers_.size()), chunks - 1);
+        shared.helpers = helpers;
+        for (uint32_t i = 0; i < helpers; ++i) {
+            Submit([&]() {
+                run();
+                shared.helpers.fetch_sub(1, std::memory_order_release);
+            });
+        }
+        run();
+        // Helpers still reference shared, wait for them while draining other work
+        while (shared.helpers.load(std::memory_order_acquire) != 0) {
+            if (!try_run_one()) std::this_thread::yield();
+        }
+    }
+
+    uint32_t GetWorkerCount() const {
+        return static_cast<uint32_t>(workers_.size());
+    }
+};
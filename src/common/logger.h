@@ -1,7 +1,22 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <ctime>
 #include <format>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+
+#include "flight_recorder.h"
 
 static std::ofstream g_log_file;
 
@@ -10,39 +25,456 @@ static std::ofstream g_log_file;
 #define CLR_ERROR "\033[31m"
 #define CLR_RESET "\033[0m"
 
-inline const char* now_time() {
-    static char buf[32];
-    std::time_t t = std::time(nullptr);
+// Severity levels, plain integers so the build can pass -DLOG_MIN_LEVEL=...
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO  1
+#define LOG_LEVEL_ERROR 2
+#define LOG_LEVEL_NONE  3
+
+// Statements below this level are compiled out. Release builds drop LOG_DEBUG unless told otherwise
+#ifndef LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#else
+#define LOG_MIN_LEVEL LOG_LEVEL_DEBUG
+#endif
+#endif
+
+/* What a producer does when the log ring is full */
+enum class log_overflow_policy {
+    BLOCK,  // wait for the writer, nothing is lost
+    DROP,   // discard the message, the writer reports how many were dropped
+};
+
+using log_config_t = struct {
+    uint32_t capacity;          // ring slots, rounded up to a power of two
+    log_overflow_policy policy;
+};
+
+/* Subsystems whose verbosity can be changed at runtime */
+enum class log_category : uint8_t {
+    GENERAL,
+    GPU,
+    ASSET,
+    SCENE,
+    INPUT,
+};
+
+constexpr uint32_t log_category_count = 5;
+
+inline const char* log_category_name(log_category category) {
+    switch (category) {
+        case log_category::GPU: return "gpu";
+        case log_category::ASSET: return "asset";
+        case log_category::SCENE: return "scene";
+        case log_category::INPUT: return "input";
+        default: return "general";
+    }
+}
+
+/* Runtime minimum level per category. Only statements that survived LOG_MIN_LEVEL are affected */
+inline std::array<std::atomic<int>, log_category_count>& log_category_levels() {
+    static std::array<std::atomic<int>, log_category_count> levels;
+    static const bool initialized = [] {
+        for (auto& level : levels) level.store(LOG_MIN_LEVEL, std::memory_order_relaxed);
+        return true;
+    }();
+    (void)initialized;
+    return levels;
+}
+
+inline void log_set_level(log_category category, int level) {
+    log_category_levels()[static_cast<uint32_t>(category)].store(level, std::memory_order_relaxed);
+}
+
+inline int log_get_level(log_category category) {
+    return log_category_levels()[static_cast<uint32_t>(category)].load(std::memory_order_relaxed);
+}
+
+inline bool log_enabled(log_category category, int level) {
+    return level >= log_get_level(category);
+}
+
+/* Apply a level list such as "info" or "gpu=debug,scene=error", a bare level applies to every category */
+inline void log_parse_levels(std::string_view spec) {
+    auto parse_level = [](std::string_view name) {
+        if (name == "debug") return LOG_LEVEL_DEBUG;
+        if (name == "info") return LOG_LEVEL_INFO;
+        if (name == "error") return LOG_LEVEL_ERROR;
+        if (name == "none") return LOG_LEVEL_NONE;
+        return -1;
+    };
+    while (!spec.empty()) {
+        size_t comma = spec.find(',');
+        std::string_view item = spec.substr(0, comma);
+        spec = comma == std::string_view::npos ? std::string_view() : spec.substr(comma + 1);
+        size_t eq = item.find('=');
+        int level = parse_level(eq == std::string_view::npos ? item : item.substr(eq + 1));
+        if (level < 0) continue;
+        for (uint32_t i = 0; i < log_category_count; ++i) {
+            auto category = static_cast<log_category>(i);
+            if (eq == std::string_view::npos || item.substr(0, eq) == log_category_name(category)) log_set_level(category, level);
+        }
+    }
+}
+
+/* Static description of a LOG_* statement, one per call site */
+struct log_site_t {
+    log_category category;
+    const char* level;
+    const char* color;
+    const char* file_name;
+    const char* func_name;
+    int line;
+};
+
+inline std::string now_time(std::time_t t = std::time(nullptr)) {
     std::tm tm{};
 #ifdef _WIN32
     localtime_s(&tm, &t);
 #else
     localtime_r(&t, &tm);
 #endif
-    std::snprintf(buf, sizeof(buf), "%d/%d/%d %02d:%02d", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min);
-    return buf;
+    return std::format("{}/{}/{} {:02}:{:02}", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min);
+}
+
+// Arguments are copied into the record as raw bytes: arithmetic values and pointers as they are, strings as a length
+// followed by their characters. A message with any other argument is formatted on the calling thread, since a format
+// spec written for the argument's own type may not apply to a stand-in.
+template<typename T>
+concept LogRawArg = (std::is_arithmetic_v<std::remove_cvref_t<T>> || std::is_pointer_v<std::remove_cvref_t<T>>) &&
+    !std::is_convertible_v<T, const char*>;
+
+template<typename T>
+concept LogStringArg = std::is_convertible_v<T, std::string_view>;
+
+template<typename... Ts>
+concept LogDeferrableArgs = ((LogRawArg<Ts> || LogStringArg<Ts>) && ...);
+
+template<typename T>
+using log_stored_t = std::conditional_t<LogRawArg<T>, std::remove_cvref_t<T>, std::string_view>;
+
+template<typename T>
+inline size_t log_arg_size(const T& v) {
+    if constexpr (LogRawArg<T>) {
+        return sizeof(T);
+    } else {
+        return sizeof(uint32_t) + std::string_view(v).size();
+    }
+}
+
+template<typename T>
+inline uint8_t* log_encode_arg(uint8_t* p, const T& v) {
+    if constexpr (LogRawArg<T>) {
+        std::remove_cvref_t<T> raw = v;
+        memcpy(p, &raw, sizeof(raw));
+        return p + sizeof(raw);
+    } else {
+        std::string_view s(v);
+        uint32_t len = static_cast<uint32_t>(s.size());
+        memcpy(p, &len, sizeof(len));
+        memcpy(p + sizeof(len), s.data(), len);
+        return p + sizeof(len) + len;
+    }
 }
 
-inline void log_init(const char* filename) {
+template<typename T>
+inline T log_decode_arg(const uint8_t*& p) {
+    if constexpr (std::is_same_v<T, std::string_view>) {
+        uint32_t len;
+        memcpy(&len, p, sizeof(len));
+        std::string_view s(reinterpret_cast<const char*>(p + sizeof(len)), len);
+        p += sizeof(len) + len;
+        return s;
+    } else {
+        T v;
+        memcpy(&v, p, sizeof(T));
+        p += sizeof(T);
+        return v;
+    }
+}
+
+/* Bounded multi-producer single-consumer ring. Every slot carries a sequence number: producers claim a position with
+ * a CAS on the tail and publish by bumping the slot's sequence, the writer thread consumes in order. A record holds
+ * the call site, a timestamp, the format string and the raw argument bytes; formatting happens on the writer thread,
+ * which writes lines in batches with one flush per batch. */
+class AsyncLogger {
+public:
+    static constexpr size_t payload_size = 192;
+    using decode_fn_t = void (*)(std::string_view fmt, const uint8_t* payload, std::string& out);
+private:
+    struct slot_t {
+        std::atomic<uint64_t> sequence;
+        log_site_t site;
+        std::time_t time;
+        const char* fmt;
+        size_t fmt_size;
+        decode_fn_t decode;
+        std::string line;   // preformatted fallback for arguments that do not fit the payload
+        alignas(8) uint8_t payload[payload_size];
+    };
+    std::unique_ptr<slot_t[]> slots_;
+    uint64_t mask_;
+    log_overflow_policy policy_;
+    alignas(64) std::atomic<uint64_t> tail_{0};
+    alignas(64) uint64_t head_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<bool> running_{true};
+    std::thread writer_;
+
+    void write_batch(std::string& console, std::string& file) {
+        if (!console.empty()) {
+            std::cout << console;
+            std::cout.flush();
+        }
+        if (!file.empty() && g_log_file.is_open()) {
+            g_log_file << file;
+            g_log_file.flush();
+        }
+        console.clear();
+        file.clear();
+    }
+
+    // Consume everything published so far, returns whether anything was written
+    bool drain(std::string& console, std::string& file) {
+        bool any = false;
+        std::string line;
+        for (;;) {
+            slot_t& slot = slots_[head_ & mask_];
+            if (slot.sequence.load(std::memory_order_acquire) != head_ + 1) break;
+            const log_site_t& site = slot.site;
+            line = std::format("[{}][{}][{}][{}({}:{})] ", site.level, log_category_name(site.category), now_time(slot.time), site.func_name, site.file_name, site.line);
+            if (slot.decode) {
+                slot.decode(std::string_view(slot.fmt, slot.fmt_size), slot.payload, line);
+            } else {
+                line.append(slot.line);
+                slot.line.clear();
+            }
+            console.append(site.color).append(line).append(CLR_RESET "\n");
+            file.append(line).append("\n");
+            // Hand the slot to the producer of the next lap
+            slot.sequence.store(head_ + mask_ + 1, std::memory_order_release);
+            ++head_;
+            any = true;
+        }
+        uint64_t dropped = dropped_.exchange(0, std::memory_order_relaxed);
+        if (dropped) {
+            line = std::format("[ERROR][{}] log ring full, dropped {} messages", now_time(), dropped);
+            console.append(CLR_ERROR).append(line).append(CLR_RESET "\n");
+            file.append(line).append("\n");
+        }
+        return any;
+    }
+
+    void writer_loop() {
+        std::string console, file;
+        while (running_.load(std::memory_order_acquire)) {
+            if (!drain(console, file)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            write_batch(console, file);
+        }
+        drain(console, file);
+        write_batch(console, file);
+    }
+
+    // Claim the next free slot, null when it was dropped
+    slot_t* acquire() {
+        uint64_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            slot_t& slot = slots_[pos & mask_];
+            uint64_t seq = slot.sequence.load(std::memory_order_acquire);
+            if (seq == pos) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) return &slot;
+            } else if (seq < pos) {
+                // The slot still holds last lap's message, the ring is full
+                if (policy_ == log_overflow_policy::DROP) {
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+                std::this_thread::yield();
+                pos = tail_.load(std::memory_order_relaxed);
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void publish(slot_t* slot) {
+        uint64_t pos = slot->sequence.load(std::memory_order_relaxed);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+    }
+
+    template<typename... Ts>
+    static void decode(std::string_view fmt, const uint8_t* payload, std::string& out) {
+        // Braced initialization decodes the arguments in order
+        std::tuple<Ts...> values{log_decode_arg<Ts>(payload)...};
+        std::apply([&](auto&... v) { std::vformat_to(std::back_inserter(out), fmt, std::make_format_args(v...)); }, values);
+    }
+public:
+    AsyncLogger(const log_config_t& config) : policy_(config.policy) {
+        uint64_t capacity = 1;
+        while (capacity < config.capacity) capacity <<= 1;
+        mask_ = capacity - 1;
+        slots_ = std::make_unique<slot_t[]>(capacity);
+        for (uint64_t i = 0; i < capacity; ++i) slots_[i].sequence.store(i, std::memory_order_relaxed);
+        writer_ = std::thread([this]() { writer_loop(); });
+    }
+    AsyncLogger(AsyncLogger&) = delete;
+
+    /* Stops the writer after everything queued so far has been written */
+    ~AsyncLogger() {
+        running_.store(false, std::memory_order_release);
+        writer_.join();
+    }
+
+    /* Record a message without formatting it when every argument can be copied raw, fmt must outlive the logger
+     * (string literals do). Other messages, or ones too large for a slot, are formatted here */
+    template<typename... Args>
+    void Write(const log_site_t& site, std::string_view fmt, const Args&... args) {
+        bool raw = false;
+        if constexpr (LogDeferrableArgs<Args...>) raw = (log_arg_size(args) + ... + 0) <= payload_size;
+        slot_t* slot = acquire();
+        if (!slot) return;
+        slot->site = site;
+        slot->time = std::time(nullptr);
+        slot->fmt = fmt.data();
+        slot->fmt_size = fmt.size();
+        if (raw) {
+            if constexpr (LogDeferrableArgs<Args...>) {
+                [[maybe_unused]] uint8_t* p = slot->payload;
+                ((p = log_encode_arg(p, args)), ...);
+                slot->decode = &decode<log_stored_t<Args>...>;
+            }
+        } else {
+            slot->decode = nullptr;
+            slot->line = std::vformat(fmt, std::make_format_args(args...));
+        }
+        publish(slot);
+    }
+
+    /* Record an already formatted message */
+    void WriteFormatted(const log_site_t& site, std::string&& msg) {
+        slot_t* slot = acquire();
+        if (!slot) return;
+        slot->site = site;
+        slot->time = std::time(nullptr);
+        slot->decode = nullptr;
+        slot->line = std::move(msg);
+        publish(slot);
+    }
+};
+
+inline std::unique_ptr<AsyncLogger>& g_async_logger() {
+    static std::unique_ptr<AsyncLogger> logger;
+    return logger;
+}
+
+/* Starts the writer thread. GERK_LOG_LEVEL overrides the per-category levels, see log_parse_levels */
+inline void log_init(const char* filename, const log_config_t& config = {4096, log_overflow_policy::BLOCK}) {
+    if (const char* env = std::getenv("GERK_LOG_LEVEL")) log_parse_levels(env);
     g_log_file.open(filename, std::ios::app);
+    g_async_logger() = std::make_unique<AsyncLogger>(config);
 }
 
+/* Flush pending messages and stop the writer thread, later messages are written synchronously */
 inline void log_close() {
+    g_async_logger().reset();
     if (g_log_file.is_open())
         g_log_file.close();
 }
 
-template<typename... Args>
-inline void log_print(const char* level, const char* color, const char* file_name, const char* func_name, int col, std::string fmt, Args&&... args) {
-    auto msg = std::vformat(fmt, std::make_format_args(args...));
-    auto line = std::format("[{}][{}][{}({}:{})] {}", level, now_time(), func_name, file_name, col, msg);
-    std::cout << color << line << CLR_RESET << '\n';
+inline void log_write_sync(const log_site_t& site, std::string_view msg) {
+    auto line = std::format("[{}][{}][{}][{}({}:{})] {}", site.level, log_category_name(site.category), now_time(), site.func_name, site.file_name, site.line, msg);
+    std::cout << site.color << line << CLR_RESET << '\n';
     if (g_log_file.is_open()) {
         g_log_file << line << '\n';
         g_log_file.flush();
     }
 }
 
-#define LOG_INFO(...)  log_print("INFO",  CLR_INFO, __FILE__, __FUNCTION__, __LINE__, __VA_ARGS__)
-#define LOG_DEBUG(...) log_print("DEBUG", CLR_DEBUG, __FILE__, __FUNCTION__, __LINE__, __VA_ARGS__)
-#define LOG_ERROR(...) log_print("ERROR", CLR_ERROR, __FILE__, __FUNCTION__, __LINE__, __VA_ARGS__)
\ No newline at end of file
+/* Backend of the LOG_* macros: the call site only copies its arguments, formatting happens on the writer thread */
+template<typename... Args>
+inline void log_write(const log_site_t& site, std::format_string<const Args&...> fmt, const Args&... args) {
+    flight_record(trace_event_type::LOG, fmt.get().data());
+    if (auto& logger = g_async_logger()) {
+        logger->Write(site, fmt.get(), args...);
+        return;
+    }
+    log_write_sync(site, std::vformat(fmt.get(), std::make_format_args(args...)));
+}
+
+/* Formats on the calling thread, for runtime format strings */
+template<typename... Args>
+inline void log_print(const char* level, const char* color, const char* file_name, const char* func_name, int col, std::string fmt, Args&&... args) {
+    log_site_t site = {log_category::GENERAL, level, color, file_name, func_name, col};
+    flight_record(trace_event_type::LOG, level);
+    auto msg = std::vformat(fmt, std::make_format_args(args...));
+    if (auto& logger = g_async_logger()) {
+        logger->WriteFormatted(site, std::move(msg));
+        return;
+    }
+    log_write_sync(site, msg);
+}
+
+/* Per call site limit of messages per second. Messages over the limit are counted, and the first message after the
+ * window ends reports how many were suppressed */
+class LogRateLimit {
+private:
+    const uint32_t per_second_;
+    std::atomic<int64_t> window_start_{0};
+    std::atomic<uint32_t> count_{0};
+    std::atomic<uint32_t> suppressed_{0};
+public:
+    LogRateLimit(uint32_t per_second) : per_second_(per_second) {}
+
+    /* Returns whether the message may be written, suppressed receives the count to report before it */
+    bool Allow(uint32_t& suppressed) {
+        suppressed = 0;
+        int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t start = window_start_.load(std::memory_order_relaxed);
+        if (now - start >= 1000 && window_start_.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+            count_.store(0, std::memory_order_relaxed);
+            suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+        }
+        if (count_.fetch_add(1, std::memory_order_relaxed) < per_second_) return true;
+        suppressed_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+};
+
+// Disabled levels are discarded at compile time, the arguments are still type checked but generate no code
+#define LOG_WRITE(category, level, name, color, ...) do { \
+        if constexpr ((level) >= LOG_MIN_LEVEL) { \
+            if (log_enabled(category, level)) { \
+                static const log_site_t log_site_ = {category, name, color, __FILE__, __FUNCTION__, __LINE__}; \
+                log_write(log_site_, __VA_ARGS__); \
+            } \
+        } \
+    } while (0)
+
+#define LOG_WRITE_RATE(category, per_second, level, name, color, ...) do { \
+        if constexpr ((level) >= LOG_MIN_LEVEL) { \
+            if (log_enabled(category, level)) { \
+                static const log_site_t log_site_ = {category, name, color, __FILE__, __FUNCTION__, __LINE__}; \
+                static LogRateLimit log_rate_(per_second); \
+                uint32_t log_suppressed_; \
+                bool log_allowed_ = log_rate_.Allow(log_suppressed_); \
+                if (log_suppressed_) log_write(log_site_, "suppressed {} messages", log_suppressed_); \
+                if (log_allowed_) log_write(log_site_, __VA_ARGS__); \
+            } \
+        } \
+    } while (0)
+
+#define LOG_INFO(...)  LOG_WRITE(log_category::GENERAL, LOG_LEVEL_INFO, "INFO", CLR_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_WRITE(log_category::GENERAL, LOG_LEVEL_DEBUG, "DEBUG", CLR_DEBUG, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_WRITE(log_category::GENERAL, LOG_LEVEL_ERROR, "ERROR", CLR_ERROR, __VA_ARGS__)
+
+#define LOG_INFO_CAT(category, ...)  LOG_WRITE(category, LOG_LEVEL_INFO, "INFO", CLR_INFO, __VA_ARGS__)
+#define LOG_DEBUG_CAT(category, ...) LOG_WRITE(category, LOG_LEVEL_DEBUG, "DEBUG", CLR_DEBUG, __VA_ARGS__)
+#define LOG_ERROR_CAT(category, ...) LOG_WRITE(category, LOG_LEVEL_ERROR, "ERROR", CLR_ERROR, __VA_ARGS__)
+
+#define LOG_INFO_RATE(category, per_second, ...)  LOG_WRITE_RATE(category, per_second, LOG_LEVEL_INFO, "INFO", CLR_INFO, __VA_ARGS__)
+#define LOG_DEBUG_RATE(category, per_second, ...) LOG_WRITE_RATE(category, per_second, LOG_LEVEL_DEBUG, "DEBUG", CLR_DEBUG, __VA_ARGS__)
+#define LOG_ERROR_RATE(category, per_second, ...) LOG_WRITE_RATE(category, per_second, LOG_LEVEL_ERROR, "ERROR", CLR_ERROR, __VA_ARGS__)
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+enum class memory_category : uint8_t {
+    TEXTURE,
+    GEOMETRY,
+    CONSTANT,   // constant and structured buffers
+    UPLOAD,     // staging buffers waiting for their copy
+};
+
+constexpr uint32_t memory_category_count = 4;
+
+inline const char* memory_category_name(memory_category category) {
+    switch (category) {
+        case memory_category::TEXTURE: return "texture";
+        case memory_category::GEOMETRY: return "geometry";
+        case memory_category::CONSTANT: return "constant";
+        default: return "upload";
+    }
+}
+
+struct memory_usage_t {
+    int64_t cpu_bytes;  // pixel and vertex copies held in system memory, mapped files included
+    int64_t gpu_bytes;  // resource allocations, upload heaps included although they live in system memory
+};
+
+/* Running byte counts per category, updated by whoever allocates or frees. Counters are relaxed atomics, any thread
+ * may update or read them */
+class MemoryStats {
+private:
+    std::atomic<int64_t> cpu_[memory_category_count]{};
+    std::atomic<int64_t> gpu_[memory_category_count]{};
+public:
+    void AddCPU(memory_category category, int64_t bytes) {
+        cpu_[static_cast<uint32_t>(category)].fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    void AddGPU(memory_category category, int64_t bytes) {
+        gpu_[static_cast<uint32_t>(category)].fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    memory_usage_t Get(memory_category category) const {
+        auto i = static_cast<uint32_t>(category);
+        return {cpu_[i].load(std::memory_order_relaxed), gpu_[i].load(std::memory_order_relaxed)};
+    }
+
+    memory_usage_t GetTotal() const {
+        memory_usage_t total = {0, 0};
+        for (uint32_t i = 0; i < memory_category_count; ++i) {
+            total.cpu_bytes += cpu_[i].load(std::memory_order_relaxed);
+            total.gpu_bytes += gpu_[i].load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+};
+
+inline MemoryStats& g_memory_stats() {
+    static MemoryStats stats;
+    return stats;
+}
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "job_pool.h"
+#include "simd_math.h"
+#include "texture.h"
+
+struct mip_settings_t {
+    mip_filter filter;
+    bool srgb;              // color channels are sRGB encoded and filtered in linear space, alpha is always linear
+    uint32_t max_levels;    // 0 for the full chain down to 1x1
+};
+
+/* Generated chain. view.levels[0] points at the source, the other levels into storage */
+struct mip_chain_t {
+    texture_view_t view;
+    std::vector<std::vector<uint8_t>> storage;
+};
+
+inline uint32_t mip_level_count(uint32_t width, uint32_t height) {
+    uint32_t levels = 1;
+    for (uint32_t size = std::max(width, height); size > 1; size >>= 1) ++levels;
+    return levels;
+}
+
+inline const std::array<float, 256>& mip_srgb_to_linear() {
+    static const std::array<float, 256> table = [] {
+        std::array<float, 256> t;
+        for (uint32_t i = 0; i < 256; ++i) {
+            float c = i / 255.0f;
+            t[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return t;
+    }();
+    return table;
+}
+
+// Indexed by linear * 65535, fine enough that every 8-bit code round-trips
+inline const std::vector<uint8_t>& mip_linear_to_srgb() {
+    static const std::vector<uint8_t> table = [] {
+        std::vector<uint8_t> t(65536);
+        for (uint32_t i = 0; i < t.size(); ++i) {
+            float l = i / 65535.0f;
+            float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+            t[i] = static_cast<uint8_t>(std::clamp(c, 0.0f, 1.0f) * 255.0f + 0.5f);
+        }
+        return t;
+    }();
+    return table;
+}
+
+// Kaiser-windowed sinc for a 2:1 reduction, taps at source offsets -2.5 .. 2.5 around the destination texel center
+inline const std::array<float, 6>& mip_kaiser_weights() {
+    static const std::array<float, 6> weights = [] {
+        auto bessel_i0 = [](float x) {
+            float sum = 1.0f, term = 1.0f;
+            for (int k = 1; k < 16; ++k) {
+                term *= (x / (2.0f * k)) * (x / (2.0f * k));
+                sum += term;
+            }
+            return sum;
+        };
+        const float alpha = 4.0f, width = 3.0f;
+        std::array<float, 6> w;
+        float total = 0.0f;
+        for (int i = 0; i < 6; ++i) {
+            float t = i - 2.5f;
+            float x = t * 0.5f * math_pi;
+            float sinc = std::sin(x) / x;
+            float r = t / width;
+            w[i] = sinc * bessel_i0(alpha * std::sqrt(1.0f - r * r)) / bessel_i0(alpha);
+            total += w[i];
+        }
+        for (auto& v : w) v /= total;
+        return w;
+    }();
+    return weights;
+}
+
+/* Build the mip chain of an uncompressed texture. Levels are filtered from their predecessor kept in linear float, so
+ * quantization does not accumulate down the chain; rows of each level are split across pool when one is given. Every
+ * texel is filtered as four lanes, channels the format lacks read 0 and alpha 1. sRGB only applies to 8-bit RGBA, float
+ * formats keep values above 1 */
+inline mip_chain_t generate_mips(const texture_view_t& source, const mip_settings_t& settings, JobPool* pool = nullptr) {
+    mip_chain_t chain = {{source.format, source.width, source.height, {source.levels[0]}}, {}};
+    uint32_t levels = mip_level_count(source.width, source.height);
+    if (settings.max_levels) levels = std::min(levels, settings.max_levels);
+    if (levels <= 1) return chain;
+
+    auto parallel_rows = [&](uint32_t rows, auto&& f) {
+        if (pool) pool->ParallelFor(rows, 16, f);
+        else f(0u, rows);
+    };
+    const auto& to_linear = mip_srgb_to_linear();
+    const auto& to_srgb = mip_linear_to_srgb();
+    const auto& kaiser = mip_kaiser_weights();
+    const texture_format format = source.format;
+    const uint32_t channels = texture_format_channels(format);
+    const bool is_float = texture_format_is_float(format);
+    const bool srgb = settings.srgb && format == texture_format::RGBA8_UNORM;
+    const float max_value = is_float ? std::numeric_limits<float>::max() : 1.0f;
+
+    uint32_t w = source.width, h = source.height;
+    const texture_level_t& top = source.levels[0];
+    std::vector<float> src, dst, tmp;
+    // Row y of the level being reduced. The source level is decoded into scratch row by row instead of as a whole,
+    // a 4096x4096 source would otherwise need 256 MB of floats
+    auto source_row = [&](uint32_t level, uint32_t y, std::vector<float>& scratch) -> const float* {
+        if (level > 1) return &src[static_cast<size_t>(y) * w * 4];
+        scratch.assign(static_cast<size_t>(w) * 4, 0.0f);
+        const uint8_t* in = top.data + static_cast<size_t>(y) * top.row_pitch;
+        for (uint32_t x = 0; x < w; ++x) {
+            float* out = &scratch[static_cast<size_t>(x) * 4];
+            out[3] = 1.0f;
+            if (is_float) {
+                const uint8_t* texel = in + static_cast<size_t>(x) * channels * 2;
+                for (uint32_t c = 0; c < channels; ++c) {
+                    uint16_t half;
+                    memcpy(&half, texel + c * 2, 2);
+                    out[c] = half_to_float(half);
+                }
+                continue;
+            }
+            const uint8_t* texel = in + static_cast<size_t>(x) * channels;
+            for (uint32_t c = 0; c < channels; ++c) out[c] = srgb && c < 3 ? to_linear[texel[c]] : texel[c] * (1.0f / 255.0f);
+        }
+        return scratch.data();
+    };
+
+    chain.storage.resize(levels - 1);
+    for (uint32_t level = 1; level < levels; ++level) {
+        uint32_t dw = std::max(1u, w >> 1), dh = std::max(1u, h >> 1);
+        dst.resize(static_cast<size_t>(dw) * dh * 4);
+        if (settings.filter == mip_filter::BOX) {
+            parallel_rows(dh, [&](uint32_t begin, uint32_t end) {
+                std::vector<float> scratch0, scratch1;
+                for (uint32_t y = begin; y < end; ++y) {
+                    const float* r0 = source_row(level, std::min(2 * y, h - 1), scratch0);
+                    const float* r1 = source_row(level, std::min(2 * y + 1, h - 1), scratch1);
+                    for (uint32_t x = 0; x < dw; ++x) {
+                        size_t x0 = std::min(2 * x, w - 1) * 4, x1 = std::min(2 * x + 1, w - 1) * 4;
+                        vec_t sum = vec_add(vec_add(vec_load4(r0 + x0), vec_load4(r0 + x1)), vec_add(vec_load4(r1 + x0), vec_load4(r1 + x1)));
+                        vec_store4(&dst[(static_cast<size_t>(y) * dw + x) * 4], vec_scale(sum, 0.25f));
+                    }
+                }
+            });
+        } else {
+            // Separable: horizontal into tmp (dw x h), then vertical into dst
+            tmp.resize(static_cast<size_t>(dw) * h * 4);
+            parallel_rows(h, [&](uint32_t begin, uint32_t end) {
+                std::vector<float> scratch;
+                for (uint32_t y = begin; y < end; ++y) {
+                    const float* row = source_row(level, y, scratch);
+                    float* out = &tmp[static_cast<size_t>(y) * dw * 4];
+                    if (w == 1) {
+                        vec_store4(out, vec_load4(row));
+                        continue;
+                    }
+                    for (uint32_t x = 0; x < dw; ++x) {
+                        vec_t sum = vec_splat(0.0f);
+                        for (int k = 0; k < 6; ++k) {
+                            int64_t sx = std::clamp<int64_t>(2 * int64_t(x) - 2 + k, 0, w - 1);
+                            sum = vec_mul_add(vec_splat(kaiser[k]), vec_load4(row + sx * 4), sum);
+                        }
+                        vec_store4(out + x * 4, sum);
+                    }
+                }
+            });
+            parallel_rows(dh, [&](uint32_t begin, uint32_t end) {
+                for (uint32_t y = begin; y < end; ++y) {
+                    const float* rows[6];
+                    for (int k = 0; k < 6; ++k) {
+                        int64_t sy = h == 1 ? 0 : std::clamp<int64_t>(2 * int64_t(y) - 2 + k, 0, h - 1);
+                        rows[k] = &tmp[static_cast<size_t>(sy) * dw * 4];
+                    }
+                    for (uint32_t x = 0; x < dw; ++x) {
+                        vec_t sum;
+                        if (h == 1) {
+                            sum = vec_load4(rows[0] + x * 4);
+                        } else {
+                            sum = vec_splat(0.0f);
+                            for (int k = 0; k < 6; ++k) sum = vec_mul_add(vec_splat(kaiser[k]), vec_load4(rows[k] + x * 4), sum);
+                        }
+                        // The sinc lobes can overshoot, keep the filtered values in range for the next level
+                        sum = vec_min(vec_max(sum, vec_splat(0.0f)), vec_splat(max_value));
+                        vec_store4(&dst[(static_cast<size_t>(y) * dw + x) * 4], sum);
+                    }
+                }
+            });
+        }
+
+        const uint32_t pixel_bytes = texture_format_pixel_bytes(format);
+        auto& bytes = chain.storage[level - 1];
+        bytes.resize(static_cast<size_t>(dw) * dh * pixel_bytes);
+        parallel_rows(dh, [&](uint32_t begin, uint32_t end) {
+            for (size_t i = static_cast<size_t>(begin) * dw; i < static_cast<size_t>(end) * dw; ++i) {
+                const float* in = &dst[i * 4];
+                uint8_t* out = &bytes[i * pixel_bytes];
+                for (uint32_t c = 0; c < channels; ++c) {
+                    if (is_float) {
+                        uint16_t half = float_to_half(in[c]);
+                        memcpy(out + c * 2, &half, 2);
+                        continue;
+                    }
+                    float v = std::clamp(in[c], 0.0f, 1.0f);
+                    out[c] = srgb && c < 3 ? to_srgb[static_cast<uint32_t>(v * 65535.0f + 0.5f)] : static_cast<uint8_t>(v * 255.0f + 0.5f);
+                }
+            }
+        });
+        chain.view.levels.push_back({dw, dh, dw * pixel_bytes, bytes.data()});
+        std::swap(src, dst);
+        w = dw;
+        h = dh;
+    }
+    return chain;
+}
+
+/* Peak bytes generate_mips allocates for a width x height source: the float copies of the first two generated levels,
+ * which src and dst keep for the whole chain, the horizontal pass of the Kaiser filter and the generated levels */
+inline uint64_t generate_mips_peak_bytes(uint32_t width, uint32_t height, texture_format format, const mip_settings_t& settings) {
+    uint32_t levels = mip_level_count(width, height);
+    if (settings.max_levels) levels = std::min(levels, settings.max_levels);
+    if (levels <= 1) return 0;
+    const uint64_t texel_bytes = 4 * sizeof(float);
+    uint64_t dw = std::max(1u, width >> 1), dh = std::max(1u, height >> 1);
+    uint64_t bytes = (dw * dh + std::max<uint64_t>(1, dw >> 1) * std::max<uint64_t>(1, dh >> 1)) * texel_bytes;
+    if (settings.filter != mip_filter::BOX) bytes += dw * height * texel_bytes;
+    for (uint32_t level = 1; level < levels; ++level) {
+        uint64_t lw = std::max(1u, width >> level), lh = std::max(1u, height >> level);
+        bytes += lw * lh * texture_format_pixel_bytes(format);
+    }
+    return bytes;
+}
@@ -6,6 +6,8 @@
 #include <iostream>
 #include <tiny_gltf.h>
 
+#include "memory_stats.h"
+
 
 class gltf_loader {
 public:
@@ -18,7 +20,7 @@ public:
         int textureWidth = 0;
         int textureHeight = 0;
         int textureChannels = 0;
-        std::vector<unsigned char> texture_data;
+        std::vector<unsigned char> texture_data;    // empty after release_texture
     };
 
     struct vertex {
@@ -40,6 +42,9 @@ private:
     }
 public:
     gltf_loader(const std::string& file_name) : file_name_(file_name) {}
+    ~gltf_loader() {
+        release_texture();
+    }
     bool LoadGLB() {
         tinygltf::Model model;
         tinygltf::TinyGLTF loader;
@@ -114,11 +119,13 @@ public:
             if (texIndex >= 0) {
                 const tinygltf::Texture& tex = model.textures[texIndex];
                 if (tex.source >= 0) {
-                    const tinygltf::Image& img = model.images[tex.source];
+                    tinygltf::Image& img = model.images[tex.source];
                     mesh_.textureWidth = img.width;
                     mesh_.textureHeight = img.height;
                     mesh_.textureChannels = img.component;
-                    mesh_.texture_data = img.image;
+                    // The model is dropped on return, take its pixels instead of copying them
+                    mesh_.texture_data = std::move(img.image);
+                    g_memory_stats().AddCPU(memory_category::TEXTURE, mesh_.texture_data.size());
                     std::cout << "Extracted Texture: " << img.width << "x" << img.height
                               << " (" << img.component << " channels)" << std::endl;
                 }
@@ -127,6 +134,17 @@ public:
         return true;
     }
 
+    const mesh& get_mesh() const {
+        return mesh_;
+    }
+
+    /* Free the texture pixels, pass this to GPUResourceManager::ReleaseAfterUpload once they have been handed to
+     * CreateTexture, or keep them by not calling it */
+    void release_texture() {
+        g_memory_stats().AddCPU(memory_category::TEXTURE, -static_cast<int64_t>(mesh_.texture_data.size()));
+        std::vector<unsigned char>().swap(mesh_.texture_data);
+    }
+
     void merge() {
         size_t vertexCount = mesh_.vertices.size() / 3;
         vertices_.reserve(vertexCount);
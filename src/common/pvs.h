@@ -0,0 +1,371 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <string_view>
+#include <vector>
+
+#include "geometry.h"
+#include "job_pool.h"
+
+/* Precomputed potentially visible sets for static scenes. The walkable region is split into cells, and for every
+ * cell the scene is rasterized from a few sample points into small cube maps with a CPU depth rasterizer. Ids that
+ * win any depth test form the cell's visible set, stored as a zero-run compressed bitset. */
+class PVSBaker {
+public:
+    using pvs_bake_param_t = struct {
+        aabb_t region;          // walkable space the camera can be in
+        float cell_size;
+        uint32_t resolution;    // cube face size in pixels, small objects below a pixel may be missed
+        float near_z;
+    };
+private:
+    struct triangle_t {
+        float3_t v[3];
+        uint32_t object;
+    };
+    pvs_bake_param_t param_;
+    std::vector<triangle_t> triangles_;
+    std::vector<aabb_t> object_bounds_;
+    uint32_t object_count_{0};
+    uint32_t dims_[3]{};
+    std::vector<std::vector<uint8_t>> cells_;
+
+    struct raster_target_t {
+        std::vector<float> depth;   // 1/z, larger is closer
+        std::vector<uint32_t> ids;
+    };
+
+    static float dot(const float3_t& a, const float3_t& b) {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+
+    static float3_t sub(const float3_t& a, const float3_t& b) {
+        return {a.x - b.x, a.y - b.y, a.z - b.z};
+    }
+
+    void raster_triangle(raster_target_t& rt, const float3_t (&view)[3], uint32_t id) const {
+        // Clip against the near plane, a triangle becomes at most a quad
+        float3_t poly[4];
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < 3; ++i) {
+            const float3_t& a = view[i];
+            const float3_t& b = view[(i + 1) % 3];
+            bool a_in = a.z >= param_.near_z;
+            bool b_in = b.z >= param_.near_z;
+            if (a_in) poly[n++] = a;
+            if (a_in != b_in) {
+                float t = (param_.near_z - a.z) / (b.z - a.z);
+                poly[n++] = {a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, param_.near_z};
+            }
+        }
+        if (n < 3) return;
+        float res = static_cast<float>(param_.resolution);
+        float sx[4], sy[4], iz[4];
+        for (uint32_t i = 0; i < n; ++i) {
+            iz[i] = 1.0f / poly[i].z;
+            sx[i] = (poly[i].x * iz[i] + 1.0f) * 0.5f * res;
+            sy[i] = (1.0f - poly[i].y * iz[i]) * 0.5f * res;
+        }
+        for (uint32_t t = 1; t + 1 < n; ++t) {
+            uint32_t i0 = 0, i1 = t, i2 = t + 1;
+            float area = (sx[i1] - sx[i0]) * (sy[i2] - sy[i0]) - (sy[i1] - sy[i0]) * (sx[i2] - sx[i0]);
+            if (std::fabs(area) < 1e-12f) continue;
+            float inv_area = 1.0f / area;
+            int32_t x0 = std::max(0, static_cast<int32_t>(std::floor(std::min({sx[i0], sx[i1], sx[i2]}))));
+            int32_t x1 = std::min(static_cast<int32_t>(param_.resolution) - 1, static_cast<int32_t>(std::ceil(std::max({sx[i0], sx[i1], sx[i2]}))));
+            int32_t y0 = std::max(0, static_cast<int32_t>(std::floor(std::min({sy[i0], sy[i1], sy[i2]}))));
+            int32_t y1 = std::min(static_cast<int32_t>(param_.resolution) - 1, static_cast<int32_t>(std::ceil(std::max({sy[i0], sy[i1], sy[i2]}))));
+            for (int32_t y = y0; y <= y1; ++y) {
+                float py = y + 0.5f;
+                for (int32_t x = x0; x <= x1; ++x) {
+                    float px = x + 0.5f;
+                    // Barycentrics from edge functions, sign-normalized by the area so both windings pass
+                    float w0 = ((sx[i1] - px) * (sy[i2] - py) - (sy[i1] - py) * (sx[i2] - px)) * inv_area;
+                    float w1 = ((sx[i2] - px) * (sy[i0] - py) - (sy[i2] - py) * (sx[i0] - px)) * inv_area;
+                    float w2 = 1.0f - w0 - w1;
+                    if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) continue;
+                    float d = w0 * iz[i0] + w1 * iz[i1] + w2 * iz[i2];
+                    size_t p = static_cast<size_t>(y) * param_.resolution + x;
+                    if (d > rt.depth[p]) {
+                        rt.depth[p] = d;
+                        rt.ids[p] = id;
+                    }
+                }
+            }
+        }
+    }
+
+    void render_sample(raster_target_t& rt, const float3_t& eye, std::vector<uint8_t>& visible) const {
+        static const float3_t axes[6][3] = {
+            // right, up, forward of the six cube faces
+            {{0, 0, -1}, {0, 1, 0}, {1, 0, 0}},
+            {{0, 0, 1}, {0, 1, 0}, {-1, 0, 0}},
+            {{1, 0, 0}, {0, 0, -1}, {0, 1, 0}},
+            {{1, 0, 0}, {0, 0, 1}, {0, -1, 0}},
+            {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}},
+            {{-1, 0, 0}, {0, 1, 0}, {0, 0, -1}},
+        };
+        for (const auto& face : axes) {
+            std::fill(rt.depth.begin(), rt.depth.end(), 0.0f);
+            std::fill(rt.ids.begin(), rt.ids.end(), std::numeric_limits<uint32_t>::max());
+            for (const auto& tri : triangles_) {
+                float3_t view[3];
+                for (int i = 0; i < 3; ++i) {
+                    float3_t d = sub(tri.v[i], eye);
+                    view[i] = {dot(d, face[0]), dot(d, face[1]), dot(d, face[2])};
+                }
+                // Entirely outside one side of the 90 degree frustum
+                if ((view[0].x > view[0].z && view[1].x > view[1].z && view[2].x > view[2].z) ||
+                    (-view[0].x > view[0].z && -view[1].x > view[1].z && -view[2].x > view[2].z) ||
+                    (view[0].y > view[0].z && view[1].y > view[1].z && view[2].y > view[2].z) ||
+                    (-view[0].y > view[0].z && -view[1].y > view[1].z && -view[2].y > view[2].z)) {
+                    continue;
+                }
+                raster_triangle(rt, view, tri.object);
+            }
+            for (uint32_t id : rt.ids) {
+                if (id != std::numeric_limits<uint32_t>::max()) visible[id >> 3] |= static_cast<uint8_t>(1u << (id & 7));
+            }
+        }
+    }
+
+    void bake_cell(raster_target_t& rt, uint32_t cx, uint32_t cy, uint32_t cz) {
+        std::vector<uint8_t> visible((object_count_ + 7) / 8, 0);
+        aabb_t cell = {
+            {param_.region.min.x + cx * param_.cell_size, param_.region.min.y + cy * param_.cell_size, param_.region.min.z + cz * param_.cell_size},
+            {param_.region.min.x + (cx + 1) * param_.cell_size, param_.region.min.y + (cy + 1) * param_.cell_size, param_.region.min.z + (cz + 1) * param_.cell_size},
+        };
+        // Objects overlapping the cell itself are always visible from inside it
+        for (uint32_t i = 0; i < object_count_; ++i) {
+            if (aabb_overlaps(cell, object_bounds_[i])) visible[i >> 3] |= static_cast<uint8_t>(1u << (i & 7));
+        }
+        // Center plus the eight corners pulled slightly inwards
+        float3_t c = aabb_center(cell);
+        float3_t e = aabb_extent(cell);
+        render_sample(rt, c, visible);
+        for (int i = 0; i < 8; ++i) {
+            float3_t p = {
+                c.x + ((i & 1) ? 0.9f : -0.9f) * e.x,
+                c.y + ((i & 2) ? 0.9f : -0.9f) * e.y,
+                c.z + ((i & 4) ? 0.9f : -0.9f) * e.z,
+            };
+            render_sample(rt, p, visible);
+        }
+        cells_[(static_cast<size_t>(cz) * dims_[1] + cy) * dims_[0] + cx] = Compress(visible);
+    }
+
+    static void write_varint(std::vector<uint8_t>& out, uint32_t v) {
+        while (v >= 0x80) {
+            out.push_back(static_cast<uint8_t>(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(v));
+    }
+public:
+    PVSBaker(const pvs_bake_param_t& param) : param_(param) {}
+
+    /* Add the world space triangles of an object, ids must be dense starting at 0 */
+    void AddObject(uint32_t id, const float3_t* positions, const uint32_t* indices, uint32_t index_count) {
+        object_count_ = std::max(object_count_, id + 1);
+        object_bounds_.resize(object_count_, aabb_empty());
+        for (uint32_t i = 0; i + 2 < index_count; i += 3) {
+            triangle_t tri = {{positions[indices[i]], positions[indices[i + 1]], positions[indices[i + 2]]}, id};
+            for (const auto& v : tri.v) aabb_extend(object_bounds_[id], v);
+            triangles_.push_back(tri);
+        }
+    }
+
+    /* Rasterize every cell, cells are split across pool when one is given */
+    void Bake(JobPool* pool = nullptr) {
+        for (int i = 0; i < 3; ++i) {
+            float extent = (&param_.region.max.x)[i] - (&param_.region.min.x)[i];
+            dims_[i] = std::max(1u, static_cast<uint32_t>(std::ceil(extent / param_.cell_size)));
+        }
+        uint32_t cell_count = dims_[0] * dims_[1] * dims_[2];
+        cells_.assign(cell_count, {});
+        // Cells are expensive, one per chunk keeps the workers balanced and each chunk owns its raster target
+        auto bake_cells = [this](uint32_t begin, uint32_t end) {
+            raster_target_t rt;
+            size_t pixels = static_cast<size_t>(param_.resolution) * param_.resolution;
+            rt.depth.resize(pixels);
+            rt.ids.resize(pixels);
+            for (uint32_t i = begin; i < end; ++i) {
+                bake_cell(rt, i % dims_[0], (i / dims_[0]) % dims_[1], i / (dims_[0] * dims_[1]));
+            }
+        };
+        if (pool) pool->ParallelFor(cell_count, 1, bake_cells);
+        else bake_cells(0, cell_count);
+    }
+
+    /* Zero-run compression: pairs of (zero byte run, literal byte count) as varints, followed by the literals */
+    static std::vector<uint8_t> Compress(const std::vector<uint8_t>& bits) {
+        std::vector<uint8_t> out;
+        size_t i = 0;
+        while (i < bits.size()) {
+            uint32_t zeros = 0;
+            while (i < bits.size() && bits[i] == 0) {
+                ++zeros;
+                ++i;
+            }
+            size_t begin = i;
+            while (i < bits.size() && bits[i] != 0) ++i;
+            write_varint(out, zeros);
+            write_varint(out, static_cast<uint32_t>(i - begin));
+            out.insert(out.end(), bits.begin() + begin, bits.begin() + i);
+        }
+        return out;
+    }
+
+    bool Save(std::string_view file_name) const {
+        std::ofstream out(file_name.data(), std::ios::out | std::ios::binary);
+        if (!out.good()) return false;
+        uint32_t magic = 0x53565047; // GPVS
+        out.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+        out.write(reinterpret_cast<const char*>(&param_.region), sizeof(param_.region));
+        out.write(reinterpret_cast<const char*>(&param_.cell_size), sizeof(param_.cell_size));
+        out.write(reinterpret_cast<const char*>(dims_), sizeof(dims_));
+        out.write(reinterpret_cast<const char*>(&object_count_), sizeof(object_count_));
+        for (const auto& cell : cells_) {
+            uint32_t size = static_cast<uint32_t>(cell.size());
+            out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+            out.write(reinterpret_cast<const char*>(cell.data()), size);
+        }
+        return out.good();
+    }
+
+    size_t GetCompressedSize() const {
+        size_t size = 0;
+        for (const auto& cell : cells_) size += cell.size();
+        return size;
+    }
+};
+
+/* Runtime side of the PVS. The camera's cell is decoded once when the camera enters it, after that every
+ * visibility test is a single bit lookup. Outside the baked region everything is visible */
+class PotentiallyVisibleSet {
+private:
+    aabb_t region_{};
+    float cell_size_{1.0f};
+    uint32_t dims_[3]{};
+    uint32_t object_count_{0};
+    std::vector<std::vector<uint8_t>> cells_;
+    std::vector<uint8_t> current_;
+    int64_t current_cell_{-2};
+
+    static uint32_t read_varint(const std::vector<uint8_t>& in, size_t& i) {
+        uint32_t v = 0;
+        for (uint32_t shift = 0; i < in.size(); shift += 7) {
+            uint8_t b = in[i++];
+            v |= static_cast<uint32_t>(b & 0x7f) << shift;
+            if (!(b & 0x80)) break;
+        }
+        return v;
+    }
+
+    // Whether an encoded set stays inside a bitset of set_bytes, runs and literals included
+    static bool fits(const std::vector<uint8_t>& in, uint64_t set_bytes) {
+        size_t i = 0;
+        uint64_t pos = 0;
+        while (i < in.size()) {
+            pos += read_varint(in, i);
+            uint64_t literals = read_varint(in, i);
+            if (literals > in.size() - i) return false;
+            i += literals;
+            pos += literals;
+            if (pos > set_bytes) return false;
+        }
+        return true;
+    }
+
+    void decode(const std::vector<uint8_t>& in) {
+        std::fill(current_.begin(), current_.end(), 0);
+        size_t i = 0;
+        size_t pos = 0;
+        while (i < in.size()) {
+            pos += read_varint(in, i);
+            uint32_t literals = read_varint(in, i);
+            for (uint32_t k = 0; k < literals && pos < current_.size() && i < in.size(); ++k) current_[pos++] = in[i++];
+        }
+    }
+public:
+    /* Read a set saved by PVSBaker::Save. Counts are checked against the file size and every cell against the object
+     * count before anything is allocated for them, a truncated or corrupt file fails to load */
+    bool Load(std::string_view file_name) {
+        std::ifstream in(file_name.data(), std::ios::in | std::ios::binary | std::ios::ate);
+        if (!in.good()) return false;
+        const uint64_t file_size = static_cast<uint64_t>(in.tellg());
+        in.seekg(0);
+        uint32_t magic = 0;
+        in.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+        if (magic != 0x53565047) return false;
+        in.read(reinterpret_cast<char*>(&region_), sizeof(region_));
+        in.read(reinterpret_cast<char*>(&cell_size_), sizeof(cell_size_));
+        in.read(reinterpret_cast<char*>(dims_), sizeof(dims_));
+        in.read(reinterpret_cast<char*>(&object_count_), sizeof(object_count_));
+        if (!in.good() || !(cell_size_ > 0.0f)) return false;
+        // Every cell stores at least its size, which bounds the cell count by the bytes left
+        uint64_t remaining = file_size - static_cast<uint64_t>(in.tellg());
+        uint64_t cell_count = static_cast<uint64_t>(dims_[0]) * dims_[1] * dims_[2];
+        if (cell_count == 0 || dims_[0] == 0 || cell_count > remaining / sizeof(uint32_t)) return false;
+        remaining -= cell_count * sizeof(uint32_t);
+        const uint64_t set_bytes = (static_cast<uint64_t>(object_count_) + 7) / 8;
+        cells_.assign(cell_count, {});
+        for (auto& cell : cells_) {
+            uint32_t size = 0;
+            in.read(reinterpret_cast<char*>(&size), sizeof(size));
+            if (!in.good() || size > remaining) return false;
+            remaining -= size;
+            cell.resize(size);
+            in.read(reinterpret_cast<char*>(cell.data()), size);
+            if (!in.good() || !fits(cell, set_bytes)) return false;
+        }
+        current_.assign(set_bytes, 0xff);
+        current_cell_ = -2;
+        return true;
+    }
+
+    /* Select the set of the cell containing the camera, returns whether the camera is inside the baked region */
+    bool UpdateCamera(const float3_t& position) {
+        int64_t cell = -1;
+        if (aabb_contains(region_, position)) {
+            uint32_t c[3];
+            for (int i = 0; i < 3; ++i) {
+                float rel = ((&position.x)[i] - (&region_.min.x)[i]) / cell_size_;
+                c[i] = std::min(dims_[i] - 1, static_cast<uint32_t>(rel));
+            }
+            cell = (static_cast<int64_t>(c[2]) * dims_[1] + c[1]) * dims_[0] + c[0];
+        }
+        if (cell != current_cell_) {
+            if (cell < 0) {
+                std::fill(current_.begin(), current_.end(), 0xff);
+            } else {
+                decode(cells_[cell]);
+            }
+            current_cell_ = cell;
+        }
+        return cell >= 0;
+    }
+
+    bool IsVisible(uint32_t object) const {
+        if (object >= object_count_) return true;
+        return (current_[object >> 3] >> (object & 7)) & 1;
+    }
+
+    /* Show the drawcalls of objects in the current set and hide the rest, object i is expected at first_drawcall + i.
+     * Run it before finer tests such as frustum culling, which then only hide */
+    template<typename PipelineT>
+    void Apply(PipelineT& pipeline, uint32_t first_drawcall) const {
+        for (uint32_t i = 0; i < object_count_; ++i) {
+            pipeline.GetDrawCall(first_drawcall + i).SetVisible(IsVisible(i));
+        }
+    }
+
+    uint32_t GetObjectCount() const {
+        return object_count_;
+    }
+};
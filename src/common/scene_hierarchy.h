@@ -0,0 +1,219 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#include "job_pool.h"
+
+/* Parent/child transforms stored flat in breadth-first order, so every parent precedes its children and each depth
+ * level is one contiguous range. Update walks the levels in order and recomputes a world matrix only when its local
+ * matrix or an ancestor changed; nodes of one level are independent and run in parallel on a job pool.
+ * Nodes are addressed by stable handles, the internal order is rebuilt lazily after structural changes. */
+class SceneHierarchy {
+public:
+    static constexpr uint32_t npos = std::numeric_limits<uint32_t>::max();
+    struct matrix_t {
+        float m[4][4];
+    };
+private:
+    // Indexed by position in breadth-first order
+    std::vector<uint32_t> parent_;
+    std::vector<uint32_t> handle_;
+    std::vector<matrix_t> local_;
+    std::vector<matrix_t> world_;
+    std::vector<uint8_t> dirty_;
+    std::vector<uint8_t> changed_;
+    std::vector<uint32_t> level_begin_;
+    // Indexed by handle
+    std::vector<uint32_t> index_;
+    std::vector<uint32_t> free_handles_;
+    std::vector<uint32_t> removed_;
+    bool structure_dirty_{false};
+    uint32_t recomputed_{0};
+
+    static void multiply(const matrix_t& a, const matrix_t& b, matrix_t& r) {
+        for (int i = 0; i < 4; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                r.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j] + a.m[i][3] * b.m[3][j];
+            }
+        }
+    }
+
+    void rebuild() {
+        uint32_t n = static_cast<uint32_t>(parent_.size());
+        // Removed nodes take their subtrees with them. Parents may sit after children until reordered, so resolve
+        // liveness and depth by walking up the chain with memoization
+        std::vector<uint8_t> dead(n, 0);
+        for (uint32_t h : removed_) {
+            if (h < index_.size() && index_[h] != npos) dead[index_[h]] = 1;
+        }
+        std::vector<uint32_t> depth(n, npos);
+        std::vector<uint32_t> chain;
+        for (uint32_t i = 0; i < n; ++i) {
+            uint32_t cur = i;
+            while (depth[cur] == npos && !dead[cur] && parent_[cur] != npos) {
+                chain.push_back(cur);
+                cur = parent_[cur];
+            }
+            uint32_t d = dead[cur] ? npos : (depth[cur] != npos ? depth[cur] : 0);
+            if (!dead[cur]) depth[cur] = d;
+            while (!chain.empty()) {
+                uint32_t c = chain.back();
+                chain.pop_back();
+                if (d == npos) {
+                    dead[c] = 1;
+                } else {
+                    depth[c] = ++d;
+                }
+            }
+        }
+        std::vector<uint32_t> order;
+        order.reserve(n);
+        for (uint32_t i = 0; i < n; ++i) {
+            if (!dead[i]) order.push_back(i);
+        }
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return depth[a] < depth[b]; });
+        std::vector<uint32_t> new_index(n, npos);
+        for (uint32_t i = 0; i < order.size(); ++i) new_index[order[i]] = i;
+        std::vector<uint32_t> parent(order.size()), handle(order.size());
+        std::vector<matrix_t> local(order.size()), world(order.size());
+        std::vector<uint8_t> dirty(order.size()), changed(order.size(), 0);
+        level_begin_.clear();
+        for (uint32_t i = 0; i < order.size(); ++i) {
+            uint32_t o = order[i];
+            parent[i] = parent_[o] == npos ? npos : new_index[parent_[o]];
+            handle[i] = handle_[o];
+            local[i] = local_[o];
+            world[i] = world_[o];
+            // Structural changes are rare, recompute everything once instead of tracking which subtrees moved
+            dirty[i] = 1;
+            while (level_begin_.size() <= depth[o]) level_begin_.push_back(i);
+        }
+        level_begin_.push_back(static_cast<uint32_t>(order.size()));
+        for (uint32_t i = 0; i < n; ++i) {
+            if (dead[i]) {
+                index_[handle_[i]] = npos;
+                free_handles_.push_back(handle_[i]);
+            }
+        }
+        for (uint32_t i = 0; i < order.size(); ++i) index_[handle[i]] = i;
+        parent_ = std::move(parent);
+        handle_ = std::move(handle);
+        local_ = std::move(local);
+        world_ = std::move(world);
+        dirty_ = std::move(dirty);
+        changed_ = std::move(changed);
+        removed_.clear();
+        structure_dirty_ = false;
+    }
+
+    void update_range(uint32_t begin, uint32_t end, uint32_t& recomputed) {
+        for (uint32_t i = begin; i < end; ++i) {
+            uint32_t p = parent_[i];
+            bool changed = dirty_[i] || (p != npos && changed_[p]);
+            changed_[i] = changed;
+            dirty_[i] = 0;
+            if (!changed) continue;
+            if (p == npos) {
+                world_[i] = local_[i];
+            } else {
+                multiply(local_[i], world_[p], world_[i]);
+            }
+            ++recomputed;
+        }
+    }
+public:
+    /* Add a node under parent (npos for a root), the world matrix is valid after the next Update */
+    uint32_t AddNode(uint32_t parent, const float local[4][4]) {
+        uint32_t h;
+        if (!free_handles_.empty()) {
+            h = free_handles_.back();
+            free_handles_.pop_back();
+        } else {
+            h = static_cast<uint32_t>(index_.size());
+            index_.push_back(npos);
+        }
+        matrix_t m;
+        memcpy(m.m, local, sizeof(m.m));
+        index_[h] = static_cast<uint32_t>(parent_.size());
+        parent_.push_back(parent == npos ? npos : index_[parent]);
+        handle_.push_back(h);
+        local_.push_back(m);
+        world_.push_back(m);
+        dirty_.push_back(1);
+        changed_.push_back(0);
+        structure_dirty_ = true;
+        return h;
+    }
+
+    /* Remove a node together with its subtree */
+    void RemoveNode(uint32_t handle) {
+        removed_.push_back(handle);
+        structure_dirty_ = true;
+    }
+
+    /* Move a node with its subtree under parent, or to the roots with npos. Fails when parent is the node itself or
+     * one of its descendants, which would make a cycle */
+    bool SetParent(uint32_t handle, uint32_t parent) {
+        uint32_t i = index_[handle];
+        if (parent != npos) {
+            for (uint32_t cur = index_[parent]; cur != npos; cur = parent_[cur]) {
+                if (cur == i) return false;
+            }
+        }
+        parent_[i] = parent == npos ? npos : index_[parent];
+        structure_dirty_ = true;
+        return true;
+    }
+
+    void SetLocalMatrix(uint32_t handle, const float local[4][4]) {
+        uint32_t i = index_[handle];
+        memcpy(local_[i].m, local, sizeof(local_[i].m));
+        dirty_[i] = 1;
+    }
+
+    /* Propagate changed local matrices down the tree. Levels run one after another, the nodes inside a level are
+     * split over pool when given. Returns the number of world matrices recomputed */
+    uint32_t Update(JobPool* pool = nullptr, uint32_t grain = 1024) {
+        if (structure_dirty_) rebuild();
+        recomputed_ = 0;
+        for (size_t l = 0; l + 1 < level_begin_.size(); ++l) {
+            uint32_t begin = level_begin_[l];
+            uint32_t end = level_begin_[l + 1];
+            if (pool && end - begin > grain) {
+                std::atomic<uint32_t> recomputed{0};
+                pool->ParallelFor(end - begin, grain, [&](uint32_t b, uint32_t e) {
+                    uint32_t local_count = 0;
+                    update_range(begin + b, begin + e, local_count);
+                    recomputed.fetch_add(local_count, std::memory_order_relaxed);
+                });
+                recomputed_ += recomputed.load();
+            } else {
+                update_range(begin, end, recomputed_);
+            }
+        }
+        return recomputed_;
+    }
+
+    const float (&GetWorldMatrix(uint32_t handle) const)[4][4] {
+        return world_[index_[handle]].m;
+    }
+
+    /* Whether the world matrix was recomputed by the last Update */
+    bool WorldChanged(uint32_t handle) const {
+        return changed_[index_[handle]] != 0;
+    }
+
+    uint32_t GetNodeCount() const {
+        return static_cast<uint32_t>(parent_.size());
+    }
+
+    uint32_t GetLevelCount() const {
+        return level_begin_.empty() ? 0 : static_cast<uint32_t>(level_begin_.size() - 1);
+    }
+};
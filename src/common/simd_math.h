@@ -0,0 +1,400 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#include "geometry.h"
+
+// Portable vector, matrix and quaternion math. Same conventions as DirectXMath: row-major matrices, row vectors
+// multiplied on the left, left-handed view and projection with D3D depth range. The backend is picked at compile time:
+// AVX2 (with FMA) when the compiler targets it, SSE4.1 otherwise on x86, scalar elsewhere or when SIMD_MATH_SCALAR is
+// defined.
+
+#if !defined(SIMD_MATH_SCALAR) && defined(__AVX2__)
+#define SIMD_MATH_AVX2 1
+#define SIMD_MATH_SSE4 1
+#include <immintrin.h>
+#elif !defined(SIMD_MATH_SCALAR) && (defined(__SSE4_1__) || defined(__AVX__) || defined(_M_X64))
+// MSVC has no macro for SSE4.1, every x64 target this project runs on supports it
+#define SIMD_MATH_SSE4 1
+#include <smmintrin.h>
+#elif !defined(SIMD_MATH_SCALAR)
+#define SIMD_MATH_SCALAR 1
+#endif
+
+constexpr float math_pi = 3.141592654f;
+constexpr float math_pi_div2 = 1.570796327f;
+
+inline float deg_to_rad(float degrees) {
+    return degrees * (math_pi / 180.0f);
+}
+
+struct float4x4_t {
+    float m[4][4];
+};
+
+#ifdef SIMD_MATH_SSE4
+struct vec_t {
+    __m128 v;
+};
+#else
+struct vec_t {
+    float v[4];
+};
+#endif
+
+struct mat_t {
+    vec_t r[4];
+};
+
+#ifdef SIMD_MATH_SSE4
+
+inline vec_t vec_set(float x, float y, float z, float w) {
+    return {_mm_set_ps(w, z, y, x)};
+}
+
+inline vec_t vec_splat(float s) {
+    return {_mm_set1_ps(s)};
+}
+
+inline float vec_get_x(vec_t a) {
+    return _mm_cvtss_f32(a.v);
+}
+
+inline float vec_get_y(vec_t a) {
+    return _mm_cvtss_f32(_mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(1, 1, 1, 1)));
+}
+
+inline float vec_get_z(vec_t a) {
+    return _mm_cvtss_f32(_mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(2, 2, 2, 2)));
+}
+
+inline float vec_get_w(vec_t a) {
+    return _mm_cvtss_f32(_mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(3, 3, 3, 3)));
+}
+
+inline vec_t vec_add(vec_t a, vec_t b) {
+    return {_mm_add_ps(a.v, b.v)};
+}
+
+inline vec_t vec_sub(vec_t a, vec_t b) {
+    return {_mm_sub_ps(a.v, b.v)};
+}
+
+inline vec_t vec_mul(vec_t a, vec_t b) {
+    return {_mm_mul_ps(a.v, b.v)};
+}
+
+inline vec_t vec_scale(vec_t a, float s) {
+    return {_mm_mul_ps(a.v, _mm_set1_ps(s))};
+}
+
+// a * b + c
+inline vec_t vec_mul_add(vec_t a, vec_t b, vec_t c) {
+#ifdef SIMD_MATH_AVX2
+    return {_mm_fmadd_ps(a.v, b.v, c.v)};
+#else
+    return {_mm_add_ps(_mm_mul_ps(a.v, b.v), c.v)};
+#endif
+}
+
+// Dot product of xyz, replicated to every lane
+inline vec_t vec_dot3(vec_t a, vec_t b) {
+    return {_mm_dp_ps(a.v, b.v, 0x7f)};
+}
+
+inline vec_t vec_dot4(vec_t a, vec_t b) {
+    return {_mm_dp_ps(a.v, b.v, 0xff)};
+}
+
+inline vec_t vec_cross3(vec_t a, vec_t b) {
+    __m128 a_yzx = _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 b_yzx = _mm_shuffle_ps(b.v, b.v, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 c = _mm_sub_ps(_mm_mul_ps(a.v, b_yzx), _mm_mul_ps(a_yzx, b.v));
+    return {_mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1))};
+}
+
+inline vec_t vec_sqrt(vec_t a) {
+    return {_mm_sqrt_ps(a.v)};
+}
+
+inline vec_t vec_div(vec_t a, vec_t b) {
+    return {_mm_div_ps(a.v, b.v)};
+}
+
+inline vec_t vec_min(vec_t a, vec_t b) {
+    return {_mm_min_ps(a.v, b.v)};
+}
+
+inline vec_t vec_max(vec_t a, vec_t b) {
+    return {_mm_max_ps(a.v, b.v)};
+}
+
+// Lane i of r comes from lane i of a
+inline vec_t vec_splat_lane(vec_t a, int lane) {
+    switch (lane) {
+        case 0: return {_mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(0, 0, 0, 0))};
+        case 1: return {_mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(1, 1, 1, 1))};
+        case 2: return {_mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(2, 2, 2, 2))};
+        default: return {_mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(3, 3, 3, 3))};
+    }
+}
+
+inline vec_t vec_load4(const float* p) {
+    return {_mm_loadu_ps(p)};
+}
+
+inline void vec_store4(float* p, vec_t a) {
+    _mm_storeu_ps(p, a.v);
+}
+
+inline mat_t mat_transpose(const mat_t& m) {
+    mat_t r = m;
+    _MM_TRANSPOSE4_PS(r.r[0].v, r.r[1].v, r.r[2].v, r.r[3].v);
+    return r;
+}
+
+inline mat_t mat_mul(const mat_t& a, const mat_t& b) {
+    mat_t r;
+#ifdef SIMD_MATH_AVX2
+    // Two result rows per 256-bit register, each lane broadcasts its own row's elements
+    __m256 b0 = _mm256_broadcast_ps(&b.r[0].v), b1 = _mm256_broadcast_ps(&b.r[1].v);
+    __m256 b2 = _mm256_broadcast_ps(&b.r[2].v), b3 = _mm256_broadcast_ps(&b.r[3].v);
+    for (int i = 0; i < 4; i += 2) {
+        __m256 rows = _mm256_set_m128(a.r[i + 1].v, a.r[i].v);
+        __m256 acc = _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, 0x00), b0);
+        acc = _mm256_fmadd_ps(_mm256_shuffle_ps(rows, rows, 0x55), b1, acc);
+        acc = _mm256_fmadd_ps(_mm256_shuffle_ps(rows, rows, 0xaa), b2, acc);
+        acc = _mm256_fmadd_ps(_mm256_shuffle_ps(rows, rows, 0xff), b3, acc);
+        r.r[i].v = _mm256_castps256_ps128(acc);
+        r.r[i + 1].v = _mm256_extractf128_ps(acc, 1);
+    }
+#else
+    for (int i = 0; i < 4; ++i) {
+        __m128 row = a.r[i].v;
+        __m128 acc = _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(0, 0, 0, 0)), b.r[0].v);
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(1, 1, 1, 1)), b.r[1].v));
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(2, 2, 2, 2)), b.r[2].v));
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(3, 3, 3, 3)), b.r[3].v));
+        r.r[i].v = acc;
+    }
+#endif
+    return r;
+}
+
+#else // SIMD_MATH_SCALAR
+
+inline vec_t vec_set(float x, float y, float z, float w) {
+    return {{x, y, z, w}};
+}
+
+inline vec_t vec_splat(float s) {
+    return {{s, s, s, s}};
+}
+
+inline float vec_get_x(vec_t a) {
+    return a.v[0];
+}
+
+inline float vec_get_y(vec_t a) {
+    return a.v[1];
+}
+
+inline float vec_get_z(vec_t a) {
+    return a.v[2];
+}
+
+inline float vec_get_w(vec_t a) {
+    return a.v[3];
+}
+
+inline vec_t vec_add(vec_t a, vec_t b) {
+    return {{a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]}};
+}
+
+inline vec_t vec_sub(vec_t a, vec_t b) {
+    return {{a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]}};
+}
+
+inline vec_t vec_mul(vec_t a, vec_t b) {
+    return {{a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]}};
+}
+
+inline vec_t vec_scale(vec_t a, float s) {
+    return {{a.v[0] * s, a.v[1] * s, a.v[2] * s, a.v[3] * s}};
+}
+
+inline vec_t vec_mul_add(vec_t a, vec_t b, vec_t c) {
+    return vec_add(vec_mul(a, b), c);
+}
+
+inline vec_t vec_dot3(vec_t a, vec_t b) {
+    return vec_splat(a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2]);
+}
+
+inline vec_t vec_dot4(vec_t a, vec_t b) {
+    return vec_splat(a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2] + a.v[3] * b.v[3]);
+}
+
+inline vec_t vec_cross3(vec_t a, vec_t b) {
+    return {{a.v[1] * b.v[2] - a.v[2] * b.v[1], a.v[2] * b.v[0] - a.v[0] * b.v[2], a.v[0] * b.v[1] - a.v[1] * b.v[0], 0.0f}};
+}
+
+inline vec_t vec_sqrt(vec_t a) {
+    return {{std::sqrt(a.v[0]), std::sqrt(a.v[1]), std::sqrt(a.v[2]), std::sqrt(a.v[3])}};
+}
+
+inline vec_t vec_div(vec_t a, vec_t b) {
+    return {{a.v[0] / b.v[0], a.v[1] / b.v[1], a.v[2] / b.v[2], a.v[3] / b.v[3]}};
+}
+
+inline vec_t vec_min(vec_t a, vec_t b) {
+    return {{std::fmin(a.v[0], b.v[0]), std::fmin(a.v[1], b.v[1]), std::fmin(a.v[2], b.v[2]), std::fmin(a.v[3], b.v[3])}};
+}
+
+inline vec_t vec_max(vec_t a, vec_t b) {
+    return {{std::fmax(a.v[0], b.v[0]), std::fmax(a.v[1], b.v[1]), std::fmax(a.v[2], b.v[2]), std::fmax(a.v[3], b.v[3])}};
+}
+
+inline vec_t vec_splat_lane(vec_t a, int lane) {
+    return vec_splat(a.v[lane]);
+}
+
+inline vec_t vec_load4(const float* p) {
+    return {{p[0], p[1], p[2], p[3]}};
+}
+
+inline void vec_store4(float* p, vec_t a) {
+    p[0] = a.v[0]; p[1] = a.v[1]; p[2] = a.v[2]; p[3] = a.v[3];
+}
+
+inline mat_t mat_transpose(const mat_t& m) {
+    mat_t r;
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) r.r[i].v[j] = m.r[j].v[i];
+    }
+    return r;
+}
+
+inline mat_t mat_mul(const mat_t& a, const mat_t& b) {
+    mat_t r;
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            r.r[i].v[j] = a.r[i].v[0] * b.r[0].v[j] + a.r[i].v[1] * b.r[1].v[j] + a.r[i].v[2] * b.r[2].v[j] + a.r[i].v[3] * b.r[3].v[j];
+        }
+    }
+    return r;
+}
+
+#endif
+
+// Backend independent functions, built on the primitives above
+
+inline vec_t vec_load3(const float3_t& p, float w = 0.0f) {
+    return vec_set(p.x, p.y, p.z, w);
+}
+
+inline float3_t vec_store3(vec_t a) {
+    return {vec_get_x(a), vec_get_y(a), vec_get_z(a)};
+}
+
+inline float vec_length3(vec_t a) {
+    return std::sqrt(vec_get_x(vec_dot3(a, a)));
+}
+
+// Zero length vectors stay zero instead of turning into NaN
+inline vec_t vec_normalize3(vec_t a) {
+    float len = vec_length3(a);
+    return len > 0.0f ? vec_scale(a, 1.0f / len) : a;
+}
+
+// Row vector times matrix
+inline vec_t vec_transform(vec_t a, const mat_t& m) {
+    vec_t r = vec_mul(vec_splat_lane(a, 0), m.r[0]);
+    r = vec_mul_add(vec_splat_lane(a, 1), m.r[1], r);
+    r = vec_mul_add(vec_splat_lane(a, 2), m.r[2], r);
+    return vec_mul_add(vec_splat_lane(a, 3), m.r[3], r);
+}
+
+inline mat_t mat_load(const float m[4][4]) {
+    return {{vec_load4(m[0]), vec_load4(m[1]), vec_load4(m[2]), vec_load4(m[3])}};
+}
+
+inline void mat_store(float m[4][4], const mat_t& a) {
+    for (int i = 0; i < 4; ++i) vec_store4(m[i], a.r[i]);
+}
+
+inline mat_t mat_identity() {
+    return {{vec_set(1, 0, 0, 0), vec_set(0, 1, 0, 0), vec_set(0, 0, 1, 0), vec_set(0, 0, 0, 1)}};
+}
+
+inline mat_t mat_translation(float x, float y, float z) {
+    return {{vec_set(1, 0, 0, 0), vec_set(0, 1, 0, 0), vec_set(0, 0, 1, 0), vec_set(x, y, z, 1)}};
+}
+
+inline mat_t mat_scaling(float x, float y, float z) {
+    return {{vec_set(x, 0, 0, 0), vec_set(0, y, 0, 0), vec_set(0, 0, z, 0), vec_set(0, 0, 0, 1)}};
+}
+
+// Quaternions are (x, y, z, w) with w the real part
+inline vec_t quat_rotation_roll_pitch_yaw(float pitch, float yaw, float roll) {
+    float sp = std::sin(pitch * 0.5f), cp = std::cos(pitch * 0.5f);
+    float sy = std::sin(yaw * 0.5f), cy = std::cos(yaw * 0.5f);
+    float sr = std::sin(roll * 0.5f), cr = std::cos(roll * 0.5f);
+    return vec_set(
+        sp * cy * cr + cp * sy * sr,
+        cp * sy * cr - sp * cy * sr,
+        cp * cy * sr - sp * sy * cr,
+        cp * cy * cr + sp * sy * sr);
+}
+
+// Rotation by a followed by b
+inline vec_t quat_mul(vec_t a, vec_t b) {
+    float ax = vec_get_x(a), ay = vec_get_y(a), az = vec_get_z(a), aw = vec_get_w(a);
+    float bx = vec_get_x(b), by = vec_get_y(b), bz = vec_get_z(b), bw = vec_get_w(b);
+    return vec_set(
+        bw * ax + bx * aw + by * az - bz * ay,
+        bw * ay - bx * az + by * aw + bz * ax,
+        bw * az + bx * ay - by * ax + bz * aw,
+        bw * aw - bx * ax - by * ay - bz * az);
+}
+
+inline mat_t mat_rotation_quaternion(vec_t q) {
+    float x = vec_get_x(q), y = vec_get_y(q), z = vec_get_z(q), w = vec_get_w(q);
+    return {{
+        vec_set(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + z * w), 2.0f * (x * z - y * w), 0.0f),
+        vec_set(2.0f * (x * y - z * w), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + x * w), 0.0f),
+        vec_set(2.0f * (x * z + y * w), 2.0f * (y * z - x * w), 1.0f - 2.0f * (x * x + y * y), 0.0f),
+        vec_set(0.0f, 0.0f, 0.0f, 1.0f),
+    }};
+}
+
+// Roll around z, then pitch around x, then yaw around y
+inline mat_t mat_rotation_roll_pitch_yaw(float pitch, float yaw, float roll) {
+    return mat_rotation_quaternion(quat_rotation_roll_pitch_yaw(pitch, yaw, roll));
+}
+
+inline mat_t mat_look_at_lh(vec_t eye, vec_t focus, vec_t up) {
+    vec_t z = vec_normalize3(vec_sub(focus, eye));
+    vec_t x = vec_normalize3(vec_cross3(up, z));
+    vec_t y = vec_cross3(z, x);
+    mat_t r = {{
+        vec_set(vec_get_x(x), vec_get_x(y), vec_get_x(z), 0.0f),
+        vec_set(vec_get_y(x), vec_get_y(y), vec_get_y(z), 0.0f),
+        vec_set(vec_get_z(x), vec_get_z(y), vec_get_z(z), 0.0f),
+        vec_set(-vec_get_x(vec_dot3(x, eye)), -vec_get_x(vec_dot3(y, eye)), -vec_get_x(vec_dot3(z, eye)), 1.0f),
+    }};
+    return r;
+}
+
+inline mat_t mat_perspective_fov_lh(float fov_y, float aspect_ratio, float near_z, float far_z) {
+    float h = std::cos(fov_y * 0.5f) / std::sin(fov_y * 0.5f);
+    float w = h / aspect_ratio;
+    float range = far_z / (far_z - near_z);
+    return {{
+        vec_set(w, 0.0f, 0.0f, 0.0f),
+        vec_set(0.0f, h, 0.0f, 0.0f),
+        vec_set(0.0f, 0.0f, range, 1.0f),
+        vec_set(0.0f, 0.0f, -range * near_z, 0.0f),
+    }};
+}
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <vector>
+
+#include "geometry.h"
+
+/* Loose spatial hash grid for many moving objects. Each object lives in exactly one bucket, chosen by hashing the
+ * cell of its center, and queries grow their region by the largest half extent seen so nothing is missed. Buckets
+ * keep ids and bounds in separate contiguous arrays, so a query only streams the bounds it tests.
+ * Queries take a shared lock and may run concurrently from any number of threads, updates take an exclusive lock;
+ * the batched variants take it once per batch. */
+class SpatialHashGrid {
+public:
+    using spatial_move_t = struct {
+        uint32_t id;
+        aabb_t bounds;
+    };
+private:
+    struct bucket_t {
+        std::vector<uint32_t> ids;
+        std::vector<aabb_t> bounds;
+    };
+    struct object_t {
+        uint32_t bucket;
+        uint32_t slot;
+    };
+    static constexpr uint32_t npos = std::numeric_limits<uint32_t>::max();
+
+    float cell_size_;
+    float inv_cell_size_;
+    uint32_t bucket_mask_;
+    std::vector<bucket_t> buckets_;
+    std::vector<object_t> objects_;
+    std::vector<uint32_t> free_ids_;
+    float max_extent_{0.0f};
+    uint32_t count_{0};
+    mutable std::shared_mutex mutex_;
+
+    int32_t cell_of(float v) const {
+        return static_cast<int32_t>(std::floor(v * inv_cell_size_));
+    }
+
+    uint32_t bucket_of_cell(int32_t x, int32_t y, int32_t z) const {
+        uint32_t h = static_cast<uint32_t>(x) * 73856093u ^ static_cast<uint32_t>(y) * 19349663u ^ static_cast<uint32_t>(z) * 83492791u;
+        return h & bucket_mask_;
+    }
+
+    uint32_t bucket_of(const aabb_t& b) const {
+        float3_t c = aabb_center(b);
+        return bucket_of_cell(cell_of(c.x), cell_of(c.y), cell_of(c.z));
+    }
+
+    void track_extent(const aabb_t& b) {
+        float3_t e = aabb_extent(b);
+        max_extent_ = std::max(max_extent_, std::max(e.x, std::max(e.y, e.z)));
+    }
+
+    uint32_t insert_locked(const aabb_t& b) {
+        uint32_t id;
+        if (!free_ids_.empty()) {
+            id = free_ids_.back();
+            free_ids_.pop_back();
+        } else {
+            id = static_cast<uint32_t>(objects_.size());
+            objects_.push_back({npos, npos});
+        }
+        uint32_t bi = bucket_of(b);
+        bucket_t& bucket = buckets_[bi];
+        objects_[id] = {bi, static_cast<uint32_t>(bucket.ids.size())};
+        bucket.ids.push_back(id);
+        bucket.bounds.push_back(b);
+        track_extent(b);
+        ++count_;
+        return id;
+    }
+
+    void remove_locked(uint32_t id) {
+        if (id >= objects_.size() || objects_[id].slot == npos) return;
+        object_t& obj = objects_[id];
+        bucket_t& bucket = buckets_[obj.bucket];
+        // Swap with the last entry of the bucket and patch the moved object's slot
+        uint32_t last = static_cast<uint32_t>(bucket.ids.size() - 1);
+        if (obj.slot != last) {
+            bucket.ids[obj.slot] = bucket.ids[last];
+            bucket.bounds[obj.slot] = bucket.bounds[last];
+            objects_[bucket.ids[obj.slot]].slot = obj.slot;
+        }
+        bucket.ids.pop_back();
+        bucket.bounds.pop_back();
+        obj = {npos, npos};
+        free_ids_.push_back(id);
+        --count_;
+    }
+
+    void move_locked(uint32_t id, const aabb_t& b) {
+        if (id >= objects_.size() || objects_[id].slot == npos) return;
+        object_t& obj = objects_[id];
+        uint32_t bi = bucket_of(b);
+        track_extent(b);
+        if (bi == obj.bucket) {
+            // Most moves stay inside their cell, only the bounds change
+            buckets_[bi].bounds[obj.slot] = b;
+            return;
+        }
+        bucket_t& from = buckets_[obj.bucket];
+        uint32_t last = static_cast<uint32_t>(from.ids.size() - 1);
+        if (obj.slot != last) {
+            from.ids[obj.slot] = from.ids[last];
+            from.bounds[obj.slot] = from.bounds[last];
+            objects_[from.ids[obj.slot]].slot = obj.slot;
+        }
+        from.ids.pop_back();
+        from.bounds.pop_back();
+        bucket_t& to = buckets_[bi];
+        obj = {bi, static_cast<uint32_t>(to.ids.size())};
+        to.ids.push_back(id);
+        to.bounds.push_back(b);
+    }
+
+    // Visit every bucket that may hold objects overlapping region, each at most once. Cells whose loose bounds fail
+    // test are skipped without hashing. Objects must overlap region as well as pass test, so the result does not
+    // depend on which buckets were visited when test is looser than region, as the frustum plane test is
+    template<typename Test>
+    void query_locked(const aabb_t& region, Test&& test, std::vector<uint32_t>& out) const {
+        auto scan = [&](const bucket_t& bucket) {
+            for (size_t i = 0; i < bucket.bounds.size(); ++i) {
+                if (aabb_overlaps(region, bucket.bounds[i]) && test(bucket.bounds[i])) out.push_back(bucket.ids[i]);
+            }
+        };
+        int32_t x0 = cell_of(region.min.x - max_extent_), x1 = cell_of(region.max.x + max_extent_);
+        int32_t y0 = cell_of(region.min.y - max_extent_), y1 = cell_of(region.max.y + max_extent_);
+        int32_t z0 = cell_of(region.min.z - max_extent_), z1 = cell_of(region.max.z + max_extent_);
+        double cells = (static_cast<double>(x1) - x0 + 1) * (static_cast<double>(y1) - y0 + 1) * (static_cast<double>(z1) - z0 + 1);
+        if (cells * 2.0 >= static_cast<double>(buckets_.size())) {
+            // Region covers a large share of the buckets, a linear pass beats hashing and deduplicating every cell
+            for (const auto& bucket : buckets_) scan(bucket);
+            return;
+        }
+        std::vector<uint32_t> visit;
+        visit.reserve(static_cast<size_t>(cells));
+        for (int32_t z = z0; z <= z1; ++z) {
+            for (int32_t y = y0; y <= y1; ++y) {
+                for (int32_t x = x0; x <= x1; ++x) {
+                    aabb_t cell = {
+                        {x * cell_size_ - max_extent_, y * cell_size_ - max_extent_, z * cell_size_ - max_extent_},
+                        {(x + 1) * cell_size_ + max_extent_, (y + 1) * cell_size_ + max_extent_, (z + 1) * cell_size_ + max_extent_},
+                    };
+                    if (test(cell)) visit.push_back(bucket_of_cell(x, y, z));
+                }
+            }
+        }
+        // Different cells can hash to the same bucket
+        std::sort(visit.begin(), visit.end());
+        visit.erase(std::unique(visit.begin(), visit.end()), visit.end());
+        for (uint32_t bi : visit) scan(buckets_[bi]);
+    }
+public:
+    /* cell_size should be around the typical object size, the bucket count is 2^bucket_bits */
+    SpatialHashGrid(float cell_size, uint32_t bucket_bits = 16) : cell_size_(cell_size), inv_cell_size_(1.0f / cell_size),
+        bucket_mask_((1u << bucket_bits) - 1), buckets_(static_cast<size_t>(1) << bucket_bits) {}
+    SpatialHashGrid(SpatialHashGrid&) = delete;
+
+    uint32_t Insert(const aabb_t& bounds) {
+        std::unique_lock lock(mutex_);
+        return insert_locked(bounds);
+    }
+
+    void Move(uint32_t id, const aabb_t& bounds) {
+        std::unique_lock lock(mutex_);
+        move_locked(id, bounds);
+    }
+
+    void Remove(uint32_t id) {
+        std::unique_lock lock(mutex_);
+        remove_locked(id);
+    }
+
+    void InsertBatch(std::span<const aabb_t> bounds, std::vector<uint32_t>& ids) {
+        std::unique_lock lock(mutex_);
+        ids.reserve(ids.size() + bounds.size());
+        for (const auto& b : bounds) ids.push_back(insert_locked(b));
+    }
+
+    void MoveBatch(std::span<const spatial_move_t> moves) {
+        std::unique_lock lock(mutex_);
+        for (const auto& m : moves) move_locked(m.id, m.bounds);
+    }
+
+    void RemoveBatch(std::span<const uint32_t> ids) {
+        std::unique_lock lock(mutex_);
+        for (uint32_t id : ids) remove_locked(id);
+    }
+
+    /* Queries append the ids of overlapping objects to out */
+    void QueryAABB(const aabb_t& box, std::vector<uint32_t>& out) const {
+        std::shared_lock lock(mutex_);
+        query_locked(box, [&](const aabb_t& b) { return aabb_overlaps(box, b); }, out);
+    }
+
+    void QuerySphere(const sphere_t& sphere, std::vector<uint32_t>& out) const {
+        std::shared_lock lock(mutex_);
+        aabb_t region = {
+            {sphere.center.x - sphere.radius, sphere.center.y - sphere.radius, sphere.center.z - sphere.radius},
+            {sphere.center.x + sphere.radius, sphere.center.y + sphere.radius, sphere.center.z + sphere.radius},
+        };
+        query_locked(region, [&](const aabb_t& b) { return sphere_overlaps_aabb(sphere, b); }, out);
+    }
+
+    void QueryFrustum(const frustum_t& frustum, std::vector<uint32_t>& out) const {
+        std::shared_lock lock(mutex_);
+        query_locked(frustum_bounds(frustum), [&](const aabb_t& b) { return frustum_overlaps_aabb(frustum, b); }, out);
+    }
+
+    uint32_t GetObjectCount() const {
+        std::shared_lock lock(mutex_);
+        return count_;
+    }
+
+    float GetCellSize() const {
+        return cell_size_;
+    }
+};
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/* Pixel formats textures are stored and uploaded in, the DX12 side maps them to DXGI formats. D3D12 has no 3-channel
+ * 8-bit format, RGB sources are stored as RGBA8 or BC1 */
+enum class texture_format : uint32_t {
+    R8_UNORM,
+    RG8_UNORM,
+    RGBA8_UNORM,
+    R16_FLOAT,
+    RGBA16_FLOAT,
+    BC1_UNORM,      // RGB with 1-bit alpha, 8 bytes per 4x4 block
+    BC4_UNORM,      // single channel, 8 bytes per block
+    BC5_UNORM,      // two channels, 16 bytes per block
+    BC7_UNORM,      // RGBA, 16 bytes per block
+};
+
+inline const char* texture_format_name(texture_format format) {
+    switch (format) {
+        case texture_format::R8_UNORM: return "R8";
+        case texture_format::RG8_UNORM: return "RG8";
+        case texture_format::R16_FLOAT: return "R16F";
+        case texture_format::RGBA16_FLOAT: return "RGBA16F";
+        case texture_format::BC1_UNORM: return "BC1";
+        case texture_format::BC4_UNORM: return "BC4";
+        case texture_format::BC5_UNORM: return "BC5";
+        case texture_format::BC7_UNORM: return "BC7";
+        default: return "RGBA8";
+    }
+}
+
+inline bool texture_format_is_block_compressed(texture_format format) {
+    return format >= texture_format::BC1_UNORM;
+}
+
+inline bool texture_format_is_float(texture_format format) {
+    return format == texture_format::R16_FLOAT || format == texture_format::RGBA16_FLOAT;
+}
+
+/* Channels a format stores */
+inline uint32_t texture_format_channels(texture_format format) {
+    switch (format) {
+        case texture_format::R8_UNORM:
+        case texture_format::R16_FLOAT:
+        case texture_format::BC4_UNORM: return 1;
+        case texture_format::RG8_UNORM:
+        case texture_format::BC5_UNORM: return 2;
+        case texture_format::BC1_UNORM: return 3;
+        default: return 4;
+    }
+}
+
+/* Bytes of one pixel, or of one 4x4 block for block compressed formats */
+inline uint32_t texture_format_pixel_bytes(texture_format format) {
+    switch (format) {
+        case texture_format::R8_UNORM: return 1;
+        case texture_format::RG8_UNORM:
+        case texture_format::R16_FLOAT: return 2;
+        case texture_format::RGBA16_FLOAT:
+        case texture_format::BC1_UNORM:
+        case texture_format::BC4_UNORM: return 8;
+        case texture_format::BC5_UNORM:
+        case texture_format::BC7_UNORM: return 16;
+        default: return 4;
+    }
+}
+
+/* IEEE half precision, rounded to nearest even. Overflow saturates to infinity, NaN stays NaN */
+inline uint16_t float_to_half(float value) {
+    uint32_t f;
+    memcpy(&f, &value, 4);
+    uint32_t sign = (f >> 16) & 0x8000;
+    uint32_t abs = f & 0x7fffffff;
+    if (abs >= 0x7f800000) return static_cast<uint16_t>(sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0));
+    if (abs >= 0x477ff000) return static_cast<uint16_t>(sign | 0x7c00);
+    if (abs < 0x38800000) {
+        // Subnormal: shift the mantissa with its implicit bit into place, rounding on the dropped bits
+        if (abs < 0x33000000) return static_cast<uint16_t>(sign);
+        uint32_t shift = 126 - (abs >> 23);
+        uint32_t mantissa = (abs & 0x7fffff) | 0x800000;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1))) ++half;
+        return static_cast<uint16_t>(sign | half);
+    }
+    uint32_t rounded = abs + 0xfff + ((abs >> 13) & 1) - (112u << 23);
+    return static_cast<uint16_t>(sign | (rounded >> 13));
+}
+
+inline float half_to_float(uint16_t value) {
+    uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1f;
+    uint32_t mantissa = value & 0x3ff;
+    uint32_t f;
+    if (exponent == 0x1f) {
+        f = sign | 0x7f800000 | (mantissa << 13);
+    } else if (exponent != 0) {
+        f = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    } else if (mantissa == 0) {
+        f = sign;
+    } else {
+        // Subnormal, normalize the mantissa
+        exponent = 113;
+        while (!(mantissa & 0x400)) {
+            mantissa <<= 1;
+            --exponent;
+        }
+        f = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+    float result;
+    memcpy(&result, &f, 4);
+    return result;
+}
+
+/* Encoder effort for block compressed formats */
+enum class bc_quality : uint32_t {
+    FAST,       // endpoints from the principal axis, one pass
+    NORMAL,     // plus endpoint refinement and a search over the BC7 p-bits
+    HIGH,       // plus more refinement and a local search over the quantized endpoints
+};
+
+/* Downsampling filter for mip levels */
+enum class mip_filter : uint32_t {
+    BOX,        // 2x2 average, fast
+    KAISER,     // Kaiser-windowed sinc over 6x6 texels, sharper and with less aliasing
+};
+
+/* How shaders see the channels of a texture. Gray sources are stored in red, with alpha in green when they have one,
+ * and are spread back to RGB when sampled. Data such as distance fields and two channel normal maps keeps its
+ * channels as stored */
+enum class texture_swizzle : uint32_t {
+    RGBA,           // channels as stored
+    GRAY,           // red to RGB, alpha 1
+    GRAY_ALPHA,     // red to RGB, green to alpha
+};
+
+/* Bytes of one row of pixels, or of one row of blocks */
+inline uint32_t texture_row_bytes(texture_format format, uint32_t width) {
+    if (texture_format_is_block_compressed(format)) width = (width + 3) / 4;
+    return width * texture_format_pixel_bytes(format);
+}
+
+/* Rows a level of the given height is stored in, block compressed formats store four pixel rows per row */
+inline uint32_t texture_row_count(texture_format format, uint32_t height) {
+    return texture_format_is_block_compressed(format) ? (height + 3) / 4 : height;
+}
+
+/* One mip level, rows are row_pitch bytes apart which may exceed the tightly packed row size */
+struct texture_level_t {
+    uint32_t width;
+    uint32_t height;
+    uint32_t row_pitch;
+    const uint8_t* data;
+};
+
+/* Non-owning view of a texture and its mip chain, level 0 is the full resolution */
+struct texture_view_t {
+    texture_format format;
+    uint32_t width;
+    uint32_t height;
+    std::vector<texture_level_t> levels;
+    texture_swizzle swizzle{texture_swizzle::RGBA};
+};
+
+/* Bytes the view's levels span in memory, padding between rows included */
+inline uint64_t texture_view_bytes(const texture_view_t& view) {
+    uint64_t bytes = 0;
+    for (const auto& level : view.levels) bytes += static_cast<uint64_t>(level.row_pitch) * texture_row_count(view.format, level.height);
+    return bytes;
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "mapped_file.h"
+#include "texture.h"
+
+/* Settings that change the derived texture, part of the cache key */
+struct texture_cache_settings_t {
+    texture_format format;
+    uint32_t mip_levels;    // 0 for the full chain
+    mip_filter filter;
+    bool srgb;              // color is sRGB encoded, mips are filtered in linear space
+    bc_quality quality;     // encoder effort when format is block compressed
+};
+
+/* Derived textures stored in their final GPU layout. A file holds a header, a level table and every level with rows
+ * padded to 256 bytes and levels starting on 512 bytes, the D3D12 placed footprint of an upload buffer, so a cached
+ * texture is memory-mapped and copied into the upload heap without decoding. Files are named after a hash of the
+ * source bytes and the settings, a changed source or setting simply misses. */
+class TextureCache {
+public:
+    static constexpr uint32_t pitch_alignment = 256;        // D3D12_TEXTURE_DATA_PITCH_ALIGNMENT
+    static constexpr uint32_t placement_alignment = 512;    // D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT
+private:
+    static constexpr uint32_t magic = 0x43585447;   // GTXC
+    static constexpr uint32_t version = 2;
+    struct header_t {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        uint32_t format;
+        uint32_t width;
+        uint32_t height;
+        uint32_t level_count;
+    };
+    struct level_header_t {
+        uint64_t offset;
+        uint32_t width;
+        uint32_t height;
+        uint32_t row_pitch;
+        uint32_t row_count;
+    };
+    std::filesystem::path dir_;
+    std::mutex mutex_;
+    std::map<uint64_t, MappedFile> mappings_;
+
+    static uint64_t align(uint64_t v, uint64_t a) {
+        return (v + a - 1) / a * a;
+    }
+public:
+    TextureCache(std::filesystem::path dir) : dir_(std::move(dir)) {}
+    TextureCache(TextureCache&) = delete;
+
+    /* 64-bit FNV-1a, chain calls through seed */
+    static uint64_t Hash(const void* data, size_t size, uint64_t seed = 0xcbf29ce484222325ull) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        uint64_t h = seed;
+        for (size_t i = 0; i < size; ++i) {
+            h ^= p[i];
+            h *= 0x100000001b3ull;
+        }
+        return h;
+    }
+
+    static uint64_t Key(const void* source, size_t size, const texture_cache_settings_t& settings) {
+        uint32_t fields[] = {version, static_cast<uint32_t>(settings.format), settings.mip_levels, static_cast<uint32_t>(settings.filter), settings.srgb, static_cast<uint32_t>(settings.quality)};
+        return Hash(fields, sizeof(fields), Hash(source, size));
+    }
+
+    std::filesystem::path GetPath(uint64_t key) const {
+        return dir_ / std::format("{:016x}.gtex", key);
+    }
+
+    /* Write view under key. The file is written next to its final name and renamed, so readers never see a partial
+     * file. Safe to call from several threads */
+    bool Store(uint64_t key, const texture_view_t& view) const {
+        std::error_code ec;
+        std::filesystem::create_directories(dir_, ec);
+        header_t header = {magic, version, key, static_cast<uint32_t>(view.format), view.width, view.height, static_cast<uint32_t>(view.levels.size())};
+        std::vector<level_header_t> levels(view.levels.size());
+        uint64_t offset = align(sizeof(header_t) + sizeof(level_header_t) * levels.size(), placement_alignment);
+        for (size_t i = 0; i < levels.size(); ++i) {
+            const auto& l = view.levels[i];
+            levels[i] = {offset, l.width, l.height, static_cast<uint32_t>(align(texture_row_bytes(view.format, l.width), pitch_alignment)), texture_row_count(view.format, l.height)};
+            offset = align(offset + static_cast<uint64_t>(levels[i].row_pitch) * levels[i].row_count, placement_alignment);
+        }
+        auto path = GetPath(key);
+        // Threads storing the same source each write their own file, the last rename wins
+        static std::atomic<uint32_t> writer{0};
+        auto tmp = path;
+        tmp += std::format(".{}.tmp", writer.fetch_add(1, std::memory_order_relaxed));
+        {
+            std::ofstream out(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+            if (!out) return false;
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(levels.data()), sizeof(level_header_t) * levels.size());
+            std::vector<char> row;
+            for (size_t i = 0; i < levels.size(); ++i) {
+                const auto& l = view.levels[i];
+                out.seekp(static_cast<std::streamoff>(levels[i].offset));
+                uint32_t row_bytes = texture_row_bytes(view.format, l.width);
+                row.assign(levels[i].row_pitch, 0);
+                for (uint32_t r = 0; r < levels[i].row_count; ++r) {
+                    memcpy(row.data(), l.data + static_cast<size_t>(r) * l.row_pitch, row_bytes);
+                    out.write(row.data(), static_cast<std::streamsize>(row.size()));
+                }
+            }
+            if (!out.good()) return false;
+        }
+        std::filesystem::rename(tmp, path, ec);
+        return !ec;
+    }
+
+    /* Map the texture stored under key. The view points into the mapping, which stays open as long as the cache */
+    std::optional<texture_view_t> Open(uint64_t key) {
+        std::lock_guard lock(mutex_);
+        auto it = mappings_.find(key);
+        if (it == mappings_.end()) {
+            MappedFile file;
+            if (!file.Open(GetPath(key))) return std::nullopt;
+            it = mappings_.emplace(key, std::move(file)).first;
+        }
+        const MappedFile& file = it->second;
+        header_t header;
+        bool valid = file.GetSize() >= sizeof(header_t);
+        if (valid) memcpy(&header, file.GetData(), sizeof(header));
+        valid = valid && header.magic == magic && header.version == version && header.key == key;
+        valid = valid && file.GetSize() >= sizeof(header_t) + sizeof(level_header_t) * header.level_count;
+        texture_view_t view = {};
+        for (uint32_t i = 0; valid && i < header.level_count; ++i) {
+            level_header_t l;
+            memcpy(&l, file.GetData() + sizeof(header_t) + sizeof(level_header_t) * i, sizeof(l));
+            valid = l.offset + static_cast<uint64_t>(l.row_pitch) * l.row_count <= file.GetSize();
+            view.levels.push_back({l.width, l.height, l.row_pitch, file.GetData() + l.offset});
+        }
+        if (!valid) {
+            mappings_.erase(it);
+            return std::nullopt;
+        }
+        view.format = static_cast<texture_format>(header.format);
+        view.width = header.width;
+        view.height = header.height;
+        return view;
+    }
+
+    /* Unmap the texture stored under key, every view Open returned for it becomes invalid */
+    void Close(uint64_t key) {
+        std::lock_guard lock(mutex_);
+        mappings_.erase(key);
+    }
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <optional>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "mip_generator.h"
+#include "texture.h"
+
+struct texture_pack_param_t {
+    uint32_t max_size;      // textures whose larger side is at most this are packed
+    uint32_t min_textures;  // a format and size class needs at least this many textures to become an array
+    uint32_t max_layers;    // layers per array, D3D12 allows 2048
+};
+
+/* Where a packed texture landed: sample layer of array at uv * uv_scale */
+struct texture_pack_entry_t {
+    uint32_t array;
+    uint32_t layer;
+    float uv_scale[2];
+};
+
+/* Square layers of one format and swizzle with the full mip chain, layers[i].levels point into storage */
+struct texture_array_t {
+    texture_format format;
+    texture_swizzle swizzle;
+    uint32_t size;
+    std::vector<texture_view_t> layers;
+    std::vector<uint8_t> storage;
+};
+
+struct texture_pack_t {
+    std::vector<texture_array_t> arrays;
+    std::vector<std::optional<texture_pack_entry_t>> entries;  // per source texture, empty when it stays on its own
+};
+
+/* Size class of a texture, the power of two square layer it is packed into. Block compressed layers are at least one
+ * block */
+inline uint32_t texture_size_class(const texture_view_t& view) {
+    uint32_t size = std::bit_ceil(std::max(view.width, view.height));
+    return texture_format_is_block_compressed(view.format) ? std::max(size, 4u) : size;
+}
+
+/* Pack small textures into texture arrays by format and size class. A texture smaller than its class sits in the
+ * top left corner of its layer on every level, the rest of the layer repeats its right column and bottom row, so
+ * sampling up to the edge behaves like clamp addressing; only textures that fill their layer keep wrap addressing.
+ * Layer levels past the texture's last one repeat that level. Textures without a full mip chain, or whose format
+ * and class have fewer than min_textures members, are left out */
+inline texture_pack_t pack_texture_arrays(const std::vector<texture_view_t>& textures, const texture_pack_param_t& param) {
+    texture_pack_t pack;
+    pack.entries.resize(textures.size());
+    std::map<std::tuple<texture_format, texture_swizzle, uint32_t>, std::vector<uint32_t>> groups;
+    for (uint32_t i = 0; i < textures.size(); ++i) {
+        const auto& t = textures[i];
+        if (t.levels.empty() || std::max(t.width, t.height) > param.max_size) continue;
+        if (t.levels.size() != mip_level_count(t.width, t.height)) continue;
+        groups[{t.format, t.swizzle, texture_size_class(t)}].push_back(i);
+    }
+
+    for (auto& [key, members] : groups) {
+        if (members.size() < std::max(param.min_textures, 1u)) continue;
+        const auto [format, swizzle, size] = key;
+        const uint32_t unit = texture_format_pixel_bytes(format);
+        const uint32_t level_count = mip_level_count(size, size);
+        size_t layer_bytes = 0;
+        for (uint32_t l = 0; l < level_count; ++l) {
+            uint32_t s = std::max(1u, size >> l);
+            layer_bytes += static_cast<size_t>(texture_row_bytes(format, s)) * texture_row_count(format, s);
+        }
+        for (size_t first = 0; first < members.size(); first += param.max_layers) {
+            const uint32_t layer_count = static_cast<uint32_t>(std::min<size_t>(param.max_layers, members.size() - first));
+            texture_array_t array = {format, swizzle, size, {}, std::vector<uint8_t>(layer_bytes * layer_count)};
+            const uint32_t array_index = static_cast<uint32_t>(pack.arrays.size());
+            for (uint32_t layer = 0; layer < layer_count; ++layer) {
+                const uint32_t source_index = members[first + layer];
+                const texture_view_t& source = textures[source_index];
+                texture_view_t view = {format, size, size, {}, swizzle};
+                uint8_t* out = array.storage.data() + layer_bytes * layer;
+                for (uint32_t l = 0; l < level_count; ++l) {
+                    const uint32_t s = std::max(1u, size >> l);
+                    const uint32_t row_bytes = texture_row_bytes(format, s);
+                    const uint32_t rows = texture_row_count(format, s);
+                    const texture_level_t& src = source.levels[std::min<size_t>(l, source.levels.size() - 1)];
+                    const uint32_t src_row_bytes = texture_row_bytes(format, src.width);
+                    const uint32_t src_rows = texture_row_count(format, src.height);
+                    for (uint32_t r = 0; r < rows; ++r) {
+                        uint8_t* dst = out + static_cast<size_t>(r) * row_bytes;
+                        memcpy(dst, src.data + static_cast<size_t>(std::min(r, src_rows - 1)) * src.row_pitch, src_row_bytes);
+                        for (uint32_t x = src_row_bytes; x < row_bytes; x += unit) memcpy(dst + x, dst + src_row_bytes - unit, unit);
+                    }
+                    view.levels.push_back({s, s, row_bytes, out});
+                    out += static_cast<size_t>(row_bytes) * rows;
+                }
+                array.layers.push_back(std::move(view));
+                pack.entries[source_index] = texture_pack_entry_t{array_index, layer, {static_cast<float>(source.width) / size, static_cast<float>(source.height) / size}};
+            }
+            pack.arrays.push_back(std::move(array));
+        }
+    }
+    return pack;
+}
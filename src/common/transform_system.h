@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <xmmintrin.h>
+#define TRANSFORM_SYSTEM_SSE 1
+#endif
+
+#include "geometry.h"
+
+/* Batched world matrix composition. Rotation (as a quaternion), translation and scale live in separate arrays, four
+ * objects are composed at once with one SIMD lane per object, and groups without a changed transform are skipped.
+ * The result equals scale * rotation * translation of DX12World::GetObjectMatrix, row-major as the shaders expect. */
+class TransformSystem {
+private:
+    // Component arrays, padded to a multiple of four so the last group can be loaded whole
+    std::vector<float> qx_, qy_, qz_, qw_;
+    std::vector<float> tx_, ty_, tz_;
+    std::vector<float> sx_, sy_, sz_;
+    std::vector<uint8_t> dirty_;
+    uint32_t count_{0};
+    uint32_t dirty_begin_{std::numeric_limits<uint32_t>::max()};
+    uint32_t dirty_end_{0};
+
+    void mark_dirty(uint32_t id) {
+        dirty_[id] = 1;
+        dirty_begin_ = std::min(dirty_begin_, id);
+        dirty_end_ = std::max(dirty_end_, id + 1);
+    }
+
+    void compose_scalar(uint32_t i, float* out) const {
+        float x = qx_[i], y = qy_[i], z = qz_[i], w = qw_[i];
+        float m[4][4] = {
+            {(1.0f - 2.0f * (y * y + z * z)) * sx_[i], 2.0f * (x * y + z * w) * sx_[i], 2.0f * (x * z - y * w) * sx_[i], 0.0f},
+            {2.0f * (x * y - z * w) * sy_[i], (1.0f - 2.0f * (x * x + z * z)) * sy_[i], 2.0f * (y * z + x * w) * sy_[i], 0.0f},
+            {2.0f * (x * z + y * w) * sz_[i], 2.0f * (y * z - x * w) * sz_[i], (1.0f - 2.0f * (x * x + y * y)) * sz_[i], 0.0f},
+            {tx_[i], ty_[i], tz_[i], 1.0f},
+        };
+        memcpy(out, m, sizeof(m));
+    }
+
+#ifdef TRANSFORM_SYSTEM_SSE
+    void compose_group(uint32_t g, uint8_t* out, size_t stride) const {
+        __m128 x = _mm_loadu_ps(&qx_[g]), y = _mm_loadu_ps(&qy_[g]), z = _mm_loadu_ps(&qz_[g]), w = _mm_loadu_ps(&qw_[g]);
+        __m128 two = _mm_set1_ps(2.0f), one = _mm_set1_ps(1.0f);
+        __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+        __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+        __m128 xw = _mm_mul_ps(x, w), yw = _mm_mul_ps(y, w), zw = _mm_mul_ps(z, w);
+        __m128 sx = _mm_loadu_ps(&sx_[g]), sy = _mm_loadu_ps(&sy_[g]), sz = _mm_loadu_ps(&sz_[g]);
+        // rows[r][c] holds element (r, c) of four matrices
+        __m128 rows[4][4] = {
+            {
+                _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx),
+                _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, zw)), sx),
+                _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, yw)), sx),
+                _mm_setzero_ps(),
+            },
+            {
+                _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, zw)), sy),
+                _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy),
+                _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, xw)), sy),
+                _mm_setzero_ps(),
+            },
+            {
+                _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, yw)), sz),
+                _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, xw)), sz),
+                _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz),
+                _mm_setzero_ps(),
+            },
+            {_mm_loadu_ps(&tx_[g]), _mm_loadu_ps(&ty_[g]), _mm_loadu_ps(&tz_[g]), one},
+        };
+        uint32_t lanes = std::min(4u, count_ - g);
+        for (int r = 0; r < 4; ++r) {
+            // Turn element-per-register into row-per-object
+            _MM_TRANSPOSE4_PS(rows[r][0], rows[r][1], rows[r][2], rows[r][3]);
+            for (uint32_t l = 0; l < lanes; ++l) {
+                if (dirty_[g + l]) _mm_storeu_ps(reinterpret_cast<float*>(out + static_cast<size_t>(g + l) * stride) + r * 4, rows[r][l]);
+            }
+        }
+    }
+#endif
+public:
+    /* Add an object with euler angles in radians (pitch, yaw, roll as in XMMatrixRotationRollPitchYaw) */
+    uint32_t Add(const float3_t& rotation, const float3_t& translation, const float3_t& scale) {
+        uint32_t id = count_++;
+        size_t padded = (static_cast<size_t>(count_) + 3) & ~static_cast<size_t>(3);
+        for (auto* v : {&qx_, &qy_, &qz_, &tx_, &ty_, &tz_}) v->resize(padded, 0.0f);
+        for (auto* v : {&qw_, &sx_, &sy_, &sz_}) v->resize(padded, 1.0f);
+        dirty_.resize(padded, 0);
+        SetRotation(id, rotation);
+        SetTranslation(id, translation);
+        SetScale(id, scale);
+        return id;
+    }
+
+    void SetRotation(uint32_t id, const float3_t& rotation) {
+        float sp = std::sin(rotation.x * 0.5f), cp = std::cos(rotation.x * 0.5f);
+        float sy = std::sin(rotation.y * 0.5f), cy = std::cos(rotation.y * 0.5f);
+        float sr = std::sin(rotation.z * 0.5f), cr = std::cos(rotation.z * 0.5f);
+        SetRotationQuaternion(id,
+            sp * cy * cr + cp * sy * sr,
+            cp * sy * cr - sp * cy * sr,
+            cp * cy * sr - sp * sy * cr,
+            cp * cy * cr + sp * sy * sr);
+    }
+
+    void SetRotationQuaternion(uint32_t id, float x, float y, float z, float w) {
+        qx_[id] = x; qy_[id] = y; qz_[id] = z; qw_[id] = w;
+        mark_dirty(id);
+    }
+
+    void SetTranslation(uint32_t id, const float3_t& translation) {
+        tx_[id] = translation.x; ty_[id] = translation.y; tz_[id] = translation.z;
+        mark_dirty(id);
+    }
+
+    void SetScale(uint32_t id, const float3_t& scale) {
+        sx_[id] = scale.x; sy_[id] = scale.y; sz_[id] = scale.z;
+        mark_dirty(id);
+    }
+
+    float3_t GetTranslation(uint32_t id) const {
+        return {tx_[id], ty_[id], tz_[id]};
+    }
+
+    /* Write the 4x4 world matrix of every changed object i to out + i * stride bytes, so it can target an instance
+     * array directly. Returns the number of groups composed; the dirty range is reset afterwards */
+    uint32_t Compose(void* out, size_t stride) {
+        uint32_t groups = 0;
+        if (dirty_begin_ >= dirty_end_) return groups;
+        uint8_t* dst = static_cast<uint8_t*>(out);
+        for (uint32_t g = dirty_begin_ & ~3u; g < dirty_end_; g += 4) {
+            uint32_t mask;
+            memcpy(&mask, &dirty_[g], sizeof(mask));
+            if (!mask) continue;
+#ifdef TRANSFORM_SYSTEM_SSE
+            compose_group(g, dst, stride);
+#else
+            for (uint32_t i = g; i < std::min(g + 4, count_); ++i) {
+                if (dirty_[i]) compose_scalar(i, reinterpret_cast<float*>(dst + static_cast<size_t>(i) * stride));
+            }
+#endif
+            memset(&dirty_[g], 0, 4);
+            ++groups;
+        }
+        dirty_begin_ = std::numeric_limits<uint32_t>::max();
+        dirty_end_ = 0;
+        return groups;
+    }
+
+    /* Range of objects changed since the last Compose, empty when begin >= end */
+    uint32_t GetDirtyBegin() const {
+        return dirty_begin_;
+    }
+
+    uint32_t GetDirtyEnd() const {
+        return dirty_end_;
+    }
+
+    uint32_t GetCount() const {
+        return count_;
+    }
+};
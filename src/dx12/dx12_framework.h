@@ -8,10 +8,16 @@
 #include <d3dcompiler.h>
 #include <directx/d3dx12.h>
 #include <DirectXMath.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <mutex>
+#include <optional>
+#include <span>
 #include <limits>
 #include <stb_image.h>
 #include <unordered_map>
@@ -20,9 +26,20 @@
 
 #include "../win32/common.h"
 #include "../win32/window.h"
+#include "../common/block_compress.h"
+#include "../common/flight_recorder.h"
+#include "../common/job_pool.h"
+#include "../common/memory_stats.h"
+#include "../common/mip_generator.h"
+#include "../common/simd_math.h"
+#include "../common/texture_cache.h"
+#include "../common/transform_system.h"
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
 
+// Swapchain buffers, and so frames the CPU may record ahead of the GPU
+constexpr uint32_t frame_count = 2;
+
 class GPUFence {
 private:
     ComPtr<ID3D12Device> device_;
@@ -46,6 +63,7 @@ public:
     void Wait() {
         if (fence_->GetCompletedValue() < fence_value_)
         {
+            TraceScope trace(trace_event_type::FENCE_WAIT, "fence wait", fence_value_);
             fence_->SetEventOnCompletion(fence_value_, fence_event_);
             WaitForSingleObject(fence_event_, INFINITE);
         }
@@ -55,6 +73,11 @@ public:
         return fence_value_;
     }
 
+    /* Last value the GPU has signaled, polling it never blocks */
+    uint64_t GetCompletedValue() {
+        return fence_->GetCompletedValue();
+    }
+
     ~GPUFence() {
         CloseHandle(fence_event_);
         fence_.Reset();
@@ -62,6 +85,32 @@ public:
 
 };
 
+inline DXGI_FORMAT to_dxgi_format(texture_format format) {
+    switch (format) {
+        case texture_format::R8_UNORM: return DXGI_FORMAT_R8_UNORM;
+        case texture_format::RG8_UNORM: return DXGI_FORMAT_R8G8_UNORM;
+        case texture_format::R16_FLOAT: return DXGI_FORMAT_R16_FLOAT;
+        case texture_format::RGBA16_FLOAT: return DXGI_FORMAT_R16G16B16A16_FLOAT;
+        case texture_format::BC1_UNORM: return DXGI_FORMAT_BC1_UNORM;
+        case texture_format::BC4_UNORM: return DXGI_FORMAT_BC4_UNORM;
+        case texture_format::BC5_UNORM: return DXGI_FORMAT_BC5_UNORM;
+        case texture_format::BC7_UNORM: return DXGI_FORMAT_BC7_UNORM;
+        default: return DXGI_FORMAT_R8G8B8A8_UNORM;
+    }
+}
+
+inline UINT to_component_mapping(texture_swizzle swizzle) {
+    switch (swizzle) {
+        case texture_swizzle::GRAY: return D3D12_ENCODE_SHADER_4_COMPONENT_MAPPING(
+            D3D12_SHADER_COMPONENT_MAPPING_FROM_MEMORY_COMPONENT_0, D3D12_SHADER_COMPONENT_MAPPING_FROM_MEMORY_COMPONENT_0,
+            D3D12_SHADER_COMPONENT_MAPPING_FROM_MEMORY_COMPONENT_0, D3D12_SHADER_COMPONENT_MAPPING_FORCE_VALUE_1);
+        case texture_swizzle::GRAY_ALPHA: return D3D12_ENCODE_SHADER_4_COMPONENT_MAPPING(
+            D3D12_SHADER_COMPONENT_MAPPING_FROM_MEMORY_COMPONENT_0, D3D12_SHADER_COMPONENT_MAPPING_FROM_MEMORY_COMPONENT_0,
+            D3D12_SHADER_COMPONENT_MAPPING_FROM_MEMORY_COMPONENT_0, D3D12_SHADER_COMPONENT_MAPPING_FROM_MEMORY_COMPONENT_1);
+        default: return D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    }
+}
+
 class GPUResourceManager {
 public:
     enum class gpu_resource_type {
@@ -69,6 +118,7 @@ public:
         VERTEX_BUFFER,
         INDEX_BUFFER,
         CONST_BUFFER,
+        STRUCTURED_BUFFER,
     };
 
     using gpu_resource_t = struct {
@@ -97,7 +147,15 @@ private:
     ComPtr<ID3D12CommandAllocator> render_alloc_;
     GPUFence io_fence_;
     std::vector<gpu_resource_t> temporary_resourcs_;
+    std::vector<std::pair<uint64_t, std::function<void()>>> pending_releases_;
     std::unordered_map<std::string, gpu_resource_t> resources_map_;
+    uint32_t frame_{0};
+    uint64_t frame_serial_{0};
+    bool recording_{false};
+
+    uint64_t AllocationSize(const D3D12_RESOURCE_DESC& desc) {
+        return device_->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+    }
 public:
     GPUResourceManager() {}
 
@@ -131,15 +189,47 @@ public:
         return resource;
     }
 
-    gpu_resource_handle_t CreateTexture(const std::string& res_id, uint32_t width, uint32_t height, uint8_t* tex_data) {
+    gpu_resource_handle_t CreateTexture(const std::string& res_id, uint32_t width, uint32_t height, const uint8_t* tex_data) {
+        texture_view_t view = {texture_format::RGBA8_UNORM, width, height, {{width, height, width * 4, tex_data}}};
+        return CreateTexture(res_id, view);
+    }
+
+    /* Copy count levels of view from first_level on into a mapped upload buffer laid out by footprints. A level is one
+     * memcpy when its row pitch already matches the placed footprint, which is the case for views from the
+     * TextureCache. Touches no device state, safe on any thread */
+    static void WriteTextureLevels(uint8_t* mapping, const texture_view_t& view, uint32_t first_level, uint32_t count, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT* footprints, const UINT* row_counts, const UINT64* row_bytes) {
+        for (uint32_t i = 0; i < count; ++i) {
+            const auto& level = view.levels[first_level + i];
+            const auto& fp = footprints[i];
+            uint8_t* dst = mapping + fp.Offset;
+            if (fp.Footprint.RowPitch == level.row_pitch) {
+                memcpy(dst, level.data, static_cast<size_t>(level.row_pitch) * (row_counts[i] - 1) + row_bytes[i]);
+            } else {
+                for (UINT r = 0; r < row_counts[i]; ++r) {
+                    memcpy(dst + static_cast<size_t>(r) * fp.Footprint.RowPitch, level.data + static_cast<size_t>(r) * level.row_pitch, row_bytes[i]);
+                }
+            }
+        }
+    }
+
+    /* Create a texture with every level of view, see WriteTextureLevels for how levels reach the upload heap */
+    gpu_resource_handle_t CreateTexture(const std::string& res_id, const texture_view_t& view) {
+        return CreateTextureArray(res_id, std::span<const texture_view_t>(&view, 1));
+    }
+
+    /* Create a texture array with one layer per view, layers must share format, size and level count */
+    gpu_resource_handle_t CreateTextureArray(const std::string& res_id, std::span<const texture_view_t> layers) {
         ComPtr<ID3D12Resource> tex_buffer;
+        const texture_view_t& view = layers[0];
+        const uint32_t level_count = static_cast<uint32_t>(view.levels.size());
+        const uint32_t subresource_count = level_count * static_cast<uint32_t>(layers.size());
         D3D12_RESOURCE_DESC tex_desc {};
-        tex_desc.MipLevels = 1;
-        tex_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-        tex_desc.Width = width;
-        tex_desc.Height = height;
+        tex_desc.MipLevels = static_cast<UINT16>(level_count);
+        tex_desc.Format = to_dxgi_format(view.format);
+        tex_desc.Width = view.width;
+        tex_desc.Height = view.height;
         tex_desc.Flags = D3D12_RESOURCE_FLAG_NONE;
-        tex_desc.DepthOrArraySize = 1;
+        tex_desc.DepthOrArraySize = static_cast<UINT16>(layers.size());
         tex_desc.SampleDesc.Count = 1;
         tex_desc.SampleDesc.Quality = 0;
         tex_desc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
@@ -153,20 +243,36 @@ public:
             IID_PPV_ARGS(&tex_buffer)));
         auto wres_id = string_to_wstring(res_id);
         tex_buffer->SetName(wres_id.value().c_str());
-        const UINT64 buffer_size = GetRequiredIntermediateSize(tex_buffer.Get(), 0, 1);
+        std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> footprints(subresource_count);
+        std::vector<UINT> row_counts(subresource_count);
+        std::vector<UINT64> row_bytes(subresource_count);
+        UINT64 buffer_size = 0;
+        device_->GetCopyableFootprints(&tex_desc, 0, subresource_count, 0, footprints.data(), row_counts.data(), row_bytes.data(), &buffer_size);
+        TraceScope trace(trace_event_type::UPLOAD, "texture upload", buffer_size);
         ComPtr<ID3D12Resource> tex_upload = CreateUploadHeap(buffer_size);
+        uint8_t* mapping;
+        CD3DX12_RANGE range(0, 0);
+        CHECKHR(tex_upload->Map(0, &range, reinterpret_cast<void**>(&mapping)));
+        // Subresources are ordered level first within each layer
+        for (size_t layer = 0; layer < layers.size(); ++layer) {
+            size_t first = layer * level_count;
+            WriteTextureLevels(mapping, layers[layer], 0, level_count, &footprints[first], &row_counts[first], &row_bytes[first]);
+        }
+        tex_upload->Unmap(0, nullptr);
         io_fence_.Wait();
         CHECKHR(copy_alloc_->Reset());
         CHECKHR(copy_list_->Reset(copy_alloc_.Get(), nullptr));
-        D3D12_SUBRESOURCE_DATA tex_upload_desc = {};
-        tex_upload_desc.pData = tex_data;
-        tex_upload_desc.RowPitch = width * 4;
-        tex_upload_desc.SlicePitch = tex_upload_desc.RowPitch * height;
-        UpdateSubresources(copy_list_.Get(), tex_buffer.Get(), tex_upload.Get(), 0, 0, 1, &tex_upload_desc);
+        for (uint32_t i = 0; i < subresource_count; ++i) {
+            CD3DX12_TEXTURE_COPY_LOCATION dst(tex_buffer.Get(), i);
+            CD3DX12_TEXTURE_COPY_LOCATION src(tex_upload.Get(), footprints[i]);
+            copy_list_->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+        }
         CHECKHR(copy_list_->Close());
         ID3D12CommandList* lists[] = { copy_list_.Get() };
         copy_queue_->ExecuteCommandLists(1, lists);
         io_fence_.Insert(copy_queue_);
+        g_memory_stats().AddGPU(memory_category::TEXTURE, AllocationSize(tex_desc));
+        g_memory_stats().AddGPU(memory_category::UPLOAD, buffer_size);
         DXGI_FORMAT* fmt = new DXGI_FORMAT(tex_desc.Format);
         gpu_resource_t tex_res = {
             .res = tex_buffer,
@@ -198,6 +304,7 @@ public:
     gpu_resource_handle_t CreateVertexBuffer(const std::string& res_id, const V* vertices, const uint32_t elem_size) {
         ComPtr<ID3D12Resource> vertex_buffer;
         uint32_t size_in_bytes = elem_size * sizeof(V);
+        TraceScope trace(trace_event_type::UPLOAD, "vertex buffer upload", size_in_bytes);
         auto vertex_heap_prop= CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
         auto vertex_heap_desc = CD3DX12_RESOURCE_DESC::Buffer(size_in_bytes);
         CHECKHR(device_->CreateCommittedResource(
@@ -223,6 +330,8 @@ public:
         ID3D12CommandList* lists[] = { copy_list_.Get() };
         copy_queue_->ExecuteCommandLists(1, lists);
         io_fence_.Insert(copy_queue_);
+        g_memory_stats().AddGPU(memory_category::GEOMETRY, AllocationSize(vertex_heap_desc));
+        g_memory_stats().AddGPU(memory_category::UPLOAD, size_in_bytes);
         uint32_t* stride = new uint32_t(sizeof(V));
         gpu_resource_t vertex_res = {
             .res = vertex_buffer,
@@ -252,6 +361,7 @@ public:
 
     gpu_resource_handle_t CreateIndexBuffer(const std::string& res_id, const uint32_t* indices, const uint32_t elem_size) {
         uint32_t size_in_bytes = elem_size * sizeof(uint32_t);
+        TraceScope trace(trace_event_type::UPLOAD, "index buffer upload", size_in_bytes);
         ComPtr<ID3D12Resource> index_buffer;
         auto index_heap_prop = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
         auto index_heap_desc = CD3DX12_RESOURCE_DESC::Buffer(size_in_bytes);
@@ -279,6 +389,8 @@ public:
         ID3D12CommandList* lists[] = { copy_list_.Get() };
         copy_queue_->ExecuteCommandLists(1, lists);
         io_fence_.Insert(copy_queue_);
+        g_memory_stats().AddGPU(memory_category::GEOMETRY, AllocationSize(index_heap_desc));
+        g_memory_stats().AddGPU(memory_category::UPLOAD, size_in_bytes);
         gpu_resource_t index_res = {
             .res = index_buffer,
             .state = D3D12_RESOURCE_STATE_COMMON,
@@ -308,6 +420,7 @@ public:
     template<typename C>
     gpu_resource_handle_t CreateCBuffer(const std::string& res_id, const C& data) {
         ComPtr<ID3D12Resource> cbuffer = CreateUploadHeap(sizeof(C));
+        g_memory_stats().AddGPU(memory_category::CONSTANT, sizeof(C));
         uint32_t* stride = new uint32_t(sizeof(C));
         auto wres_id = string_to_wstring(res_id);
         cbuffer->SetName(wres_id.value().c_str());
@@ -345,6 +458,7 @@ public:
     template<typename C>
     gpu_resource_handle_t CreateCBuffer(const std::string& res_id, const C* data_array, const uint32_t count) {
         auto buffer = CreateUploadHeap(sizeof(C) * count);
+        g_memory_stats().AddGPU(memory_category::CONSTANT, sizeof(C) * count);
         uint32_t* stride = new uint32_t(sizeof(C));
         gpu_resource_t cbuffer_res = {
             .res = buffer,
@@ -377,17 +491,84 @@ public:
         return true;
     }
 
+    /* Create a structured buffer on the upload heap. It stays mapped for its whole lifetime, the mapping is returned
+     * through mapping so callers can stream data into it every frame without Map/Unmap */
+    gpu_resource_handle_t CreateStructuredBuffer(const std::string& res_id, const uint32_t stride, const uint32_t count, uint8_t** mapping) {
+        ComPtr<ID3D12Resource> buffer = CreateUploadHeap(static_cast<size_t>(stride) * count);
+        g_memory_stats().AddGPU(memory_category::CONSTANT, static_cast<int64_t>(stride) * count);
+        auto wres_id = string_to_wstring(res_id);
+        buffer->SetName(wres_id.value().c_str());
+        CD3DX12_RANGE range(0, 0);
+        CHECKHR(buffer->Map(0, &range, reinterpret_cast<void**>(mapping)));
+        gpu_resource_t buffer_res = {
+            .res = buffer,
+            .state = D3D12_RESOURCE_STATE_GENERIC_READ,
+            .type = D3D12_HEAP_TYPE_UPLOAD,
+            .fence_value = std::numeric_limits<uint64_t>::max(),
+            .size = static_cast<uint64_t>(stride) * count,
+            .ext_info = new uint32_t(stride),
+        };
+        resources_map_[res_id] = buffer_res;
+        gpu_resource_handle_t handle {
+            .typ = gpu_resource_type::STRUCTURED_BUFFER,
+            .id = res_id,
+            .ptr = &resources_map_[res_id],
+        };
+        return handle;
+    }
+
+    /* Called by RenderContext once the GPU is done with the previous use of frame's resources, before recording */
+    void BeginFrame(uint32_t frame) {
+        frame_ = frame;
+        ++frame_serial_;
+        recording_ = true;
+    }
+
+    void EndFrame() {
+        recording_ = false;
+    }
+
+    /* Frame being recorded, or the last one recorded between frames */
+    uint32_t GetFrame() const {
+        return frame_;
+    }
+
+    /* Counts BeginFrame calls */
+    uint64_t GetFrameSerial() const {
+        return frame_serial_;
+    }
+
+    bool IsRecording() const {
+        return recording_;
+    }
+
+    /* Run release once every upload issued so far has landed on the GPU, typically to free the CPU copy of data just
+     * passed to a Create* call. Releases still pending when the manager is destroyed are dropped, not run */
+    void ReleaseAfterUpload(std::function<void()> release) {
+        pending_releases_.emplace_back(io_fence_.GetValue(), std::move(release));
+    }
+
+    /* Free upload buffers and run releases whose copies have completed, polls the fence without waiting */
     void DeferredRelease() {
-        uint64_t completedValue = io_fence_.GetValue();
+        uint64_t completedValue = io_fence_.GetCompletedValue();
         for (auto it = temporary_resourcs_.begin(); it != temporary_resourcs_.end();) {
             if (it->fence_value <= completedValue) {
-                std::cout << "deferred released an upload buffer" << std::endl;
+                LOG_DEBUG_RATE(log_category::GPU, 4, "deferred released an upload buffer");
+                g_memory_stats().AddGPU(memory_category::UPLOAD, -static_cast<int64_t>(it->size));
                 it->res.Reset();
                 it = temporary_resourcs_.erase(it);
             } else {
                 ++it;
             }
         }
+        for (auto it = pending_releases_.begin(); it != pending_releases_.end();) {
+            if (it->first <= completedValue) {
+                it->second();
+                it = pending_releases_.erase(it);
+            } else {
+                ++it;
+            }
+        }
     }
 
     ~GPUResourceManager() {
@@ -395,44 +576,291 @@ public:
     }
 };
 
-class ITextureHeap {};
+/* Per-instance data read by vertex shaders as StructuredBuffer<InstanceData>, keep in sync with shaders/triangle.vs */
+struct InstanceData {
+    float world_matrix[4][4];
+    uint32_t material_index;
+    uint32_t flags;
+    float padding[2];
+};
+
+/* Persistently mapped structured buffer with one copy per frame in flight, fed from a CPU shadow kept by the owner.
+ * Writes mark their range dirty in every copy, and a copy catches up on its ranges when it is flushed or bound while
+ * its frame is being recorded, after the GPU is done with its previous use. Transient buffers are fully rewritten
+ * every frame during recording, so only the copy of that frame is marked */
+class DX12FrameRingBuffer {
+private:
+    GPUResourceManager& mgr_;
+    GPUResourceManager::gpu_resource_handle_t handle_;
+    uint8_t* mapping_{};
+    uint32_t stride_;
+    uint32_t capacity_;
+    bool transient_;
+    const char* trace_name_;
+    uint32_t frame_{0};
+    uint64_t serial_{0};
+    uint32_t dirty_begin_[frame_count];
+    uint32_t dirty_end_[frame_count]{};
+
+    // Follow the frame being recorded, between frames the copy of the last recorded frame stays current
+    void track_frame() {
+        if (!mgr_.IsRecording() || serial_ == mgr_.GetFrameSerial()) return;
+        serial_ = mgr_.GetFrameSerial();
+        frame_ = mgr_.GetFrame();
+    }
+public:
+    DX12FrameRingBuffer(GPUResourceManager& mgr, const std::string& res_id, uint32_t stride, uint32_t capacity, bool transient, const char* trace_name) : mgr_(mgr), stride_(stride), capacity_(capacity), transient_(transient), trace_name_(trace_name) {
+        handle_ = mgr.CreateStructuredBuffer(res_id, stride, capacity * frame_count, &mapping_);
+        std::fill(std::begin(dirty_begin_), std::end(dirty_begin_), std::numeric_limits<uint32_t>::max());
+    }
+    DX12FrameRingBuffer(DX12FrameRingBuffer&) = delete;
+
+    void MarkDirty(uint32_t begin, uint32_t end) {
+        track_frame();
+        for (uint32_t f = 0; f < frame_count; ++f) {
+            if (transient_ && f != frame_) continue;
+            dirty_begin_[f] = std::min(dirty_begin_[f], begin);
+            dirty_end_[f] = std::max(dirty_end_[f], end);
+        }
+    }
+
+    /* Copy the dirty range of the frame being recorded from shadow. Between frames this does nothing, the writes stay
+     * pending until the next frame uses the buffer */
+    void Flush(const void* shadow) {
+        if (!mgr_.IsRecording()) return;
+        track_frame();
+        uint32_t begin = dirty_begin_[frame_], end = dirty_end_[frame_];
+        if (begin >= end) return;
+        size_t offset = static_cast<size_t>(begin) * stride_;
+        size_t bytes = static_cast<size_t>(end - begin) * stride_;
+        TraceScope trace(trace_event_type::UPLOAD, trace_name_, bytes);
+        memcpy(mapping_ + static_cast<size_t>(frame_) * capacity_ * stride_ + offset, static_cast<const uint8_t*>(shadow) + offset, bytes);
+        dirty_begin_[frame_] = std::numeric_limits<uint32_t>::max();
+        dirty_end_[frame_] = 0;
+    }
+
+    /* Address of element first in the copy of the frame being recorded, flushing it first */
+    D3D12_GPU_VIRTUAL_ADDRESS GetGPUAddress(uint32_t first, const void* shadow) {
+        Flush(shadow);
+        return handle_.ptr->res->GetGPUVirtualAddress() + (static_cast<uint64_t>(frame_) * capacity_ + first) * stride_;
+    }
+
+    GPUResourceManager::gpu_resource_handle_t& GetHandle() {
+        return handle_;
+    }
+};
+
+/* CPU-packed instance stream backed by a DX12FrameRingBuffer. Writes are collected into a dirty range that reaches a
+ * frame's copy when it is flushed or bound, so only instances touched since that copy was last used cross the bus */
+class DX12InstanceBuffer {
+private:
+    std::vector<InstanceData> instances_;
+    DX12FrameRingBuffer ring_;
+    InstanceData discard_{};    // target of writes out of range, which are logged and dropped
+    uint32_t used_{0};
 
+    bool check_range(uint32_t first, uint32_t count, const char* what) {
+        if (static_cast<uint64_t>(first) + count <= instances_.size()) return true;
+        LOG_ERROR_CAT(log_category::GPU, "Failed to {} {} instances at {} in {} because out of range", what, count, first, ring_.GetHandle().id);
+        return false;
+    }
+public:
+    /* transient buffers are rewritten every frame while recording, like the batch buffer of a Pipeline */
+    DX12InstanceBuffer(GPUResourceManager& mgr, const std::string& res_id, uint32_t capacity, bool transient = false) : instances_(capacity), ring_(mgr, res_id, sizeof(InstanceData), capacity, transient, "instance flush") {}
+    DX12InstanceBuffer(DX12InstanceBuffer&) = delete;
+
+    /* Reserve count consecutive instances, returns the first index or UINT32_MAX when the buffer is full */
+    uint32_t Allocate(uint32_t count) {
+        if (used_ + count > instances_.size()) {
+            LOG_ERROR_CAT(log_category::GPU, "Failed to allocate {} instances in {} because out of range", count, ring_.GetHandle().id);
+            return std::numeric_limits<uint32_t>::max();
+        }
+        uint32_t first = used_;
+        used_ += count;
+        return first;
+    }
+
+    void Reset() {
+        used_ = 0;
+    }
+
+    const InstanceData& Get(uint32_t index) const {
+        return index < instances_.size() ? instances_[index] : discard_;
+    }
+
+    /* Writable access to an instance, marks it dirty */
+    InstanceData& Edit(uint32_t index) {
+        if (!check_range(index, 1, "edit")) return discard_;
+        ring_.MarkDirty(index, index + 1);
+        return instances_[index];
+    }
+
+    void Set(uint32_t index, const InstanceData& data) {
+        Edit(index) = data;
+    }
+
+    void Set(uint32_t first, const InstanceData* data, uint32_t count) {
+        if (!check_range(first, count, "set")) return;
+        memcpy(&instances_[first], data, sizeof(InstanceData) * count);
+        ring_.MarkDirty(first, first + count);
+    }
+
+    void SetWorldMatrix(uint32_t index, const mat_t& m) {
+        mat_store(Edit(index).world_matrix, m);
+    }
+
+    void SetMaterial(uint32_t index, uint32_t material_index) {
+        Edit(index).material_index = material_index;
+    }
+
+    /* Compose the changed world matrices of transforms into instances first + id */
+    void ComposeTransforms(TransformSystem& transforms, uint32_t first) {
+        uint32_t begin = transforms.GetDirtyBegin();
+        uint32_t end = transforms.GetDirtyEnd();
+        if (begin >= end) return;
+        if (!check_range(first, transforms.GetCount(), "compose")) return;
+        transforms.Compose(&instances_[first].world_matrix, sizeof(InstanceData));
+        ring_.MarkDirty(first + begin, first + end);
+    }
+
+    /* Copy the dirty range into the copy of the frame being recorded, see DX12FrameRingBuffer::Flush */
+    void Flush() {
+        ring_.Flush(instances_.data());
+    }
+
+    D3D12_GPU_VIRTUAL_ADDRESS GetGPUAddress(uint32_t first) {
+        return ring_.GetGPUAddress(first, instances_.data());
+    }
+
+    GPUResourceManager::gpu_resource_handle_t& GetHandle() {
+        return ring_.GetHandle();
+    }
+
+    uint32_t GetCapacity() const {
+        return static_cast<uint32_t>(instances_.size());
+    }
+
+    uint32_t GetUsed() const {
+        return used_;
+    }
+};
+
+/* Per-material data read by pixel shaders as StructuredBuffer<MaterialData>, keep in sync with shaders/triangle.ps */
+struct MaterialData {
+    uint32_t texture;       // slot in the texture heap
+    uint32_t layer;         // array layer, 0 for a texture of its own
+    float uv_scale[2];      // part of the layer the texture covers, see pack_texture_arrays
+};
+
+/* Material table indexed by InstanceData::material_index, backed by a DX12FrameRingBuffer so materials can change
+ * while earlier frames are in flight. Bind it with DrawCallMaterialBinding */
+class DX12MaterialBuffer {
+private:
+    std::vector<MaterialData> materials_;
+    DX12FrameRingBuffer ring_;
+public:
+    DX12MaterialBuffer(GPUResourceManager& mgr, const std::string& res_id, uint32_t capacity) : materials_(capacity), ring_(mgr, res_id, sizeof(MaterialData), capacity, false, "material flush") {}
+    DX12MaterialBuffer(DX12MaterialBuffer&) = delete;
+
+    void Set(uint32_t index, const MaterialData& material) {
+        if (index >= materials_.size()) {
+            LOG_ERROR_CAT(log_category::GPU, "Failed to set material {} in {} because out of range", index, ring_.GetHandle().id);
+            return;
+        }
+        materials_[index] = material;
+        ring_.MarkDirty(index, index + 1);
+    }
+
+    D3D12_GPU_VIRTUAL_ADDRESS GetGPUAddress() {
+        return ring_.GetGPUAddress(0, materials_.data());
+    }
+
+    GPUResourceManager::gpu_resource_handle_t& GetHandle() {
+        return ring_.GetHandle();
+    }
+};
+
+class ITextureHeap {
+public:
+    virtual ~ITextureHeap() = default;
+    /* Reserve a slot holding a null SRV until UpdateTexture fills it, sampling it reads zero */
+    virtual std::optional<uint32_t> Reserve() = 0;
+    virtual void UpdateTexture(uint32_t slot, ID3D12Resource* resource, texture_swizzle swizzle = texture_swizzle::RGBA) = 0;
+    /* Called by RenderContext once the GPU is done with the previous use of frame's heap */
+    virtual void BeginFrame(uint32_t frame) = 0;
+};
+
+/* SRV table shared by drawcalls. Descriptors are written to a CPU-only heap and copied into a shader visible heap per
+ * frame in flight when that frame begins, so a slot can be rewritten at any time: frames already recorded keep
+ * reading the old descriptor, the next one recorded sees the new one. */
 template<uint32_t DescriptorCount>
 class TextureHeap : public ITextureHeap {
 private:
     ComPtr<ID3D12Device> device_;
-    ComPtr<ID3D12DescriptorHeap> heap_;
+    ComPtr<ID3D12DescriptorHeap> staging_;
+    ComPtr<ID3D12DescriptorHeap> heaps_[frame_count];
+    uint64_t version_{0};
+    uint64_t frame_versions_[frame_count]{};
+    uint32_t frame_{0};
     uint32_t descriptor_size_;
     uint32_t off_{};
+
+    D3D12_CPU_DESCRIPTOR_HANDLE staging_handle(uint32_t slot) {
+        D3D12_CPU_DESCRIPTOR_HANDLE handle = staging_->GetCPUDescriptorHandleForHeapStart();
+        handle.ptr += static_cast<size_t>(slot) * descriptor_size_;
+        return handle;
+    }
 public:
     TextureHeap(ComPtr<ID3D12Device>& device) : device_(device) {
         D3D12_DESCRIPTOR_HEAP_DESC heap_desc = {};
         heap_desc.NumDescriptors = DescriptorCount;
         heap_desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+        heap_desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+        CHECKHR(device_->CreateDescriptorHeap(&heap_desc, IID_PPV_ARGS(&staging_)));
         heap_desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-        CHECKHR(device_->CreateDescriptorHeap(&heap_desc, IID_PPV_ARGS(&heap_)));
+        for (auto& heap : heaps_) CHECKHR(device_->CreateDescriptorHeap(&heap_desc, IID_PPV_ARGS(&heap)));
         descriptor_size_ = device_->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
     }
     /* Bind a descriptor for texture to the descriptor heap */
-    bool BindTexture(const GPUResourceManager::gpu_resource_handle_t& hres) {
+    bool BindTexture(const GPUResourceManager::gpu_resource_handle_t& hres, texture_swizzle swizzle = texture_swizzle::RGBA) {
+        auto slot = Reserve();
+        if (!slot.has_value()) return false;
+        UpdateTexture(slot.value(), hres.ptr->res.Get(), swizzle);
+        return true;
+    }
+
+    std::optional<uint32_t> Reserve() override {
         if (off_ == DescriptorCount) {
-            LOG_ERROR("Failed to bind Texture as SRV in the descriptor heap because out of range");
-            return false;
+            LOG_ERROR_CAT(log_category::GPU, "Failed to bind Texture as SRV in the descriptor heap because out of range");
+            return std::nullopt;
         }
+        UpdateTexture(off_, nullptr);
+        return off_++;
+    }
+
+    /* Point slot at every mip and layer of resource, or at nothing. Views are always Texture2DArray, a plain texture
+     * is an array of one layer, so shaders index a single table for both. swizzle spreads gray sources back to RGB */
+    void UpdateTexture(uint32_t slot, ID3D12Resource* resource, texture_swizzle swizzle = texture_swizzle::RGBA) override {
         D3D12_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
-        srv_desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-        srv_desc.Format = *static_cast<DXGI_FORMAT*>(hres.ptr->ext_info);
-        srv_desc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-        srv_desc.Texture2D.MipLevels = 1;
-        D3D12_CPU_DESCRIPTOR_HANDLE handle = heap_->GetCPUDescriptorHandleForHeapStart();
-        handle.ptr += off_ * descriptor_size_;
-        device_->CreateShaderResourceView(hres.ptr->res.Get(), &srv_desc, handle);
-        ++off_;
-        return true;
+        srv_desc.Shader4ComponentMapping = to_component_mapping(swizzle);
+        srv_desc.Format = resource ? resource->GetDesc().Format : DXGI_FORMAT_R8G8B8A8_UNORM;
+        srv_desc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+        srv_desc.Texture2DArray.MipLevels = resource ? resource->GetDesc().MipLevels : 1;
+        srv_desc.Texture2DArray.ArraySize = resource ? resource->GetDesc().DepthOrArraySize : 1;
+        device_->CreateShaderResourceView(resource, &srv_desc, staging_handle(slot));
+        ++version_;
     }
 
+    void BeginFrame(uint32_t frame) override {
+        frame_ = frame;
+        if (frame_versions_[frame] == version_ || off_ == 0) return;
+        device_->CopyDescriptorsSimple(off_, heaps_[frame]->GetCPUDescriptorHandleForHeapStart(), staging_handle(0), D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+        frame_versions_[frame] = version_;
+    }
+
+    /* Shader visible heap of the frame being recorded */
     ComPtr<ID3D12DescriptorHeap> GetHeap() {
-        return heap_;
+        return heaps_[frame_];
     }
 
     uint32_t GetDescriptorSize() const {
@@ -457,6 +885,12 @@ concept DrawCallResourceBindingStaticSampler = requires()
     { T::MakeStaticSampler() } -> std::same_as<D3D12_STATIC_SAMPLER_DESC>;
 };
 
+template<typename T>
+concept DrawCallResourceBindingInstanceStream = requires()
+{
+    { T::is_instance_stream } -> std::convertible_to<bool>;
+};
+
 template<uint32_t R>
 class DrawCallSRVBinding {
 public:
@@ -476,6 +910,66 @@ public:
     static void Apply(const DrawCallSRVBinding& b, ComPtr<ID3D12GraphicsCommandList>& list, uint32_t rpi) {
         list->SetGraphicsRootShaderResourceView(rpi, b.addr_);
     }
+
+    static bool Equal(const DrawCallSRVBinding& a, const DrawCallSRVBinding& b) {
+        return a.addr_ == b.addr_;
+    }
+};
+
+/* Root SRV pointing at the first instance of a drawcall inside an instance buffer, SV_InstanceID indexes from there.
+ * The address is resolved when applied, in the copy of the frame being recorded */
+template<uint32_t R>
+class DrawCallInstanceBinding {
+public:
+    static constexpr bool is_static_sampler = false;
+    static constexpr bool is_instance_stream = true;
+    DX12InstanceBuffer* buffer_;
+    uint32_t first_;
+
+    DrawCallInstanceBinding(DX12InstanceBuffer& buffer, uint32_t first_instance) : buffer_(&buffer), first_(first_instance) {}
+
+    void Rebind(DX12InstanceBuffer& buffer, uint32_t first_instance) {
+        buffer_ = &buffer;
+        first_ = first_instance;
+    }
+
+    static D3D12_ROOT_PARAMETER MakeRootParam() {
+        D3D12_ROOT_PARAMETER p{};
+        p.ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
+        p.Descriptor.ShaderRegister = R;
+        p.ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
+        return p;
+    }
+
+    static void Apply(const DrawCallInstanceBinding& b, ComPtr<ID3D12GraphicsCommandList>& list, uint32_t rpi) {
+        list->SetGraphicsRootShaderResourceView(rpi, b.buffer_->GetGPUAddress(b.first_));
+    }
+};
+
+/* Root SRV of a material buffer, resolved when applied like DrawCallInstanceBinding */
+template<uint32_t R>
+class DrawCallMaterialBinding {
+public:
+    static constexpr bool is_static_sampler = false;
+    DX12MaterialBuffer* buffer_;
+
+    DrawCallMaterialBinding(DX12MaterialBuffer& buffer) : buffer_(&buffer) {}
+
+    static D3D12_ROOT_PARAMETER MakeRootParam() {
+        D3D12_ROOT_PARAMETER p{};
+        p.ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
+        p.Descriptor.ShaderRegister = R;
+        p.ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+        return p;
+    }
+
+    static void Apply(const DrawCallMaterialBinding& b, ComPtr<ID3D12GraphicsCommandList>& list, uint32_t rpi) {
+        list->SetGraphicsRootShaderResourceView(rpi, b.buffer_->GetGPUAddress());
+    }
+
+    static bool Equal(const DrawCallMaterialBinding& a, const DrawCallMaterialBinding& b) {
+        return a.buffer_ == b.buffer_;
+    }
 };
 
 template<uint32_t R, uint32_t Size>
@@ -498,6 +992,10 @@ public:
         list->SetDescriptorHeaps(1, heaps);
         list->SetGraphicsRootDescriptorTable(rpi, b.heap_.GetHeap()->GetGPUDescriptorHandleForHeapStart());
     }
+
+    static bool Equal(const DrawCallTexturesBinding& a, const DrawCallTexturesBinding& b) {
+        return &a.heap_ == &b.heap_;
+    }
 };
 
 template<uint32_t R>
@@ -519,6 +1017,10 @@ public:
     static void Apply(const DrawCallCBVBinding& b, ComPtr<ID3D12GraphicsCommandList>& list, uint32_t rpi) {
         list->SetGraphicsRootConstantBufferView(rpi, b.addr_);
     }
+
+    static bool Equal(const DrawCallCBVBinding& a, const DrawCallCBVBinding& b) {
+        return a.addr_ == b.addr_;
+    }
 };
 
 template<uint32_t R, D3D12_FILTER F>
@@ -528,11 +1030,16 @@ public:
     static D3D12_STATIC_SAMPLER_DESC MakeStaticSampler() {
         return CD3DX12_STATIC_SAMPLER_DESC(R, F);
     }
+
+    static bool Equal(const DrawCallStaticSamplerBinding&, const DrawCallStaticSamplerBinding&) {
+        return true;
+    }
 };
 
 template<typename... Args>
 struct DrawCallLayout {
     static constexpr uint32_t count = sizeof...(Args);
+    static constexpr bool has_instance_stream = (DrawCallResourceBindingInstanceStream<Args> || ...);
 
     struct Bindings {
         std::tuple<Args...> tup_;
@@ -547,7 +1054,41 @@ struct DrawCallLayout {
             ApplyInternal(list, std::make_index_sequence<count>{});
         }
 
+        /* Whether both bindings set the same root state, instance streams are ignored since batching rewrites them */
+        bool SameState(const Bindings& other) const {
+            return SameStateInternal(other, std::make_index_sequence<count>{});
+        }
+
+        template<typename F>
+        void ForEachInstanceStream(F&& f) {
+            ForEachInstanceStreamInternal(f, std::make_index_sequence<count>{});
+        }
+
     private:
+        template<size_t... Is>
+        bool SameStateInternal(const Bindings& other, std::index_sequence<Is...>) const {
+            return ([&] {
+                using T = std::tuple_element_t<Is, std::tuple<Args...>>;
+                if constexpr (DrawCallResourceBindingInstanceStream<T>) {
+                    return true;
+                } else {
+                    return T::Equal(std::get<Is>(tup_), std::get<Is>(other.tup_));
+                }
+            }() && ...);
+        }
+
+        template<typename F, size_t... Is>
+        void ForEachInstanceStreamInternal(F& f, std::index_sequence<Is...>) {
+            ((
+                [&] {
+                    using T = std::tuple_element_t<Is, std::tuple<Args...>>;
+                    if constexpr (DrawCallResourceBindingInstanceStream<T>) {
+                        f(std::get<Is>(tup_));
+                    }
+                }()
+            ), ...);
+        }
+
         template<size_t... Is>
         void ApplyInternal(ComPtr<ID3D12GraphicsCommandList> list, std::index_sequence<Is...>) {
             uint32_t rpi = 0;
@@ -594,6 +1135,14 @@ struct DrawCallLayout {
     }
 };
 
+/* A contiguous index range inside a drawcall's index buffer. LOD 0 is full detail, coarser LODs follow with non-decreasing
+ * geometric_error, the object-space deviation from LOD 0 in world units */
+using lod_range_t = struct {
+    uint32_t index_offset;
+    uint32_t index_count;
+    float geometric_error;
+};
+
 template<typename Layout>
 class DrawCall {
 public:
@@ -606,6 +1155,9 @@ public:
 private:
     Layout::Bindings bindings_;
     ia_buffer_view_t v_;
+    std::vector<lod_range_t> lods_;
+    uint32_t lod_{0};
+    bool visible_{true};
 public:
     DrawCall(Layout::Bindings&& bindings) : bindings_(std::move(bindings)) {}
     void BindIABuffer(GPUResourceManager::gpu_resource_handle_t& hvertex_buffer, GPUResourceManager::gpu_resource_handle_t& hindex_buffer, uint32_t instance_count) {
@@ -623,11 +1175,78 @@ public:
         return Layout::CreateRootSignature(device);
     }
 
+    /* Culled drawcalls stay bound to the pipeline but are skipped when recording */
+    void SetVisible(bool visible) {
+        visible_ = visible;
+    }
+
+    bool IsVisible() const {
+        return visible_;
+    }
+
+    /* Bind the LOD index ranges of the mesh, ordered from full detail to the coarsest one */
+    void BindLODs(std::vector<lod_range_t> lods) {
+        lods_ = std::move(lods);
+        lod_ = 0;
+    }
+
+    void SetLOD(uint32_t lod) {
+        lod_ = lods_.empty() ? 0 : std::min(lod, static_cast<uint32_t>(lods_.size() - 1));
+    }
+
+    uint32_t GetLOD() const {
+        return lod_;
+    }
+
+    const std::vector<lod_range_t>& GetLODs() const {
+        return lods_;
+    }
+
+    uint32_t GetSubmittedIndexCount() const {
+        return lods_.empty() ? v_.indices_count : lods_[lod_].index_count;
+    }
+
+    uint32_t GetFullDetailIndexCount() const {
+        return lods_.empty() ? v_.indices_count : lods_[0].index_count;
+    }
+
+    uint32_t GetSubmittedIndexOffset() const {
+        return lods_.empty() ? 0 : lods_[lod_].index_offset;
+    }
+
+    /* Whether other draws the same mesh range with the same root state, so both can share one instanced draw */
+    bool CanBatchWith(DrawCall& other) {
+        return v_.vb_view.BufferLocation == other.v_.vb_view.BufferLocation &&
+            v_.vb_view.StrideInBytes == other.v_.vb_view.StrideInBytes &&
+            v_.ib_view.BufferLocation == other.v_.ib_view.BufferLocation &&
+            GetSubmittedIndexOffset() == other.GetSubmittedIndexOffset() &&
+            GetSubmittedIndexCount() == other.GetSubmittedIndexCount() &&
+            bindings_.SameState(other.bindings_);
+    }
+
+    /* First instance and source buffer of the drawcall's instance stream, buffer is nullptr without one */
+    uint32_t GetInstanceRange(DX12InstanceBuffer*& buffer) {
+        uint32_t first = 0;
+        buffer = nullptr;
+        bindings_.ForEachInstanceStream([&](auto& b) {
+            buffer = b.buffer_;
+            first = b.first_;
+        });
+        return first;
+    }
+
+    void RebindInstances(DX12InstanceBuffer& buffer, uint32_t first, uint32_t count) {
+        bindings_.ForEachInstanceStream([&](auto& b) {
+            b.Rebind(buffer, first);
+        });
+        v_.instance_count = count;
+    }
+
     void ApplyCommandList(ComPtr<ID3D12GraphicsCommandList> render_list) {
         bindings_.ApplyAll(render_list);
         render_list->IASetVertexBuffers(0, 1, &v_.vb_view);
         render_list->IASetIndexBuffer(&v_.ib_view);
-        render_list->DrawIndexedInstanced(v_.indices_count, v_.instance_count, 0, 0, 0);
+        render_list->DrawIndexedInstanced(GetSubmittedIndexCount(), v_.instance_count, GetSubmittedIndexOffset(), 0, 0);
     }
 
     ia_buffer_view_t& GetIABufferView() {
@@ -652,6 +1271,13 @@ public:
         bool enable_msaa_4x;
     };
 
+    using batch_stats_t = struct {
+        uint32_t source_draws;
+        uint32_t api_draws;
+        uint32_t saved_draws;
+        uint32_t copied_instances;
+    };
+
 private:
     ComPtr<ID3D12Device> device_;
     ComPtr<ID3D12PipelineState> pso_;
@@ -661,6 +1287,81 @@ private:
     ComPtr<ID3D12RootSignature> signature_;
     std::vector<DrawCall<Layout>> drawcalls_;
     const pipeline_init_t init_;
+    std::shared_ptr<DX12InstanceBuffer> batch_instances_;
+    std::vector<DrawCall<Layout>> batched_drawcalls_;
+    batch_stats_t batch_stats_{};
+
+    /* Group drawcalls sharing mesh range and root state into one instanced draw. Members whose instances are already
+     * adjacent in the same buffer are merged in place, the rest are gathered into the pipeline's batch instance buffer */
+    void build_batches() {
+        batched_drawcalls_.clear();
+        batch_instances_->Reset();
+        batch_stats_ = {};
+        using ia_key_t = std::tuple<D3D12_GPU_VIRTUAL_ADDRESS, D3D12_GPU_VIRTUAL_ADDRESS, uint32_t, uint32_t>;
+        std::map<ia_key_t, std::vector<uint32_t>> buckets;
+        for (uint32_t i = 0; i < drawcalls_.size(); ++i) {
+            if (!drawcalls_[i].IsVisible()) continue;
+            auto& v = drawcalls_[i].GetIABufferView();
+            buckets[{v.vb_view.BufferLocation, v.ib_view.BufferLocation, drawcalls_[i].GetSubmittedIndexOffset(), drawcalls_[i].GetSubmittedIndexCount()}].push_back(i);
+        }
+        std::vector<bool> merged(drawcalls_.size(), false);
+        std::vector<uint32_t> group;
+        for (uint32_t i = 0; i < drawcalls_.size(); ++i) {
+            if (merged[i] || !drawcalls_[i].IsVisible()) continue;
+            auto& leader = drawcalls_[i];
+            auto& v = leader.GetIABufferView();
+            auto& bucket = buckets[{v.vb_view.BufferLocation, v.ib_view.BufferLocation, leader.GetSubmittedIndexOffset(), leader.GetSubmittedIndexCount()}];
+            group.clear();
+            group.push_back(i);
+            for (uint32_t j : bucket) {
+                if (j > i && !merged[j] && leader.CanBatchWith(drawcalls_[j])) {
+                    group.push_back(j);
+                    merged[j] = true;
+                }
+            }
+            if (group.size() == 1) {
+                batched_drawcalls_.push_back(leader);
+                continue;
+            }
+            DX12InstanceBuffer* src;
+            uint32_t expect = leader.GetInstanceRange(src);
+            DX12InstanceBuffer* leader_src = src;
+            uint32_t total = 0;
+            bool contiguous = true;
+            for (uint32_t m : group) {
+                uint32_t first = drawcalls_[m].GetInstanceRange(src);
+                contiguous = contiguous && src == leader_src && first == expect;
+                expect = first + drawcalls_[m].GetIABufferView().instance_count;
+                total += drawcalls_[m].GetIABufferView().instance_count;
+            }
+            DrawCall<Layout> batch = leader;
+            if (contiguous) {
+                batch.GetIABufferView().instance_count = total;
+            } else {
+                uint32_t dst = batch_instances_->Allocate(total);
+                if (dst == std::numeric_limits<uint32_t>::max()) {
+                    for (uint32_t m : group) batched_drawcalls_.push_back(drawcalls_[m]);
+                    continue;
+                }
+                uint32_t off = dst;
+                for (uint32_t m : group) {
+                    uint32_t first = drawcalls_[m].GetInstanceRange(src);
+                    uint32_t count = drawcalls_[m].GetIABufferView().instance_count;
+                    batch_instances_->Set(off, &src->Get(first), count);
+                    off += count;
+                }
+                batch.RebindInstances(*batch_instances_, dst, total);
+                batch_stats_.copied_instances += total;
+            }
+            batched_drawcalls_.push_back(batch);
+        }
+        batch_instances_->Flush();
+        batch_stats_.source_draws = static_cast<uint32_t>(std::count_if(drawcalls_.begin(), drawcalls_.end(), [](auto& d) {
+            return d.IsVisible();
+        }));
+        batch_stats_.api_draws = static_cast<uint32_t>(batched_drawcalls_.size());
+        batch_stats_.saved_draws = batch_stats_.source_draws - batch_stats_.api_draws;
+    }
 public:
     Pipeline(ComPtr<ID3D12Device>& device, const pipeline_init_t& init) : device_(device), init_(init){}
     Pipeline(Pipeline&) = delete;
@@ -682,6 +1383,16 @@ public:
         ps_ = ps;
     }
 
+    /* Merge drawcalls with identical mesh and bindings into instanced draws every frame. Gathered instances go to a
+     * pipeline-owned instance buffer named res_id with room for capacity instances per frame in flight */
+    void EnableBatching(GPUResourceManager& mgr, const std::string& res_id, uint32_t capacity) requires (Layout::has_instance_stream) {
+        batch_instances_ = std::make_shared<DX12InstanceBuffer>(mgr, res_id, capacity, true);
+    }
+
+    const batch_stats_t& GetBatchStats() const {
+        return batch_stats_;
+    }
+
     void Build() {
         D3D12_GRAPHICS_PIPELINE_STATE_DESC pso{};
         pso.InputLayout = layout_;
@@ -708,6 +1419,7 @@ public:
         pso.SampleDesc.Count = init_.enable_msaa_4x ? 4 : 1;
         pso.SampleDesc.Quality = 0;
         pso.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
+        TraceScope trace(trace_event_type::PIPELINE_BUILD, "pipeline build");
         CHECKHR(device_->CreateGraphicsPipelineState(&pso, IID_PPV_ARGS(&pso_)));
     }
 
@@ -720,8 +1432,11 @@ public:
     }
 
     void RecordRenderCommands(ComPtr<ID3D12GraphicsCommandList> render_list) override {
-        for (auto& drawcall : drawcalls_) {
-            drawcall.ApplyCommandList(render_list);
+        if (batch_instances_ != nullptr) {
+            build_batches();
+        }
+        for (auto& drawcall : batch_instances_ != nullptr ? batched_drawcalls_ : drawcalls_) {
+            if (drawcall.IsVisible()) drawcall.ApplyCommandList(render_list);
         }
     }
 
@@ -729,6 +1444,14 @@ public:
         return  drawcalls_[drawcall_index].GetIABufferView();
     }
 
+    DrawCall<Layout>& GetDrawCall(uint32_t drawcall_index) {
+        return drawcalls_[drawcall_index];
+    }
+
+    uint32_t GetDrawCallCount() const {
+        return static_cast<uint32_t>(drawcalls_.size());
+    }
+
 };
 
 using RenderPreset = struct {
@@ -885,7 +1608,7 @@ private:
     ComPtr<ID3D12DescriptorHeap> rtv_heap_;
     ComPtr<ID3D12DescriptorHeap> msaa_rtv_heap_;
     ComPtr<ID3D12DescriptorHeap> dsv_heap_;
-    RenderTarget rts_[2];
+    RenderTarget rts_[frame_count];
 
     std::unordered_map<std::string, std::shared_ptr<IPipeline>> pipelines_;
     std::vector<std::shared_ptr<ITextureHeap>> heaps_;
@@ -927,7 +1650,7 @@ public:
 
         // Create swapchain
         DXGI_SWAP_CHAIN_DESC1 sd{};
-        sd.BufferCount = 2; // double buffer
+        sd.BufferCount = frame_count; // double buffer
         sd.Width = presets_.width;
         sd.Height = presets_.height;
         sd.Format = DXGI_FORMAT_R8G8B8A8_UNORM; // format: RGBA32
@@ -949,20 +1672,20 @@ public:
         CHECKHR(sc.As(&swapchain_));
         // Create RTV Heap for swapchain buffers
         D3D12_DESCRIPTOR_HEAP_DESC rtv_heap_desc{};
-        rtv_heap_desc.NumDescriptors = 2;
+        rtv_heap_desc.NumDescriptors = frame_count;
         rtv_heap_desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
         CHECKHR(device_->CreateDescriptorHeap(&rtv_heap_desc, IID_PPV_ARGS(&rtv_heap_)));
         D3D12_DESCRIPTOR_HEAP_DESC msaa_rtv_heap_desc{};
-        msaa_rtv_heap_desc.NumDescriptors = 2;
+        msaa_rtv_heap_desc.NumDescriptors = frame_count;
         msaa_rtv_heap_desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
         CHECKHR(device_->CreateDescriptorHeap(&msaa_rtv_heap_desc, IID_PPV_ARGS(msaa_rtv_heap_.GetAddressOf())));
         // Create DSV Heap for depth buffer
         D3D12_DESCRIPTOR_HEAP_DESC dsv_desc = {};
-        dsv_desc.NumDescriptors = 2;
+        dsv_desc.NumDescriptors = frame_count;
         dsv_desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
         dsv_desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
         CHECKHR(device_->CreateDescriptorHeap(&dsv_desc, IID_PPV_ARGS(&dsv_heap_)));
-        for (int i = 0; i < 2; ++i) {
+        for (uint32_t i = 0; i < frame_count; ++i) {
             rts_[i].Initialize(i, device_, presets_, swapchain_, rtv_heap_, msaa_rtv_heap_, dsv_heap_);
         }
     }
@@ -989,9 +1712,12 @@ public:
     }
 
     void Render() {
-        auto& rt = rts_[swapchain_->GetCurrentBackBufferIndex()];
+        const uint32_t frame = swapchain_->GetCurrentBackBufferIndex();
+        auto& rt = rts_[frame];
         auto& fence = rt.GetRenderFence();
         fence.Wait();
+        gpu_resource_mgr_.BeginFrame(frame);
+        for (auto& heap : heaps_) heap->BeginFrame(frame);
         auto& render_list = rt.GetRenderCommandList();
         auto& render_alloc = rt.GetRenderCommandAllocator();
         auto& back_buffer = rt.GetBackBuffer();
@@ -1078,6 +1804,7 @@ public:
             CHECKHR(swapchain_->Present(0, DXGI_PRESENT_ALLOW_TEARING));
         }
         fence.Insert(render_queue_);
+        gpu_resource_mgr_.EndFrame();
         gpu_resource_mgr_.DeferredRelease();
     }
 
@@ -1118,9 +1845,15 @@ public:
                 TranslateMessage(&msg);
                 DispatchMessage(&msg);
             } else {
+                auto& recorder = g_flight_recorder();
+                if (recorder) recorder->BeginFrame();
                 auto delta = fpsc_.delta_ms();
                 Update(delta);
                 render_ctx_.Render();
+                if (recorder) {
+                    auto trace = recorder->EndFrame();
+                    if (!trace.empty()) LOG_INFO("frame {} hitched, last frames written to {}", recorder->GetFrame() - 1, trace);
+                }
             }
         }
     }
@@ -1272,33 +2005,273 @@ public:
     using raw_tex_t = struct {
         uint32_t width;
         uint32_t height;
-        uint8_t* data;
+        texture_format format;
+        const uint8_t* data;    // level 0, rows are view.levels[0].row_pitch bytes apart, null once released
+        texture_view_t view;    // every level, pass to CreateTexture, no levels once released
     };
 private:
+    using loaded_texture_t = struct {
+        std::optional<texture_view_t> view;
+        uint64_t key;           // cache key, the view maps the cache file under it unless owned
+        bool cached;            // found in the cache without decoding
+        bool owned;             // the view points at decoded pixels from stbi, the cache was not writable
+    };
     std::map<std::string, raw_tex_t> textures_map;
+    std::map<std::string, loaded_texture_t> sources_;
+    TextureCache cache_{"cache/textures"};
+    texture_cache_settings_t settings_ = {texture_format::BC7_UNORM, 0, mip_filter::KAISER, true, bc_quality::NORMAL};
+    bool keep_cpu_data_{false};
+
+    /* Format a source decodes to. Two channel sources are gray and alpha and land in red and green, three channel ones
+     * need RGBA8 as D3D12 has no RGB8 format. HDR sources decode to half floats */
+    static texture_format decoded_format(int channels, bool hdr) {
+        if (hdr) return channels == 1 ? texture_format::R16_FLOAT : texture_format::RGBA16_FLOAT;
+        if (channels == 1) return texture_format::R8_UNORM;
+        return channels == 2 ? texture_format::RG8_UNORM : texture_format::RGBA8_UNORM;
+    }
+
+    static bool is_normal_map(const std::filesystem::path& path) {
+        auto stem = path.stem().string();
+        return stem.ends_with("_normal") || stem.ends_with("_n");
+    }
+
+    /* Channel mapping of a source: gray, and gray and alpha sources are spread back to RGB. Normal maps keep their
+     * channels, they share BC5 with gray and alpha */
+    static texture_swizzle source_swizzle(const std::filesystem::path& path, int channels) {
+        if (channels == 1) return texture_swizzle::GRAY;
+        return channels == 2 && !is_normal_map(path) ? texture_swizzle::GRAY_ALPHA : texture_swizzle::RGBA;
+    }
+
+    /* Format a source is stored in: with block compression on, BC4 for single channel data like the SDF atlas, BC5 for
+     * two channel data and normal maps (named *_normal or *_n), the color format otherwise. HDR sources stay half
+     * float, there is no BC6H encoder. D3D12 only accepts block compressed textures whose top level is a multiple of 4,
+     * other sizes stay in their decoded format */
+    texture_format select_format(const std::filesystem::path& path, texture_format decoded, int width, int height) const {
+        if (!texture_format_is_block_compressed(settings_.format) || texture_format_is_float(decoded) || width % 4 || height % 4) return decoded;
+        if (decoded == texture_format::R8_UNORM) return texture_format::BC4_UNORM;
+        if (decoded == texture_format::RG8_UNORM || is_normal_map(path)) return texture_format::BC5_UNORM;
+        return settings_.format;
+    }
+
+    /* Peak bytes load_texture holds for a source missing the cache: the file, the decoded pixels (floats for HDR until
+     * narrowed), the mip scratch and chain, and the block compressed chain. An upper bound, a hit only reads the file */
+    uint64_t estimate_load_bytes(const std::filesystem::path& path, uint64_t file_bytes, int width, int height, int channels, bool hdr) const {
+        const texture_format format = decoded_format(channels, hdr);
+        const auto w = static_cast<uint32_t>(width), h = static_cast<uint32_t>(height);
+        uint64_t bytes = file_bytes + static_cast<uint64_t>(w) * h * texture_format_channels(format) * (hdr ? 4 : 1);
+        bytes += generate_mips_peak_bytes(w, h, format, {settings_.filter, false, settings_.mip_levels});
+        const texture_format stored = select_format(path, format, width, height);
+        if (texture_format_is_block_compressed(stored)) {
+            uint32_t levels = mip_level_count(w, h);
+            if (settings_.mip_levels) levels = std::min(levels, settings_.mip_levels);
+            for (uint32_t l = 0; l < levels; ++l) {
+                bytes += static_cast<uint64_t>(texture_row_bytes(stored, std::max(1u, w >> l))) * texture_row_count(stored, std::max(1u, h >> l));
+            }
+        }
+        return bytes;
+    }
 
 public:
-    void load_textures() {
+    /* Format for color textures, BC1, BC7 or RGBA8 to turn block compression off, and the encoder effort. Call before
+     * load_textures */
+    void set_compression(texture_format color_format, bc_quality quality) {
+        settings_.format = color_format;
+        settings_.quality = quality;
+    }
+
+    /* Load every jpg/png/hdr under textures/ on pool, a temporary pool is created when none is given. A texture found in
+     * the cache is memory-mapped, any other is decoded, written to the cache and then mapped, so the decoded pixels
+     * are freed right away. Loads only start while their peak bytes in flight, see estimate_load_bytes, stay within
+     * budget_bytes, one load always runs even if it alone exceeds it. Results are inserted in file name order on the calling thread, so the
+     * map is the same on every run */
+    void load_textures(JobPool* pool = nullptr, size_t budget_bytes = size_t(256) << 20) {
         std::filesystem::directory_entry textures("textures");
         if (!textures.exists()) {
             std::cout << "textures not exists, exit" << std::endl;
             exit(EXIT_FAILURE);
         }
+        using decode_job_t = struct {
+            std::filesystem::path path;
+            size_t estimate;
+            loaded_texture_t texture;
+            float decode_ms;
+        };
+        std::vector<decode_job_t> jobs;
         for (auto& texture : std::filesystem::directory_iterator(textures)) {
-            if (texture.is_regular_file() && (texture.path().string().ends_with(".jpg")) || texture.path().string().ends_with(".png")) {
-                std::cout << std::format("loading texture {}", texture.path().filename().string()) << std::endl;
-                int width, height, channels;
-                unsigned char* data = stbi_load(texture.path().string().c_str(), &width, &height, &channels, 4);
-                if (data == nullptr) {
-                    std::cout << std::format("failed to load texture {}, exit", texture.path().filename().string()) << std::endl;
-                    exit(EXIT_FAILURE);
+            auto ext = texture.path().extension().string();
+            if (texture.is_regular_file() && (ext == ".jpg" || ext == ".png" || ext == ".hdr")) {
+                jobs.push_back({.path = texture.path()});
+            }
+        }
+        std::sort(jobs.begin(), jobs.end(), [](const auto& a, const auto& b) { return a.path.filename() < b.path.filename(); });
+        // The header gives the decoded size without decoding
+        for (auto& job : jobs) {
+            int w = 0, h = 0, c = 0;
+            if (stbi_info(job.path.string().c_str(), &w, &h, &c)) {
+                std::error_code ec;
+                uint64_t file_bytes = std::filesystem::file_size(job.path, ec);
+                job.estimate = static_cast<size_t>(estimate_load_bytes(job.path, ec ? 0 : file_bytes, w, h, c, stbi_is_hdr(job.path.string().c_str())));
+            }
+        }
+
+        std::unique_ptr<JobPool> local_pool;
+        if (!pool) {
+            local_pool = std::make_unique<JobPool>();
+            pool = local_pool.get();
+        }
+        std::mutex mutex;
+        std::condition_variable released;
+        size_t in_flight = 0;
+        auto begin = std::chrono::steady_clock::now();
+        for (auto& job : jobs) {
+            {
+                std::unique_lock lock(mutex);
+                released.wait(lock, [&]() { return in_flight == 0 || in_flight + job.estimate <= budget_bytes; });
+                in_flight += job.estimate;
+            }
+            pool->Submit([&]() {
+                auto t0 = std::chrono::steady_clock::now();
+                load_texture(job.path, pool, job.texture);
+                job.decode_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t0).count();
+                {
+                    std::lock_guard lock(mutex);
+                    in_flight -= job.estimate;
                 }
-                textures_map[texture.path().filename().string()] = {
-                    .width = static_cast<uint32_t>(width),
-                    .height = static_cast<uint32_t>(height),
-                    .data = data
-                };
+                released.notify_all();
+            });
+        }
+        pool->Wait();
+        float total_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+        float decode_ms = 0.0f;
+        uint32_t hits = 0;
+        for (auto& job : jobs) {
+            auto name = job.path.filename().string();
+            if (!job.texture.view.has_value()) {
+                LOG_ERROR_CAT(log_category::ASSET, "failed to load texture {}, exit", name);
+                exit(EXIT_FAILURE);
+            }
+            auto& view = job.texture.view.value();
+            LOG_INFO_CAT(log_category::ASSET, "loaded texture {} {}x{} {} in {} ms{}", name, view.width, view.height, texture_format_name(view.format), job.decode_ms, job.texture.cached ? " from cache" : "");
+            decode_ms += job.decode_ms;
+            hits += job.texture.cached;
+            g_memory_stats().AddCPU(memory_category::TEXTURE, texture_view_bytes(view));
+            textures_map[name] = {
+                .width = view.width,
+                .height = view.height,
+                .format = view.format,
+                .data = view.levels[0].data,
+                .view = view,
+            };
+            sources_[name] = std::move(job.texture);
+        }
+        LOG_INFO_CAT(log_category::ASSET, "loaded {} textures ({} from cache) in {} ms, {} ms of loading on {} threads", jobs.size(), hits, total_ms, decode_ms, pool->GetWorkerCount() + 1);
+    }
+
+    /* Map path's derived texture from the cache, decoding it, generating its mips and block compressing them on pool
+     * first on a miss. Only RGBA8 sources are treated as sRGB color, ones with one or two channels hold data like
+     * distance fields and HDR sources are linear. Thread safe */
+    void load_texture(const std::filesystem::path& path, JobPool* pool, loaded_texture_t& texture) {
+        std::ifstream in(path, std::ios::in | std::ios::binary);
+        std::vector<uint8_t> source((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (source.empty()) return;
+        const int source_size = static_cast<int>(source.size());
+        int info_width = 0, info_height = 0, info_channels = 4;
+        stbi_info_from_memory(source.data(), source_size, &info_width, &info_height, &info_channels);
+        const bool hdr = stbi_is_hdr_from_memory(source.data(), source_size);
+        const texture_format format = decoded_format(info_channels, hdr);
+        texture_cache_settings_t settings = settings_;
+        settings.srgb = settings.srgb && format == texture_format::RGBA8_UNORM;
+        settings.format = select_format(path, format, info_width, info_height);
+        uint64_t key = TextureCache::Key(source.data(), source.size(), settings);
+        auto& view = texture.view;
+        texture.key = key;
+        view = cache_.Open(key);
+        texture.cached = view.has_value();
+        texture.owned = false;
+        const texture_swizzle swizzle = source_swizzle(path, info_channels);
+        if (texture.cached) {
+            view->swizzle = swizzle;
+            return;
+        }
+        int width, height, channels;
+        const int components = static_cast<int>(texture_format_channels(format));
+        uint8_t* data;
+        if (hdr) {
+            data = reinterpret_cast<uint8_t*>(stbi_loadf_from_memory(source.data(), source_size, &width, &height, &channels, components));
+            // Narrow to half floats in place, each half lands at or before the float it came from
+            for (size_t i = 0; data && i < static_cast<size_t>(width) * height * components; ++i) {
+                float value;
+                memcpy(&value, data + i * 4, 4);
+                uint16_t half = float_to_half(value);
+                memcpy(data + i * 2, &half, 2);
             }
+        } else {
+            data = stbi_load_from_memory(source.data(), source_size, &width, &height, &channels, components);
+        }
+        if (data == nullptr) return;
+        auto w = static_cast<uint32_t>(width), h = static_cast<uint32_t>(height);
+        texture_view_t decoded = {format, w, h, {{w, h, texture_row_bytes(format, w), data}}};
+        mip_chain_t chain = generate_mips(decoded, {settings.filter, settings.srgb, settings.mip_levels}, pool);
+        if (texture_format_is_block_compressed(settings.format)) {
+            auto t0 = std::chrono::steady_clock::now();
+            compressed_texture_t compressed = compress_texture(chain.view, settings.format, settings.quality, pool);
+            float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            float psnr = texture_psnr(chain.view, compressed.view);
+            LOG_INFO_CAT(log_category::ASSET, "compressed {} to {} in {} ms, PSNR {} dB", path.filename().string(), texture_format_name(settings.format), ms, psnr);
+            if (cache_.Store(key, compressed.view)) view = cache_.Open(key);
+        } else if (cache_.Store(key, chain.view)) {
+            view = cache_.Open(key);
+        }
+        if (view.has_value()) {
+            stbi_image_free(data);
+        } else {
+            // The cache is not writable, keep the decoded pixels without mips
+            view = std::move(decoded);
+            texture.owned = true;
+        }
+        view->swizzle = swizzle;
+    }
+
+    /* Keep CPU pixels of every texture even after release_after_upload, for tools that read textures back or
+     * streaming that re-uploads levels */
+    void set_keep_cpu_data(bool keep) {
+        keep_cpu_data_ = keep;
+    }
+
+    /* Drop the CPU pixels of tex_name: unmap its cache file or free its decoded pixels. get keeps returning the size
+     * and format, with no levels */
+    void release(const std::string& tex_name) {
+        auto it = sources_.find(tex_name);
+        if (it == sources_.end() || !it->second.view.has_value()) return;
+        loaded_texture_t& source = it->second;
+        g_memory_stats().AddCPU(memory_category::TEXTURE, -static_cast<int64_t>(texture_view_bytes(source.view.value())));
+        if (source.owned) {
+            stbi_image_free(const_cast<uint8_t*>(source.view.value().levels[0].data));
+        } else {
+            // Identical sources share one mapping, it goes with the last of them
+            bool shared = std::any_of(sources_.begin(), sources_.end(), [&](const auto& other) {
+                return other.first != tex_name && !other.second.owned && other.second.key == source.key && other.second.view.has_value();
+            });
+            if (!shared) cache_.Close(source.key);
+        }
+        source.view.reset();
+        auto& tex = textures_map[tex_name];
+        tex.data = nullptr;
+        tex.view.levels.clear();
+        LOG_DEBUG_CAT(log_category::ASSET, "released cpu copy of texture {}", tex_name);
+    }
+
+    /* Release tex_name once every upload issued to mgr so far, its own included, has completed. Does nothing with
+     * set_keep_cpu_data on. The manager has to outlive mgr's next DeferredRelease */
+    void release_after_upload(const std::string& tex_name, GPUResourceManager& mgr) {
+        if (keep_cpu_data_) return;
+        mgr.ReleaseAfterUpload([this, tex_name]() { release(tex_name); });
+    }
+
+    ~TextureManager() {
+        for (auto& [name, source] : sources_) {
+            if (source.view.has_value()) release(name);
         }
     }
 
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "dx12_framework.h"
+#include "../common/hlod_builder.h"
+
+/* Hierarchical LOD for groups of static objects. The build step clusters objects on a uniform grid, merges every
+ * cluster into one proxy mesh simplified by vertex clustering and bakes the children's textures into one atlas, see
+ * build_hlod_clusters. At runtime a cluster beyond switch_distance draws its proxy instead of its children. */
+template<HLODVertex V>
+class DX12HLOD {
+public:
+    using cluster_t = struct : hlod_cluster_t<V> {
+        GPUResourceManager::gpu_resource_handle_t vertex_buffer;
+        GPUResourceManager::gpu_resource_handle_t index_buffer;
+        GPUResourceManager::gpu_resource_handle_t texture;
+        uint32_t proxy_drawcall = std::numeric_limits<uint32_t>::max();    // set by the application once the proxy drawcall is bound
+    };
+private:
+    hlod_param_t param_;
+    std::vector<hlod_object_t<V>> objects_;
+    std::vector<cluster_t> clusters_;
+    hlod_stats_t stats_{};
+public:
+    DX12HLOD(const hlod_param_t& param) : param_(param) {}
+
+    void AddObject(const hlod_object_t<V>& obj) {
+        objects_.push_back(obj);
+    }
+
+    /* Cluster all added objects and build their proxies. Object data only has to stay alive until Build returns */
+    void Build() {
+        clusters_ = build_hlod_clusters<V, cluster_t>(objects_, param_);
+        objects_.clear();
+        uint64_t children_triangles = 0;
+        uint64_t proxy_triangles = 0;
+        for (const auto& cluster : clusters_) {
+            children_triangles += cluster.children_triangles;
+            proxy_triangles += cluster.proxy_triangles;
+        }
+        LOG_INFO_CAT(log_category::SCENE, "hlod built {} clusters, {} child triangles reduced to {} proxy triangles", clusters_.size(), children_triangles, proxy_triangles);
+    }
+
+    /* Create proxy buffers and atlas textures named {prefix}_{cluster}_*, CPU copies are released afterwards, the
+     * atlases once mgr has seen their upload complete. The HLOD has to outlive mgr's next DeferredRelease */
+    void Upload(GPUResourceManager& mgr, const std::string& prefix) {
+        for (uint32_t i = 0; i < clusters_.size(); ++i) {
+            auto& cluster = clusters_[i];
+            cluster.vertex_buffer = mgr.CreateVertexBuffer(std::format("{}_{}_vertices", prefix, i), cluster.vertices.data(), static_cast<uint32_t>(cluster.vertices.size()));
+            cluster.index_buffer = mgr.CreateIndexBuffer(std::format("{}_{}_indices", prefix, i), cluster.indices.data(), static_cast<uint32_t>(cluster.indices.size()));
+            cluster.texture = mgr.CreateTexture(std::format("{}_{}_atlas", prefix, i), cluster.atlas_width, cluster.atlas_height, cluster.atlas.data());
+            std::vector<V>().swap(cluster.vertices);
+            std::vector<uint32_t>().swap(cluster.indices);
+        }
+        mgr.ReleaseAfterUpload([this]() { ReleaseAtlases(); });
+    }
+
+    /* Release the atlas pixels once their upload has completed */
+    void ReleaseAtlases() {
+        for (auto& cluster : clusters_) {
+            g_memory_stats().AddCPU(memory_category::TEXTURE, -static_cast<int64_t>(cluster.atlas.size()));
+            std::vector<uint8_t>().swap(cluster.atlas);
+        }
+    }
+
+    std::vector<cluster_t>& GetClusters() {
+        return clusters_;
+    }
+
+    /* Swap clusters between proxy and children by camera distance and frustum cull what stays visible */
+    template<typename Layout>
+    void Update(const float3_t& camera_position, const frustum_t& frustum, Pipeline<Layout>& pipeline) {
+        stats_ = {};
+        for (auto& cluster : clusters_) {
+            bool proxy = select_hlod_cluster(cluster, camera_position, frustum, param_.switch_distance, stats_, [&](uint32_t child, bool visible) {
+                pipeline.GetDrawCall(cluster.children[child]).SetVisible(visible);
+            });
+            if (cluster.proxy_drawcall != std::numeric_limits<uint32_t>::max()) {
+                pipeline.GetDrawCall(cluster.proxy_drawcall).SetVisible(proxy);
+            }
+        }
+    }
+
+    /* Draws and triangles submitted this frame vs. drawing every visible cluster's children */
+    const hlod_stats_t& GetStats() const {
+        return stats_;
+    }
+};
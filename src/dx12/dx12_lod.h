@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+
+#include "dx12_framework.h"
+#include "dx12_transformation.h"
+
+/* Screen-space-error LOD selection. Every drawcall that carries LOD ranges gets the cheapest LOD whose projected
+ * geometric error stays under pixel_threshold. */
+class DX12LODSelector {
+public:
+    using lod_select_param_t = struct {
+        float pixel_threshold;  // max allowed projected error in pixels
+        float hysteresis;       // fraction of the threshold a switch has to overshoot, avoids popping at the boundary
+        float lod_bias;         // global bias, each +1 doubles the allowed error
+    };
+
+    using lod_stats_t = struct {
+        uint64_t submitted_triangles;
+        uint64_t full_detail_triangles;
+        uint32_t objects;
+        uint32_t reduced_objects;
+    };
+private:
+    lod_select_param_t param_;
+    lod_stats_t stats_{};
+    float3_t camera_position_{};
+    float projection_scale_{1.0f};
+    float near_z_{0.1f};
+
+    static uint32_t pick(const std::vector<lod_range_t>& lods, float projected_unit, float threshold) {
+        for (uint32_t i = static_cast<uint32_t>(lods.size()); i > 0; --i) {
+            if (lods[i - 1].geometric_error * projected_unit <= threshold) return i - 1;
+        }
+        return 0;
+    }
+public:
+    DX12LODSelector(const lod_select_param_t& param) : param_(param) {}
+
+    void SetPixelThreshold(float px) {
+        param_.pixel_threshold = px;
+    }
+
+    void SetLODBias(float bias) {
+        param_.lod_bias = bias;
+    }
+
+    float GetLODBias() const {
+        return param_.lod_bias;
+    }
+
+    /* Capture camera state and reset statistics, call once per frame before selecting */
+    void BeginFrame(DX12FreeCamera& camera, const RenderPreset& presets) {
+        camera_position_ = camera.GetCameraPosition();
+        projection_scale_ = camera.GetProjectionScale(presets.height);
+        near_z_ = camera.GetNearZ();
+        stats_ = {};
+    }
+
+    /* Pick a LOD for an object bounded by the world space sphere (center, radius), starting from the current one */
+    uint32_t Select(const std::vector<lod_range_t>& lods, uint32_t current, float3_t center, float radius) const {
+        if (lods.size() <= 1) return 0;
+        float dx = center.x - camera_position_.x;
+        float dy = center.y - camera_position_.y;
+        float dz = center.z - camera_position_.z;
+        // Use the nearest point of the bounding sphere so the error is never underestimated
+        float distance = std::max(std::sqrt(dx * dx + dy * dy + dz * dz) - radius, near_z_);
+        float projected_unit = projection_scale_ / distance;
+        float threshold = param_.pixel_threshold * std::exp2(param_.lod_bias);
+        current = std::min(current, static_cast<uint32_t>(lods.size() - 1));
+        if (lods[current].geometric_error * projected_unit > threshold * (1.0f + param_.hysteresis)) {
+            // Current LOD is visibly too coarse, refine
+            return pick(lods, projected_unit, threshold);
+        }
+        // Only coarsen once the error is comfortably below the threshold
+        return std::max(current, pick(lods, projected_unit, threshold * (1.0f - param_.hysteresis)));
+    }
+
+    template<typename Layout>
+    void Apply(DrawCall<Layout>& drawcall, float3_t center, float radius) {
+        drawcall.SetLOD(Select(drawcall.GetLODs(), drawcall.GetLOD(), center, radius));
+        uint32_t instances = drawcall.GetIABufferView().instance_count;
+        stats_.submitted_triangles += static_cast<uint64_t>(drawcall.GetSubmittedIndexCount() / 3) * instances;
+        stats_.full_detail_triangles += static_cast<uint64_t>(drawcall.GetFullDetailIndexCount() / 3) * instances;
+        ++stats_.objects;
+        if (drawcall.GetLOD() != 0) ++stats_.reduced_objects;
+    }
+
+    const lod_stats_t& GetStats() const {
+        return stats_;
+    }
+};
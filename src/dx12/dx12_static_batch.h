@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cmath>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include "dx12_framework.h"
+#include "../common/cull_kernels.h"
+#include "../common/geometry.h"
+
+/* Vertex types the static batcher can bake need a position and a normal, like PyramidVertex or the loaders' vertex */
+template<typename V>
+concept StaticBatchVertex = requires(V v) {
+    v.x; v.y; v.z;
+    v.nx; v.ny; v.nz;
+};
+
+/* Load-time static batching. Props are pre-transformed into world space and merged into one vertex/index buffer per
+ * (material, spatial cell), so thousands of small static drawcalls collapse into a few dozen while every cell keeps
+ * its bounds for frustum culling. Each batch is drawn with an identity world matrix. */
+template<StaticBatchVertex V>
+class DX12StaticBatcher {
+public:
+    using static_prop_t = struct {
+        const V* vertices;
+        uint32_t vertex_count;
+        const uint32_t* indices;
+        uint32_t index_count;
+        float world_matrix[4][4];
+        uint32_t material_index;
+    };
+
+    using static_batch_t = struct {
+        uint32_t material_index;
+        int32_t cell[3];
+        aabb_t bounds;
+        uint32_t prop_count;
+        uint32_t index_count;
+        std::vector<V> vertices;
+        std::vector<uint32_t> indices;
+        GPUResourceManager::gpu_resource_handle_t vertex_buffer;
+        GPUResourceManager::gpu_resource_handle_t index_buffer;
+    };
+private:
+    float cell_size_;
+    std::map<std::tuple<uint32_t, int32_t, int32_t, int32_t>, uint32_t> batch_lookup_;
+    std::vector<static_batch_t> batches_;
+    aabb_soa_t batch_bounds_;
+    std::vector<uint8_t> batch_visible_;
+    uint32_t prop_count_{0};
+public:
+    DX12StaticBatcher(float cell_size) : cell_size_(cell_size) {}
+
+    /* Bake a prop into the batch of its material and of the cell containing its world space center */
+    void AddProp(const static_prop_t& prop) {
+        const auto& m = prop.world_matrix;
+        aabb_t bounds = aabb_empty();
+        for (uint32_t i = 0; i < prop.vertex_count; ++i) {
+            aabb_extend(bounds, transform_point(m, {prop.vertices[i].x, prop.vertices[i].y, prop.vertices[i].z}));
+        }
+        float3_t center = aabb_center(bounds);
+        int32_t cx = static_cast<int32_t>(std::floor(center.x / cell_size_));
+        int32_t cy = static_cast<int32_t>(std::floor(center.y / cell_size_));
+        int32_t cz = static_cast<int32_t>(std::floor(center.z / cell_size_));
+        auto key = std::make_tuple(prop.material_index, cx, cy, cz);
+        auto it = batch_lookup_.find(key);
+        if (it == batch_lookup_.end()) {
+            it = batch_lookup_.emplace(key, static_cast<uint32_t>(batches_.size())).first;
+            static_batch_t batch{};
+            batch.material_index = prop.material_index;
+            batch.cell[0] = cx;
+            batch.cell[1] = cy;
+            batch.cell[2] = cz;
+            batch.bounds = aabb_empty();
+            batches_.push_back(std::move(batch));
+        }
+        static_batch_t& batch = batches_[it->second];
+        normal_matrix_t nm = normal_matrix(m);
+        uint32_t base = static_cast<uint32_t>(batch.vertices.size());
+        batch.vertices.reserve(batch.vertices.size() + prop.vertex_count);
+        for (uint32_t i = 0; i < prop.vertex_count; ++i) {
+            V v = prop.vertices[i];
+            float3_t p = transform_point(m, {v.x, v.y, v.z});
+            float3_t n = transform_normal(nm, {v.nx, v.ny, v.nz});
+            v.x = p.x; v.y = p.y; v.z = p.z;
+            v.nx = n.x; v.ny = n.y; v.nz = n.z;
+            batch.vertices.push_back(v);
+        }
+        batch.indices.reserve(batch.indices.size() + prop.index_count);
+        if (nm.sign < 0.0f) {
+            // Mirroring transforms flip the winding, swap two corners to keep it
+            for (uint32_t i = 0; i + 2 < prop.index_count; i += 3) {
+                batch.indices.push_back(base + prop.indices[i]);
+                batch.indices.push_back(base + prop.indices[i + 2]);
+                batch.indices.push_back(base + prop.indices[i + 1]);
+            }
+        } else {
+            for (uint32_t i = 0; i < prop.index_count; ++i) {
+                batch.indices.push_back(base + prop.indices[i]);
+            }
+        }
+        batch.index_count = static_cast<uint32_t>(batch.indices.size());
+        aabb_merge(batch.bounds, bounds);
+        ++batch.prop_count;
+        ++prop_count_;
+    }
+
+    /* Create one vertex and index buffer per batch named {prefix}_{batch}_vertices / _indices. The CPU copies are
+     * dropped afterwards, only bounds and buffer handles are kept */
+    void Upload(GPUResourceManager& mgr, const std::string& prefix) {
+        for (uint32_t i = 0; i < batches_.size(); ++i) {
+            auto& batch = batches_[i];
+            batch.vertex_buffer = mgr.CreateVertexBuffer(std::format("{}_{}_vertices", prefix, i), batch.vertices.data(), static_cast<uint32_t>(batch.vertices.size()));
+            batch.index_buffer = mgr.CreateIndexBuffer(std::format("{}_{}_indices", prefix, i), batch.indices.data(), static_cast<uint32_t>(batch.indices.size()));
+            std::vector<V>().swap(batch.vertices);
+            std::vector<uint32_t>().swap(batch.indices);
+            batch_bounds_.push_back(batch.bounds);
+        }
+        batch_visible_.resize(batches_.size());
+        LOG_INFO_CAT(log_category::SCENE, "static batching merged {} props into {} batches", prop_count_, batches_.size());
+    }
+
+    std::vector<static_batch_t>& GetBatches() {
+        return batches_;
+    }
+
+    uint32_t GetPropCount() const {
+        return prop_count_;
+    }
+
+    /* Frustum cull the batches after Upload and toggle their drawcalls, batch i is expected at first_drawcall + i in the pipeline.
+     * Returns the number of visible batches */
+    template<typename Layout>
+    uint32_t Cull(const frustum_t& frustum, Pipeline<Layout>& pipeline, uint32_t first_drawcall) {
+        uint32_t visible = 0;
+        frustum_cull_aabbs(frustum, batch_bounds_, batch_visible_.data());
+        for (uint32_t i = 0; i < batches_.size(); ++i) {
+            pipeline.GetDrawCall(first_drawcall + i).SetVisible(batch_visible_[i] != 0);
+            visible += batch_visible_[i];
+        }
+        return visible;
+    }
+};
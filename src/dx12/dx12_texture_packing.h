@@ -0,0 +1,74 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "dx12_framework.h"
+#include "../common/texture_packer.h"
+
+/* Uploads a set of textures with the small ones packed into texture arrays, see pack_texture_arrays, and describes
+ * each texture as a material. A packed texture costs no resource or heap slot of its own, and drawcalls whose
+ * materials share an array sample the same descriptor. */
+class DX12TexturePacker {
+public:
+    using pack_stats_t = struct {
+        uint32_t textures;
+        uint32_t packed;        // textures living in an array layer
+        uint32_t resources;     // committed resources created, arrays included
+        uint64_t array_bytes;   // CPU bytes of the array layers, freed once uploaded
+    };
+private:
+    texture_pack_param_t param_;
+    pack_stats_t stats_{};
+
+    static std::optional<uint32_t> bind(ITextureHeap& heap, const GPUResourceManager::gpu_resource_handle_t& handle, texture_swizzle swizzle) {
+        auto slot = heap.Reserve();
+        if (slot.has_value()) heap.UpdateTexture(slot.value(), handle.ptr->res.Get(), swizzle);
+        return slot;
+    }
+public:
+    DX12TexturePacker(const texture_pack_param_t& param) : param_(param) {}
+
+    /* Create {prefix}_array_{i} per array and {prefix}_{i} per texture left on its own, each in a slot of heap.
+     * Returns per texture the material sampling it, empty where the heap ran out of slots */
+    std::vector<std::optional<MaterialData>> Upload(GPUResourceManager& mgr, ITextureHeap& heap, const std::string& prefix, const std::vector<texture_view_t>& textures) {
+        auto pack = std::make_shared<texture_pack_t>(pack_texture_arrays(textures, param_));
+        std::vector<std::optional<uint32_t>> array_slots;
+        uint64_t array_bytes = 0;
+        for (uint32_t i = 0; i < pack->arrays.size(); ++i) {
+            const auto& array = pack->arrays[i];
+            auto handle = mgr.CreateTextureArray(std::format("{}_array_{}", prefix, i), array.layers);
+            array_slots.push_back(bind(heap, handle, array.swizzle));
+            array_bytes += array.storage.size();
+        }
+        std::vector<std::optional<MaterialData>> materials(textures.size());
+        for (uint32_t i = 0; i < textures.size(); ++i) {
+            const auto& entry = pack->entries[i];
+            if (entry.has_value()) {
+                auto slot = array_slots[entry->array];
+                if (slot.has_value()) materials[i] = MaterialData{slot.value(), entry->layer, {entry->uv_scale[0], entry->uv_scale[1]}};
+                ++stats_.packed;
+                continue;
+            }
+            auto slot = bind(heap, mgr.CreateTexture(std::format("{}_{}", prefix, i), textures[i]), textures[i].swizzle);
+            if (slot.has_value()) materials[i] = MaterialData{slot.value(), 0, {1.0f, 1.0f}};
+            ++stats_.resources;
+        }
+        stats_.textures += static_cast<uint32_t>(textures.size());
+        stats_.resources += static_cast<uint32_t>(pack->arrays.size());
+        stats_.array_bytes += array_bytes;
+        g_memory_stats().AddCPU(memory_category::TEXTURE, array_bytes);
+        mgr.ReleaseAfterUpload([pack, array_bytes]() {
+            g_memory_stats().AddCPU(memory_category::TEXTURE, -static_cast<int64_t>(array_bytes));
+            pack->arrays.clear();
+        });
+        LOG_INFO_CAT(log_category::GPU, "packed {} of {} textures into {} arrays, {} resources instead of {}", stats_.packed, stats_.textures, pack->arrays.size(), stats_.resources, stats_.textures);
+        return materials;
+    }
+
+    const pack_stats_t& GetStats() const {
+        return stats_;
+    }
+};
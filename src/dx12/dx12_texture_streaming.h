@@ -0,0 +1,365 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "dx12_framework.h"
+#include "dx12_transformation.h"
+#include "../common/job_pool.h"
+
+/* Mip residency for textures whose levels stay readable on the CPU, like the memory-mapped views of the TextureCache.
+ * A texture starts with only its small mips resident and gets a finer or coarser top level as its on-screen size
+ * changes, within a GPU memory budget. A residency change builds a new resource holding the levels from the new top
+ * down: an I/O thread creates it and fills an upload buffer from the view, paging in the file, and a copy queue of our
+ * own uploads it. The SRV is swapped once the copy fence has passed, which is polled and never waited on, and the
+ * previous resource is released when the frames that may still sample it have finished. Levels are always uploaded
+ * from the view rather than copied from the previous resource, which the render queue may be reading at the time. */
+class DX12TextureStreamer {
+public:
+    using stream_param_t = struct {
+        uint64_t budget_bytes;      // GPU memory all streamed textures may use together
+        uint32_t initial_size;      // a texture starts with the levels no larger than this resident
+        uint32_t max_transfers;     // residency changes in flight at once
+        uint32_t evict_frames;      // a texture not requested for this many frames drops back to its initial level
+        float mip_bias;             // each +1 halves the resolution requested for the same screen size
+    };
+
+    using stream_stats_t = struct {
+        uint64_t resident_bytes;    // held by the textures' current resources
+        uint64_t committed_bytes;   // resident plus resources being filled or waiting to be released
+        uint64_t wanted_bytes;      // what the desired levels would need before the budget is applied
+        uint32_t textures;
+        uint32_t transfers;         // in flight
+        uint32_t streamed_in;       // residency changes to a finer level since start
+        uint32_t streamed_out;
+    };
+private:
+    struct transfer_t {
+        uint32_t texture;
+        uint32_t top;
+        std::atomic<bool> ready{false};     // set by the I/O thread once resource and upload are filled
+        ComPtr<ID3D12Resource> resource;
+        ComPtr<ID3D12Resource> upload;
+        uint64_t upload_bytes{0};
+        std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> footprints;
+        uint64_t fence_value{0};            // 0 until submitted to the copy queue
+    };
+
+    struct streamed_texture_t {
+        std::string name;
+        texture_view_t view;
+        uint32_t slot;
+        uint32_t lowest;                    // coarsest level the resource may start at, the initial one
+        uint32_t resident;                  // top level on the GPU, levels.size() while nothing is
+        uint32_t desired;
+        float screen_pixels;                // largest requested this frame
+        uint64_t last_request_frame;
+        std::vector<uint64_t> sizes;        // GPU bytes of a resource starting at each level
+        ComPtr<ID3D12Resource> resource;
+        transfer_t* transfer;               // in flight, null when idle
+    };
+
+    struct allocator_t {
+        ComPtr<ID3D12CommandAllocator> allocator;
+        uint64_t fence_value;
+    };
+
+    struct retired_t {
+        ComPtr<ID3D12Resource> resource;
+        uint64_t bytes;
+        uint64_t release_frame;
+    };
+
+    ComPtr<ID3D12Device> device_;
+    GPUResourceManager& resources_;
+    ITextureHeap& heap_;
+    stream_param_t param_;
+    stream_stats_t stats_{};
+    ComPtr<ID3D12CommandQueue> copy_queue_;
+    ComPtr<ID3D12GraphicsCommandList> copy_list_;
+    std::vector<allocator_t> allocators_;
+    GPUFence fence_;
+    std::vector<streamed_texture_t> textures_;
+    std::vector<std::unique_ptr<transfer_t>> transfers_;
+    std::vector<retired_t> retired_;
+    uint64_t frame_{0};
+    float3_t camera_position_{};
+    float projection_scale_{1.0f};
+    float near_z_{0.1f};
+    JobPool io_{1};
+
+    static D3D12_RESOURCE_DESC describe(const texture_view_t& view, uint32_t top) {
+        const auto& level = view.levels[top];
+        return CD3DX12_RESOURCE_DESC::Tex2D(to_dxgi_format(view.format), level.width, level.height, 1, static_cast<UINT16>(view.levels.size() - top));
+    }
+
+    /* Runs on the I/O thread, the device is free threaded and the view read only. Takes copies, textures_ may grow
+     * meanwhile */
+    void fill(transfer_t& transfer, const std::string& name, const texture_view_t& view) {
+        D3D12_RESOURCE_DESC desc = describe(view, transfer.top);
+        D3D12_HEAP_PROPERTIES heap_prop = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+        CHECKHR(device_->CreateCommittedResource(&heap_prop, D3D12_HEAP_FLAG_NONE, &desc, D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(&transfer.resource)));
+        auto wname = string_to_wstring(name);
+        transfer.resource->SetName(wname.value().c_str());
+        const uint32_t count = desc.MipLevels;
+        transfer.footprints.resize(count);
+        std::vector<UINT> row_counts(count);
+        std::vector<UINT64> row_bytes(count);
+        UINT64 size = 0;
+        device_->GetCopyableFootprints(&desc, 0, count, 0, transfer.footprints.data(), row_counts.data(), row_bytes.data(), &size);
+        TraceScope trace(trace_event_type::UPLOAD, "texture stream", size);
+        transfer.upload = resources_.CreateUploadHeap(size);
+        transfer.upload_bytes = size;
+        g_memory_stats().AddGPU(memory_category::UPLOAD, size);
+        uint8_t* mapping;
+        CD3DX12_RANGE range(0, 0);
+        CHECKHR(transfer.upload->Map(0, &range, reinterpret_cast<void**>(&mapping)));
+        GPUResourceManager::WriteTextureLevels(mapping, view, transfer.top, count, transfer.footprints.data(), row_counts.data(), row_bytes.data());
+        transfer.upload->Unmap(0, nullptr);
+        transfer.ready.store(true, std::memory_order_release);
+    }
+
+    void start(uint32_t index, uint32_t top) {
+        auto& tex = textures_[index];
+        auto transfer = std::make_unique<transfer_t>();
+        transfer->texture = index;
+        transfer->top = top;
+        tex.transfer = transfer.get();
+        stats_.committed_bytes += tex.sizes[top];
+        g_memory_stats().AddGPU(memory_category::TEXTURE, tex.sizes[top]);
+        io_.Submit([this, t = transfer.get(), name = tex.name, view = tex.view]() { fill(*t, name, view); });
+        transfers_.push_back(std::move(transfer));
+    }
+
+    ComPtr<ID3D12CommandAllocator> acquire_allocator(uint64_t completed) {
+        for (auto& a : allocators_) {
+            if (a.fence_value <= completed) {
+                CHECKHR(a.allocator->Reset());
+                return a.allocator;
+            }
+        }
+        allocator_t a = {nullptr, 0};
+        CHECKHR(device_->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY, IID_PPV_ARGS(&a.allocator)));
+        allocators_.push_back(a);
+        return a.allocator;
+    }
+
+    /* Record every filled transfer into one copy list */
+    void submit(uint64_t completed) {
+        std::vector<transfer_t*> ready;
+        for (auto& t : transfers_) {
+            if (t->fence_value == 0 && t->ready.load(std::memory_order_acquire)) ready.push_back(t.get());
+        }
+        if (ready.empty()) return;
+        auto allocator = acquire_allocator(completed);
+        CHECKHR(copy_list_->Reset(allocator.Get(), nullptr));
+        for (auto* t : ready) {
+            for (uint32_t i = 0; i < t->footprints.size(); ++i) {
+                CD3DX12_TEXTURE_COPY_LOCATION dst(t->resource.Get(), i);
+                CD3DX12_TEXTURE_COPY_LOCATION src(t->upload.Get(), t->footprints[i]);
+                copy_list_->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+            }
+        }
+        CHECKHR(copy_list_->Close());
+        ID3D12CommandList* lists[] = {copy_list_.Get()};
+        copy_queue_->ExecuteCommandLists(1, lists);
+        fence_.Insert(copy_queue_);
+        for (auto* t : ready) t->fence_value = fence_.GetValue();
+        for (auto& a : allocators_) {
+            if (a.allocator == allocator) a.fence_value = fence_.GetValue();
+        }
+    }
+
+    /* Swap in the resources whose copy has finished */
+    void complete(uint64_t completed) {
+        for (auto it = transfers_.begin(); it != transfers_.end();) {
+            transfer_t& t = **it;
+            if (t.fence_value == 0 || t.fence_value > completed) {
+                ++it;
+                continue;
+            }
+            auto& tex = textures_[t.texture];
+            if (tex.resource) {
+                // Frames recorded up to now may still sample the old resource, the one recorded frame_count frames
+                // later has waited for them
+                retired_.push_back({tex.resource, tex.sizes[tex.resident], frame_ + frame_count + 1});
+                stats_.resident_bytes -= tex.sizes[tex.resident];
+                if (t.top < tex.resident) ++stats_.streamed_in;
+                else ++stats_.streamed_out;
+            }
+            tex.resource = t.resource;
+            tex.resident = t.top;
+            tex.transfer = nullptr;
+            stats_.resident_bytes += tex.sizes[t.top];
+            heap_.UpdateTexture(tex.slot, tex.resource.Get(), tex.view.swizzle);
+            g_memory_stats().AddGPU(memory_category::UPLOAD, -static_cast<int64_t>(t.upload_bytes));
+            it = transfers_.erase(it);
+        }
+    }
+
+    uint32_t desired_level(const streamed_texture_t& tex) const {
+        if (frame_ - tex.last_request_frame > param_.evict_frames || tex.screen_pixels <= 0.0f) return tex.lowest;
+        float texels = static_cast<float>(std::max(tex.view.width, tex.view.height));
+        float level = std::floor(std::log2(texels / tex.screen_pixels) + param_.mip_bias);
+        return static_cast<uint32_t>(std::clamp(level, 0.0f, static_cast<float>(tex.lowest)));
+    }
+
+    /* Coarsen the desired levels until they fit the budget, always taking the texture whose desired level has the
+     * most texels per pixel on screen */
+    void fit_budget() {
+        uint64_t wanted = 0;
+        for (auto& tex : textures_) wanted += tex.sizes[tex.desired];
+        stats_.wanted_bytes = wanted;
+        while (wanted > param_.budget_bytes) {
+            streamed_texture_t* worst = nullptr;
+            float worst_ratio = 0.0f;
+            for (auto& tex : textures_) {
+                if (tex.desired >= tex.lowest) continue;
+                float ratio = static_cast<float>(tex.view.levels[tex.desired].width) / std::max(tex.screen_pixels, 1.0f);
+                if (!worst || ratio > worst_ratio) {
+                    worst = &tex;
+                    worst_ratio = ratio;
+                }
+            }
+            if (!worst) break;
+            wanted -= worst->sizes[worst->desired] - worst->sizes[worst->desired + 1];
+            ++worst->desired;
+        }
+    }
+public:
+    DX12TextureStreamer(RenderContext& ctx, ITextureHeap& heap, const stream_param_t& param) : device_(ctx.GetDevice()), resources_(ctx.GetGPUResourceManager()), heap_(heap), param_(param) {
+        fence_.Initialize(device_);
+        D3D12_COMMAND_QUEUE_DESC qd{};
+        qd.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+        CHECKHR(device_->CreateCommandQueue(&qd, IID_PPV_ARGS(&copy_queue_)));
+        copy_queue_->SetName(L"Streaming Copy Queue");
+        auto allocator = acquire_allocator(0);
+        CHECKHR(device_->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY, allocator.Get(), nullptr, IID_PPV_ARGS(&copy_list_)));
+        copy_list_->Close();
+    }
+    DX12TextureStreamer(DX12TextureStreamer&) = delete;
+
+    ~DX12TextureStreamer() {
+        io_.Wait();
+        fence_.Wait();
+        g_memory_stats().AddGPU(memory_category::TEXTURE, -static_cast<int64_t>(stats_.committed_bytes));
+        for (auto& t : transfers_) g_memory_stats().AddGPU(memory_category::UPLOAD, -static_cast<int64_t>(t->upload_bytes));
+    }
+
+    /* Stream view, which must stay valid as long as the streamer. Reserves the texture's SRV slot right away, it reads
+     * zero until the initial levels arrive. Returns the texture id, ids count up from 0 */
+    std::optional<uint32_t> Register(const std::string& name, const texture_view_t& view) {
+        auto slot = heap_.Reserve();
+        if (!slot.has_value() || view.levels.empty()) return std::nullopt;
+        streamed_texture_t tex = {};
+        tex.name = name;
+        tex.view = view;
+        tex.slot = slot.value();
+        const uint32_t level_count = static_cast<uint32_t>(view.levels.size());
+        // Block compressed resources need a top level that is a multiple of 4
+        tex.lowest = 0;
+        for (uint32_t i = 0; i < level_count; ++i) {
+            const auto& level = view.levels[i];
+            if (texture_format_is_block_compressed(view.format) && (level.width % 4 || level.height % 4)) break;
+            tex.lowest = i;
+            if (std::max(level.width, level.height) <= param_.initial_size) break;
+        }
+        tex.resident = level_count;
+        tex.desired = tex.lowest;
+        tex.sizes.resize(level_count);
+        for (uint32_t i = 0; i <= tex.lowest; ++i) {
+            D3D12_RESOURCE_DESC desc = describe(view, i);
+            tex.sizes[i] = device_->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+        }
+        textures_.push_back(std::move(tex));
+        uint32_t index = static_cast<uint32_t>(textures_.size() - 1);
+        start(index, textures_[index].lowest);
+        return index;
+    }
+
+    /* Capture camera state, call once per frame before requesting */
+    void BeginFrame(DX12FreeCamera& camera, const RenderPreset& presets) {
+        camera_position_ = camera.GetCameraPosition();
+        projection_scale_ = camera.GetProjectionScale(presets.height);
+        near_z_ = camera.GetNearZ();
+        for (auto& tex : textures_) tex.screen_pixels = 0.0f;
+    }
+
+    /* Texture id is drawn this frame across an object bounded by the world space sphere (center, radius), assumed to
+     * map the texture once over its diameter */
+    void Request(uint32_t id, float3_t center, float radius) {
+        auto& tex = textures_[id];
+        float dx = center.x - camera_position_.x;
+        float dy = center.y - camera_position_.y;
+        float dz = center.z - camera_position_.z;
+        float distance = std::max(std::sqrt(dx * dx + dy * dy + dz * dz) - radius, near_z_);
+        tex.screen_pixels = std::max(tex.screen_pixels, 2.0f * radius * projection_scale_ / distance);
+        tex.last_request_frame = frame_;
+    }
+
+    /* Finish, submit and start residency changes, call once per frame after the requests and before rendering */
+    void Update() {
+        uint64_t completed = fence_.GetCompletedValue();
+        for (auto it = retired_.begin(); it != retired_.end();) {
+            if (it->release_frame <= frame_) {
+                stats_.committed_bytes -= it->bytes;
+                g_memory_stats().AddGPU(memory_category::TEXTURE, -static_cast<int64_t>(it->bytes));
+                it = retired_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        complete(completed);
+        submit(completed);
+
+        for (auto& tex : textures_) tex.desired = desired_level(tex);
+        fit_budget();
+
+        // Stream out first, the memory they give back lets finer levels in. Within each, the biggest jump goes first
+        std::vector<uint32_t> order;
+        for (uint32_t i = 0; i < textures_.size(); ++i) {
+            const auto& tex = textures_[i];
+            if (!tex.transfer && tex.resident < tex.view.levels.size() && tex.desired != tex.resident) order.push_back(i);
+        }
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            const auto& ta = textures_[a];
+            const auto& tb = textures_[b];
+            int da = static_cast<int>(ta.desired) - static_cast<int>(ta.resident);
+            int db = static_cast<int>(tb.desired) - static_cast<int>(tb.resident);
+            if ((da > 0) != (db > 0)) return da > 0;
+            return std::abs(da) > std::abs(db);
+        });
+        for (uint32_t index : order) {
+            if (transfers_.size() >= param_.max_transfers) break;
+            auto& tex = textures_[index];
+            bool finer = tex.desired < tex.resident;
+            if (finer && stats_.committed_bytes + tex.sizes[tex.desired] > param_.budget_bytes) continue;
+            start(index, tex.desired);
+        }
+        stats_.textures = static_cast<uint32_t>(textures_.size());
+        stats_.transfers = static_cast<uint32_t>(transfers_.size());
+        ++frame_;
+    }
+
+    uint32_t GetSlot(uint32_t id) const {
+        return textures_[id].slot;
+    }
+
+    /* Top level on the GPU, the level count of the view while nothing is */
+    uint32_t GetResidentLevel(uint32_t id) const {
+        return textures_[id].resident;
+    }
+
+    uint32_t GetDesiredLevel(uint32_t id) const {
+        return textures_[id].desired;
+    }
+
+    const stream_stats_t& GetStats() const {
+        return stats_;
+    }
+};
@@ -1,14 +1,22 @@
 #pragma once
 
-#include <Windows.h>
-#include <wrl.h>
-#include <d3d12.h>
-#include <dxgi1_6.h>
-#include <d3dcompiler.h>
-#include <directx/d3dx12.h>
-#include <DirectXMath.h>
+#include <cstdint>
+#include <memory>
 
-using namespace DirectX;
+#ifdef _WIN32
+#include <Windows.h>
+#include "../win32/input.h"
+#else
+// Camera and world math build anywhere, only live input polling needs Win32
+using HWND = void*;
+using WPARAM = uintptr_t;
+#endif
+
+#include "../common/input.h"
+#include "../common/simd_math.h"
+#include "../common/spatial_grid.h"
+#include "../common/transform_system.h"
+#include "../common/scene_hierarchy.h"
 
 class DX12FreeCamera {
 public:
@@ -24,41 +32,67 @@ private:
     float camera_yaw_ = 90.0f;
     float camera_pitch_ = 0.0f;
     float aspect_ratio_;
+    float fov_ = math_pi_div2;
+    float near_z_ = 0.1f;
+    float far_z_ = 100.0f;
 
-    XMFLOAT3 camera_position_ = {0.0f, 0.0f, 0.0f};
-    XMFLOAT3 camera_forward_ = {0.0f, 0.0f, 0.0f};
+    float3_t camera_position_ = {0.0f, 0.0f, 0.0f};
+    float3_t camera_forward_ = {0.0f, 0.0f, 0.0f};
 
     HWND hwnd_;
 
-    bool press_w_ = false;
-    bool press_a_ = false;
-    bool press_d_ = false;
-    bool press_s_ = false;
-    bool press_space_ = false;
-    bool press_shift_ = false;
-    bool is_active_ = true;
+    std::unique_ptr<InputSource> live_input_;
+    InputSource* input_{};
 
-    XMMATRIX vp_{};
+    mat_t vp_{};
 
-    XMMATRIX matrix_apply_View(XMFLOAT3 camera, XMFLOAT3 focus) {
-        return XMMatrixLookAtLH(XMLoadFloat3(&camera), XMLoadFloat3(&focus), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+    mat_t matrix_apply_View(float3_t camera, float3_t focus) {
+        return mat_look_at_lh(vec_load3(camera), vec_load3(focus), vec_set(0.0f, 1.0f, 0.0f, 0.0f));
     }
 
-    XMMATRIX matrix_apply_Projection() {
-        return XMMatrixPerspectiveFovLH(XM_PIDIV2, aspect_ratio_, 0.1f, 100.0f);
+    mat_t matrix_apply_Projection() {
+        return mat_perspective_fov_lh(fov_, aspect_ratio_, near_z_, far_z_);
     }
 
 public:
-    DX12FreeCamera(const free_camera_init_param_t& param) : sensitivity_(param.sensitivity), speed_(param.speed), aspect_ratio_(param.aspect_ratio), hwnd_(param.hwnd) {}
+    DX12FreeCamera(const free_camera_init_param_t& param) : sensitivity_(param.sensitivity), speed_(param.speed), aspect_ratio_(param.aspect_ratio), hwnd_(param.hwnd) {
+#ifdef _WIN32
+        live_input_ = std::make_unique<Win32InputSource>(hwnd_);
+        input_ = live_input_.get();
+#endif
+    }
+
+    /* Live input of the window, null where there is none */
+    InputSource* GetLiveInput() {
+        return live_input_.get();
+    }
+
+    /* Read input from source instead, e.g. an InputRecorder or InputReplayer, or go back to live input with null */
+    void SetInputSource(InputSource* source) {
+        input_ = source ? source : live_input_.get();
+    }
 
-    XMMATRIX& GetViewMatrix() {
+    mat_t& GetViewMatrix() {
         return vp_;
     }
 
-    XMFLOAT3& GetCameraPosition() {
+    float3_t& GetCameraPosition() {
         return camera_position_;
     }
 
+    float GetFieldOfView() const {
+        return fov_;
+    }
+
+    float GetNearZ() const {
+        return near_z_;
+    }
+
+    // Pixels covered by one world unit at distance 1 on a viewport of the given height
+    float GetProjectionScale(uint32_t viewport_height) const {
+        return static_cast<float>(viewport_height) / (2.0f * tanf(fov_ * 0.5f));
+    }
+
     void SetCameraSensitivity(float s) {
         sensitivity_ = s;
     }
@@ -67,83 +101,107 @@ public:
         speed_ = s;
     }
 
-    void OnWindowActive(WPARAM wParam) {
-        if (LOWORD(wParam) == WA_INACTIVE) {
-            is_active_ = false;
-            ShowCursor(TRUE);
-        }
-        else {
-            is_active_ = true;
-            ShowCursor(FALSE);
-        }
+    void OnWindowActive([[maybe_unused]] WPARAM wParam) {
+#ifdef _WIN32
+        bool active = LOWORD(wParam) != WA_INACTIVE;
+        ShowCursor(active ? FALSE : TRUE);
+        if (input_) input_->SetActive(active);
+#endif
     }
 
-    void UpdatePerspective(float delta_ms) {
-        if (delta_ms == 0.0f) return;
-        // Get cursor and calculate pitch and yaw
-        POINT currentPos;
-        GetCursorPos(&currentPos);
-        RECT rect;
-        GetWindowRect(hwnd_, &rect);
-        int centerX = rect.left + (rect.right - rect.left) / 2;
-        int centerY = rect.top + (rect.bottom - rect.top) / 2;
-        float dx = static_cast<float>(currentPos.x - centerX);
-        float dy = static_cast<float>(currentPos.y - centerY);
-        press_w_ = (GetAsyncKeyState('W') & 0x8000) >> 15;
-        press_a_ = (GetAsyncKeyState('A') & 0x8000) >> 15;
-        press_s_ = (GetAsyncKeyState('S') & 0x8000) >> 15;
-        press_d_ = (GetAsyncKeyState('D') & 0x8000) >> 15;
-        press_shift_ = (GetAsyncKeyState(VK_SHIFT) & 0x8000) >> 15;
-        press_space_ = (GetAsyncKeyState(VK_SPACE) & 0x8000) >> 15;
+    /* Poll the input source and move the camera. Returns the delta time actually applied, which is the recorded one
+     * during a replay, or 0 when no input was available */
+    float UpdatePerspective(float delta_ms) {
+        if (delta_ms == 0.0f || !input_) return 0.0f;
+        input_frame_t frame{};
+        if (!input_->Poll(delta_ms, frame)) return 0.0f;
+        ApplyInput(frame);
+        return frame.delta_ms;
+    }
+
+    /* Deterministic part of the update, the same frames always produce the same camera path */
+    void ApplyInput(const input_frame_t& frame) {
+        float dx = static_cast<float>(frame.cursor_dx);
+        float dy = static_cast<float>(frame.cursor_dy);
         if (dx != 0 || dy != 0) {
             // Calculate camera yaw and pitch, limit pitch to (-89, 89)
             camera_yaw_ -= dx * sensitivity_;
             camera_pitch_ += dy * sensitivity_;
             if (camera_pitch_ > 89.0f)  camera_pitch_ = 89.0f;
             if (camera_pitch_ < -89.0f) camera_pitch_ = -89.0f;
-            // Reset cursor position
-            if (is_active_) SetCursorPos(centerX, centerY);
         }
 
-        float r_pitch = XMConvertToRadians(camera_pitch_);
-        float r_yaw = XMConvertToRadians(camera_yaw_);
+        float r_pitch = deg_to_rad(camera_pitch_);
+        float r_yaw = deg_to_rad(camera_yaw_);
         // Transformation from Spherical coordinate system to Cartesian coordinate system
-        XMVECTOR v_fwd = XMVectorSet(cosf(r_pitch) * cosf(r_yaw), -sinf(r_pitch), cosf(r_pitch) * sinf(r_yaw), 0.0f);
+        vec_t v_fwd = vec_set(cosf(r_pitch) * cosf(r_yaw), -sinf(r_pitch), cosf(r_pitch) * sinf(r_yaw), 0.0f);
         // Normalize
-        v_fwd = XMVector3Normalize(v_fwd);
+        v_fwd = vec_normalize3(v_fwd);
         // Calculate precise displacement by delta time between frames
-        auto displacement = speed_ * delta_ms;
-        XMVECTOR v_pos = XMLoadFloat3(&camera_position_);
+        auto displacement = speed_ * frame.delta_ms;
+        vec_t v_pos = vec_load3(camera_position_);
         // Limit y axis when pressed W or S
-        XMVECTOR v_move_fwd = XMVectorSet(XMVectorGetX(v_fwd), 0.0f, XMVectorGetZ(v_fwd), 0.0f);
-        v_move_fwd = XMVector3Normalize(v_move_fwd);
-        XMVECTOR v_up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+        vec_t v_move_fwd = vec_set(vec_get_x(v_fwd), 0.0f, vec_get_z(v_fwd), 0.0f);
+        v_move_fwd = vec_normalize3(v_move_fwd);
+        vec_t v_up = vec_set(0.0f, 1.0f, 0.0f, 0.0f);
         // Use Cross to get the right direction vector
-        XMVECTOR v_right = XMVector3Normalize(XMVector3Cross(v_up, v_move_fwd));
-        if (press_w_) v_pos = XMVectorAdd(v_pos, XMVectorScale(v_move_fwd, displacement));
-        if (press_s_) v_pos = XMVectorSubtract(v_pos, XMVectorScale(v_move_fwd, displacement));
-        if (press_a_) v_pos = XMVectorSubtract(v_pos, XMVectorScale(v_right, displacement));
-        if (press_d_) v_pos = XMVectorAdd(v_pos, XMVectorScale(v_right, displacement));
-        if (press_space_) v_pos = XMVectorAdd(v_pos, XMVectorScale(v_up, displacement));
-        if (press_shift_) v_pos = XMVectorSubtract(v_pos, XMVectorScale(v_up, displacement));
+        vec_t v_right = vec_normalize3(vec_cross3(v_up, v_move_fwd));
+        if (frame.keys & INPUT_KEY_FORWARD) v_pos = vec_add(v_pos, vec_scale(v_move_fwd, displacement));
+        if (frame.keys & INPUT_KEY_BACK) v_pos = vec_sub(v_pos, vec_scale(v_move_fwd, displacement));
+        if (frame.keys & INPUT_KEY_LEFT) v_pos = vec_sub(v_pos, vec_scale(v_right, displacement));
+        if (frame.keys & INPUT_KEY_RIGHT) v_pos = vec_add(v_pos, vec_scale(v_right, displacement));
+        if (frame.keys & INPUT_KEY_UP) v_pos = vec_add(v_pos, vec_scale(v_up, displacement));
+        if (frame.keys & INPUT_KEY_DOWN) v_pos = vec_sub(v_pos, vec_scale(v_up, displacement));
         // Save position and forward vector
-        XMStoreFloat3(&camera_position_, v_pos);
-        XMVECTOR v_focus = XMVectorAdd(v_pos, v_fwd);
-        XMStoreFloat3(&camera_forward_, v_focus);
+        camera_position_ = vec_store3(v_pos);
+        vec_t v_focus = vec_add(v_pos, v_fwd);
+        camera_forward_ = vec_store3(v_focus);
         // Enable block to rotate
-        XMMATRIX view = matrix_apply_View(camera_position_, camera_forward_);
-        XMMATRIX projection = matrix_apply_Projection();
-        vp_ = view * projection;
+        mat_t view = matrix_apply_View(camera_position_, camera_forward_);
+        mat_t projection = matrix_apply_Projection();
+        vp_ = mat_mul(view, projection);
     }
 };
 
 class DX12World {
+private:
+    SpatialHashGrid grid_;
+    TransformSystem transforms_;
+    SceneHierarchy hierarchy_;
 public:
-    DX12World() = default;
-    XMMATRIX GetObjectMatrix(XMFLOAT3 rotation, XMFLOAT3 translation, XMFLOAT3 scaling) {
-        XMMATRIX r = XMMatrixRotationRollPitchYaw(rotation.x, rotation.y, rotation.z);
-        XMMATRIX t = XMMatrixTranslation(translation.x, translation.y, translation.z);
-        XMMATRIX s = XMMatrixScaling(scaling.x, scaling.y, scaling.z);
-        return s * r * t;
+    DX12World(float grid_cell_size = 4.0f) : grid_(grid_cell_size) {}
+
+    /* Register a world space bounding box for spatial queries, the returned id stays valid until UnregisterObject */
+    uint32_t RegisterObject(const aabb_t& bounds) {
+        return grid_.Insert(bounds);
+    }
+
+    void MoveObject(uint32_t id, const aabb_t& bounds) {
+        grid_.Move(id, bounds);
+    }
+
+    void UnregisterObject(uint32_t id) {
+        grid_.Remove(id);
+    }
+
+    SpatialHashGrid& GetSpatialGrid() {
+        return grid_;
+    }
+
+    /* Per-object transforms composed in batches, prefer it over GetObjectMatrix for anything updated every frame */
+    TransformSystem& GetTransforms() {
+        return transforms_;
+    }
+
+    /* Parented nodes such as glTF node trees, world matrices are propagated by SceneHierarchy::Update */
+    SceneHierarchy& GetHierarchy() {
+        return hierarchy_;
+    }
+
+    mat_t GetObjectMatrix(float3_t rotation, float3_t translation, float3_t scaling) {
+        mat_t r = mat_rotation_roll_pitch_yaw(rotation.x, rotation.y, rotation.z);
+        mat_t t = mat_translation(translation.x, translation.y, translation.z);
+        mat_t s = mat_scaling(scaling.x, scaling.y, scaling.z);
+        return mat_mul(mat_mul(s, r), t);
     }
 };
\ No newline at end of file
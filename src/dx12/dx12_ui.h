@@ -68,7 +68,8 @@ public:
 
         std::shared_ptr<Pipeline<DrawCallLayout>> ui_pipeline = dx_app_.GetRenderContext().CreatePipeline<DrawCallLayout>("ui", { 4, 4, 0, dx_app_.GetRenderPresets().enable_msaa_4x });
         D3D12_INPUT_LAYOUT_DESC layout = { ied, _countof(ied) };
-        auto texts_tex = res_mgr_.CreateTexture("texts_tex", sdf.value().width, sdf.value().height, sdf.value().data);
+        auto texts_tex = res_mgr_.CreateTexture("texts_tex", sdf.value().view);
+        tex_mgr_.release_after_upload(std::format("{}_tex.png", font_name), res_mgr_);
         auto text_vertices_res = res_mgr_.CreateVertexBuffer("text_vertices", vertices_.data(), vertices_.size());
         auto text_indices_res = res_mgr_.CreateIndexBuffer("text_indices", indices_.data(), indices_.size());
         auto screen_info = res_mgr_.CreateCBuffer("screen_info", sc_info_);
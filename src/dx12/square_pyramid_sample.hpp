@@ -1,6 +1,9 @@
 #include "dx12_framework.h"
+#include "dx12_lod.h"
+#include "dx12_texture_streaming.h"
 #include "dx12_transformation.h"
 #include "dx12_ui.h"
+#include "../common/ecs.h"
 #include "../win32/window.h"
 
 constexpr double PI = 3.1415926f;
@@ -14,10 +17,6 @@ struct alignas(256) Scene {
     float view_matrix[4][4];
 };
 
-struct alignas(256) World {
-    float world_matrix[2][4][4];
-};
-
 Scene scene {
     .color = {0.7f, 0.7f, 0.7f, 1.0f},
     .light_pos = { 0.5f, 1.0f, 0.0f, 0.0f},
@@ -26,7 +25,15 @@ Scene scene {
     .camera_pos = {0.0f, 0.0f, 0.0f},
 };
 
-World world{};
+// Scene object components, transform is the object's id in DX12World's transform system
+struct TransformRef {
+    uint32_t transform;
+};
+
+struct Spin {
+    float omega;
+    float angle;
+};
 
 struct PyramidVertex {
     float x, y, z;
@@ -39,16 +46,14 @@ void GenerateNormal(std::vector<PyramidVertex>& vertices, std::vector<uint32_t>&
         PyramidVertex& a = vertices[indices[i]];
         PyramidVertex& b = vertices[indices[i + 1]];
         PyramidVertex& c = vertices[indices[i + 2]];
-        XMVECTOR d = XMVectorSet(a.x - b.x, a.y - b.y, a.z - b.z, 0.0f);
-        XMVECTOR e = XMVectorSet(c.x - b.x, c.y - b.y, c.z - b.z, 0.0f);
-        XMVECTOR v_normal = XMVector3Cross(d, e);
-        XMVector3Normalize(v_normal);
-        XMFLOAT3 normal {};
-        XMStoreFloat3(&normal, v_normal);
-
-        memcpy(&a.nx, &normal, sizeof(XMFLOAT3));
-        memcpy(&b.nx, &normal, sizeof(XMFLOAT3));
-        memcpy(&c.nx, &normal, sizeof(XMFLOAT3));
+        vec_t d = vec_set(a.x - b.x, a.y - b.y, a.z - b.z, 0.0f);
+        vec_t e = vec_set(c.x - b.x, c.y - b.y, c.z - b.z, 0.0f);
+        vec_t v_normal = vec_normalize3(vec_cross3(d, e));
+        float3_t normal = vec_store3(v_normal);
+
+        memcpy(&a.nx, &normal, sizeof(float3_t));
+        memcpy(&b.nx, &normal, sizeof(float3_t));
+        memcpy(&c.nx, &normal, sizeof(float3_t));
     }
 }
 
@@ -58,6 +63,25 @@ private:
     DX12UI* ui_{};
     DX12FreeCamera* free_cam_{};
     DX12World* world_{};
+    DX12LODSelector* lod_selector_{};
+    DX12InstanceBuffer* instances_{};
+    DX12MaterialBuffer* materials_{};
+    uint32_t pyramid_instance_{};
+    uint32_t ground_instance_{};
+    EntityRegistry entities_;
+    std::unique_ptr<InputRecorder> input_recorder_;
+    std::unique_ptr<InputReplayer> input_replayer_;
+    // Streamed views point into the manager's cache mappings, it has to outlive the streamer
+    std::unique_ptr<TextureManager> tex_mgr_;
+    std::unique_ptr<DX12TextureStreamer> streamer_;
+
+    using PyramidDrawCallLayout = DrawCallLayout<
+        DrawCallTexturesBinding<0, 32>,
+        DrawCallCBVBinding<0>,
+        DrawCallInstanceBinding<32>,
+        DrawCallMaterialBinding<33>,
+        DrawCallStaticSamplerBinding<0, D3D12_FILTER_MIN_MAG_MIP_LINEAR>
+    >;
 public:
     SqaurePyramidApp(RenderPreset& presets) : DX12Application(presets) {
         window_ = new Win32Window(L"Grek Renderer", WS_OVERLAPPEDWINDOW, presets_.width, presets_.height, this, GameWindowProcess);
@@ -68,7 +92,8 @@ public:
         shader_mgr.load_shaders();
         auto triangle_vs = shader_mgr.get("triangle.vs");
         auto triangle_ps = shader_mgr.get("triangle.ps");
-        TextureManager tex_mgr;
+        tex_mgr_ = std::make_unique<TextureManager>();
+        TextureManager& tex_mgr = *tex_mgr_;
         tex_mgr.load_textures();
         auto basic = tex_mgr.get("basic.jpg");
         auto brick = tex_mgr.get("brick.jpg");
@@ -135,12 +160,6 @@ public:
             { "NORMAL",   0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 20, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
         };
         D3D12_INPUT_LAYOUT_DESC layout = {pyramid_layout, _countof(pyramid_layout)};
-        using PyramidDrawCallLayout = DrawCallLayout<
-            DrawCallTexturesBinding<0, 32>,
-            DrawCallCBVBinding<0>,
-            DrawCallCBVBinding<1>,
-            DrawCallStaticSamplerBinding<0, D3D12_FILTER_MIN_MAG_MIP_LINEAR>
-        >;
         Pipeline<PyramidDrawCallLayout>::pipeline_init_t init = {32, 32, 0, presets.enable_msaa_4x};
         std::shared_ptr<Pipeline<PyramidDrawCallLayout>> default_pipeline = this->render_ctx_.CreatePipeline<PyramidDrawCallLayout>("default", init);
         GPUResourceManager& gr_mgr = this->render_ctx_.GetGPUResourceManager();
@@ -149,14 +168,22 @@ public:
         auto gr_vertices_res = gr_mgr.CreateVertexBuffer("ground_vertices", ground_vertices.data(), ground_vertices.size());
         auto gr_indices_res = gr_mgr.CreateIndexBuffer("ground_indices", ground_indices.data(), ground_indices.size());
         auto scene_res = gr_mgr.CreateCBuffer("scene", scene);
-        auto world_res = gr_mgr.CreateCBuffer("world", world);
-        auto basic_tex = gr_mgr.CreateTexture("pyramid_tex", basic.value().width, basic.value().height, basic.value().data);
-        auto brick_tex = gr_mgr.CreateTexture("brick_tex", brick.value().width, brick.value().height, brick.value().data);
+        instances_ = new DX12InstanceBuffer(gr_mgr, "instances", 65536);
+        pyramid_instance_ = instances_->Allocate(1);
+        ground_instance_ = instances_->Allocate(1);
+        instances_->SetMaterial(pyramid_instance_, 0);
+        instances_->SetMaterial(ground_instance_, 1);
         auto heap = this->render_ctx_.CreateTextureHeap<32>();
-        heap->BindTexture(basic_tex);
-        heap->BindTexture(brick_tex);
-        PyramidDrawCallLayout::Bindings pyramid_bindings(*heap, scene_res, world_res, DrawCallStaticSamplerBinding<0, D3D12_FILTER_MIN_MAG_MIP_LINEAR>());
-        PyramidDrawCallLayout::Bindings ground_bindings(*heap, scene_res, world_res, DrawCallStaticSamplerBinding<0, D3D12_FILTER_MIN_MAG_MIP_LINEAR>());
+        // Registered first, so texture ids and heap slots match the materials
+        streamer_ = std::make_unique<DX12TextureStreamer>(this->render_ctx_, *heap, DX12TextureStreamer::stream_param_t{64ull << 20, 64, 4, 120, 0.0f});
+        streamer_->Register("pyramid_tex", basic.value().view);
+        streamer_->Register("brick_tex", brick.value().view);
+        // Both textures are too large to pack into arrays, their materials sample layer 0 of their own slot
+        materials_ = new DX12MaterialBuffer(gr_mgr, "materials", 32);
+        materials_->Set(0, {streamer_->GetSlot(0), 0, {1.0f, 1.0f}});
+        materials_->Set(1, {streamer_->GetSlot(1), 0, {1.0f, 1.0f}});
+        PyramidDrawCallLayout::Bindings pyramid_bindings(*heap, scene_res, DrawCallInstanceBinding<32>(*instances_, pyramid_instance_), DrawCallMaterialBinding<33>(*materials_), DrawCallStaticSamplerBinding<0, D3D12_FILTER_MIN_MAG_MIP_LINEAR>());
+        PyramidDrawCallLayout::Bindings ground_bindings(*heap, scene_res, DrawCallInstanceBinding<32>(*instances_, ground_instance_), DrawCallMaterialBinding<33>(*materials_), DrawCallStaticSamplerBinding<0, D3D12_FILTER_MIN_MAG_MIP_LINEAR>());
         DrawCall<PyramidDrawCallLayout> py_drawcall(std::move(pyramid_bindings));
         py_drawcall.BindIABuffer(py_vertices_res, py_indices_res, 1);
         DrawCall<PyramidDrawCallLayout> gr_drawcall(std::move(ground_bindings));
@@ -166,26 +193,62 @@ public:
         default_pipeline->BindDrawCall(gr_drawcall);
         default_pipeline->BindVertexShader(triangle_vs.value());
         default_pipeline->BindFragmentShader(triangle_ps.value());
+        default_pipeline->EnableBatching(gr_mgr, "default_batch_instances", 65536);
         default_pipeline->Build();
         ui_ = new DX12UI(*this, "Lanting", tex_mgr, shader_mgr);
         free_cam_ = new DX12FreeCamera({0.001f, 0.1f, static_cast<float>(presets_.width) / static_cast<float>(presets_.height), presets_.hwnd});
+        // GERK_INPUT_REPLAY=file plays a recorded camera path, GERK_INPUT_RECORD=file records one
+        if (const char* replay = std::getenv("GERK_INPUT_REPLAY")) {
+            input_replayer_ = std::make_unique<InputReplayer>(replay);
+            if (!input_replayer_->IsOpen()) LOG_ERROR_CAT(log_category::INPUT, "Failed to open input replay {}", replay);
+            free_cam_->SetInputSource(input_replayer_.get());
+        } else if (const char* record = std::getenv("GERK_INPUT_RECORD")) {
+            input_recorder_ = std::make_unique<InputRecorder>(*free_cam_->GetLiveInput(), record);
+            if (!input_recorder_->IsOpen()) LOG_ERROR_CAT(log_category::INPUT, "Failed to open input record {}", record);
+            free_cam_->SetInputSource(input_recorder_.get());
+        }
         world_ = new DX12World();
+        // Transform ids follow the instance order, so they compose straight into instances from pyramid_instance_
+        entities_.Create(TransformRef{world_->GetTransforms().Add({0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, {1.0f, 1.0f, 1.0f})}, Spin{0.0005f, 0.0f});
+        entities_.Create(TransformRef{world_->GetTransforms().Add({0.0f, 0.0f, 0.0f}, {0.0f, -4.0f, 0.0f}, {1.0f, 1.0f, 1.0f})});
+        lod_selector_ = new DX12LODSelector({1.0f, 0.1f, 0.0f});
     }
-    float theta = 0.0f;
-    float omega = 0.0005f;
-
     virtual void Update(float delta_ms) override {
         window_->set_title(std::format(L"Grek Renderer | {} FPS", fpsc_.fps()));
         ui_->DrawString(std::format(L"Grek渲染器 | {} FPS", fpsc_.fps()), 10, 640, 16);
         auto& mgr = this->render_ctx_.GetGPUResourceManager();
         mgr.ModifyCBuffer("scene", scene);
-        mgr.ModifyCBuffer("world", world);
-        theta += omega * delta_ms;
-        free_cam_->UpdatePerspective(delta_ms);
+        // During a replay the recorded frame time drives the scene as well
+        float frame_ms = free_cam_->UpdatePerspective(delta_ms);
+        if (input_replayer_ && input_replayer_->IsFinished()) {
+            LOG_INFO_CAT(log_category::INPUT, "Input replay finished after {} frames", input_replayer_->GetFrame());
+            PostQuitMessage(0);
+        }
         memcpy(&scene.camera_pos[0], &free_cam_->GetCameraPosition().x, sizeof(float) * 3);
-        XMStoreFloat4x4(reinterpret_cast<XMFLOAT4X4 *>(&world.world_matrix[0]), world_->GetObjectMatrix({0.0f, theta, 0.0f}, {0.0f, 0.0f, 0.0f}, {1.0f, 1.0f, 1.0f}));
-        XMStoreFloat4x4(reinterpret_cast<XMFLOAT4X4 *>(&world.world_matrix[1]), world_->GetObjectMatrix({0.0f, 0.0f, 0.0f}, {0.0f, -4.0f, 0.0f}, {1.0f, 1.0f, 1.0f}));
-        XMStoreFloat4x4(reinterpret_cast<XMFLOAT4X4 *>(&scene.view_matrix), free_cam_->GetViewMatrix());
+        auto& transforms = world_->GetTransforms();
+        entities_.ForEach<Spin, TransformRef>([&](Spin& spin, TransformRef& ref) {
+            spin.angle += spin.omega * frame_ms;
+            transforms.SetRotation(ref.transform, {0.0f, spin.angle, 0.0f});
+        });
+        instances_->ComposeTransforms(world_->GetTransforms(), pyramid_instance_);
+        mat_store(scene.view_matrix, free_cam_->GetViewMatrix());
+        auto default_pipeline = this->render_ctx_.SelectPipeline<PyramidDrawCallLayout>("default");
+        lod_selector_->BeginFrame(*free_cam_, presets_);
+        lod_selector_->Apply(default_pipeline->GetDrawCall(0), {0.0f, 0.0f, 0.0f}, 0.75f);
+        lod_selector_->Apply(default_pipeline->GetDrawCall(1), {0.0f, -4.0f, 0.0f}, 0.71f);
+        auto& lod_stats = lod_selector_->GetStats();
+        ui_->DrawString(std::format(L"Triangles {} / {}", lod_stats.submitted_triangles, lod_stats.full_detail_triangles), 10, 620, 16);
+        auto& batch_stats = default_pipeline->GetBatchStats();
+        ui_->DrawString(std::format(L"Draws {} ({} saved)", batch_stats.api_draws, batch_stats.saved_draws), 10, 600, 16);
+        streamer_->BeginFrame(*free_cam_, presets_);
+        streamer_->Request(0, {0.0f, 0.0f, 0.0f}, 0.75f);
+        streamer_->Request(1, {0.0f, -4.0f, 0.0f}, 0.71f);
+        streamer_->Update();
+        auto& stream_stats = streamer_->GetStats();
+        ui_->DrawString(std::format(L"Textures {:.1f} / {:.1f} MB, mips {} {}", stream_stats.resident_bytes / 1048576.0, stream_stats.wanted_bytes / 1048576.0, streamer_->GetResidentLevel(0), streamer_->GetResidentLevel(1)), 10, 580, 16);
+        auto memory = g_memory_stats().GetTotal();
+        auto texture_memory = g_memory_stats().Get(memory_category::TEXTURE);
+        ui_->DrawString(std::format(L"Memory CPU {:.1f} MB GPU {:.1f} MB, textures {:.1f} / {:.1f} MB", memory.cpu_bytes / 1048576.0, memory.gpu_bytes / 1048576.0, texture_memory.cpu_bytes / 1048576.0, texture_memory.gpu_bytes / 1048576.0), 10, 560, 16);
         ui_->UpdateUI();
     }
     virtual void OnWindowActivate(WPARAM wParam) override {
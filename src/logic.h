@@ -1,8 +1,7 @@
 #pragma once
 #include <atomic>
 #include <chrono>
-#include <DirectXMath.h>
 #include <thread>
 
+#include "common/simd_math.h"
 #include "win32/common.h"
-using namespace DirectX;
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "Windows.h"
+#include "../common/input.h"
+
+/* Live input: cursor offset from the window center and the WASD/space/shift keys. The cursor is recentered every poll
+ * while the window is active */
+class Win32InputSource : public InputSource {
+private:
+    HWND hwnd_;
+    bool is_active_ = true;
+public:
+    Win32InputSource(HWND hwnd) : hwnd_(hwnd) {}
+
+    bool Poll(float delta_ms, input_frame_t& frame) override {
+        POINT currentPos;
+        GetCursorPos(&currentPos);
+        RECT rect;
+        GetWindowRect(hwnd_, &rect);
+        int centerX = rect.left + (rect.right - rect.left) / 2;
+        int centerY = rect.top + (rect.bottom - rect.top) / 2;
+        frame.delta_ms = delta_ms;
+        frame.cursor_dx = static_cast<int16_t>(currentPos.x - centerX);
+        frame.cursor_dy = static_cast<int16_t>(currentPos.y - centerY);
+        frame.keys = 0;
+        if (GetAsyncKeyState('W') & 0x8000) frame.keys |= INPUT_KEY_FORWARD;
+        if (GetAsyncKeyState('A') & 0x8000) frame.keys |= INPUT_KEY_LEFT;
+        if (GetAsyncKeyState('S') & 0x8000) frame.keys |= INPUT_KEY_BACK;
+        if (GetAsyncKeyState('D') & 0x8000) frame.keys |= INPUT_KEY_RIGHT;
+        if (GetAsyncKeyState(VK_SPACE) & 0x8000) frame.keys |= INPUT_KEY_UP;
+        if (GetAsyncKeyState(VK_SHIFT) & 0x8000) frame.keys |= INPUT_KEY_DOWN;
+        // Reset cursor position
+        if ((frame.cursor_dx != 0 || frame.cursor_dy != 0) && is_active_) SetCursorPos(centerX, centerY);
+        return true;
+    }
+
+    void SetActive(bool active) override {
+        is_active_ = active;
+    }
+};
@@ -0,0 +1,75 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "block_compress.h"
+
+// Encode time and PSNR of the top level per format and quality, on one thread and on a pool. Pass an image path to
+// measure real content, cropped to a multiple of 4, otherwise a 1024x1024 synthetic image is used. BC1 is given an
+// opaque copy since its pixels under half alpha decode to transparent black.
+
+int main(int argc, char** argv) {
+    uint32_t width = 1024, height = 1024;
+    std::vector<uint8_t> pixels;
+    if (argc > 1) {
+        int w, h, c;
+        uint8_t* data = stbi_load(argv[1], &w, &h, &c, 4);
+        if (!data) {
+            std::printf("cannot load %s\n", argv[1]);
+            return 1;
+        }
+        width = static_cast<uint32_t>(w) & ~3u;
+        height = static_cast<uint32_t>(h) & ~3u;
+        pixels.resize(static_cast<size_t>(width) * height * 4);
+        for (uint32_t y = 0; y < height; ++y) memcpy(&pixels[static_cast<size_t>(y) * width * 4], data + static_cast<size_t>(y) * w * 4, width * 4);
+        stbi_image_free(data);
+    } else {
+        pixels.resize(static_cast<size_t>(width) * height * 4);
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<float> noise(-6.0f, 6.0f);
+        for (uint32_t y = 0; y < height; ++y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                float u = static_cast<float>(x) / width, v = static_cast<float>(y) / height;
+                float c[4] = {255.0f * u, 255.0f * v, 127.5f + 100.0f * std::sin(u * 40.0f + v * 25.0f), 255.0f - 200.0f * u * v};
+                uint8_t* p = &pixels[(static_cast<size_t>(y) * width + x) * 4];
+                for (int i = 0; i < 4; ++i) p[i] = static_cast<uint8_t>(std::clamp(c[i] + noise(rng), 0.0f, 255.0f));
+            }
+        }
+    }
+    std::vector<uint8_t> opaque = pixels;
+    for (size_t i = 3; i < opaque.size(); i += 4) opaque[i] = 255;
+    texture_view_t view = {texture_format::RGBA8_UNORM, width, height, {{width, height, width * 4, pixels.data()}}};
+    texture_view_t opaque_view = {texture_format::RGBA8_UNORM, width, height, {{width, height, width * 4, opaque.data()}}};
+
+    JobPool pool;
+    std::printf("%ux%u\n", width, height);
+    std::printf("%-6s %-8s %10s %10s %10s\n", "format", "quality", "1 thread", "pool", "psnr");
+    const struct {
+        texture_format format;
+        const char* name;
+    } formats[] = {
+        {texture_format::BC1_UNORM, "BC1"},
+        {texture_format::BC4_UNORM, "BC4"},
+        {texture_format::BC5_UNORM, "BC5"},
+        {texture_format::BC7_UNORM, "BC7"},
+    };
+    const char* quality_names[] = {"fast", "normal", "high"};
+    for (const auto& f : formats) {
+        const texture_view_t& source = f.format == texture_format::BC1_UNORM ? opaque_view : view;
+        for (bc_quality quality : {bc_quality::FAST, bc_quality::NORMAL, bc_quality::HIGH}) {
+            double ms[2];
+            float psnr = 0.0f;
+            for (int p = 0; p < 2; ++p) {
+                auto t0 = std::chrono::steady_clock::now();
+                compressed_texture_t result = compress_texture(source, f.format, quality, p ? &pool : nullptr);
+                ms[p] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+                psnr = texture_psnr(source, result.view);
+            }
+            std::printf("%-6s %-8s %8.1fms %8.1fms %8.2fdB\n", f.name, quality_names[static_cast<uint32_t>(quality)], ms[0], ms[1], psnr);
+        }
+    }
+    std::printf("pool of %u workers and the caller\n", pool.GetWorkerCount());
+}
@@ -0,0 +1,142 @@
+#include <cmath>
+#include <random>
+
+#include "block_compress.h"
+#include "test_util.h"
+
+// Smooth color gradients with some detail and noise, the kind of content the encoders are tuned for
+static std::vector<uint8_t> make_image(uint32_t width, uint32_t height, uint32_t seed) {
+    std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 4);
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> noise(-6.0f, 6.0f);
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            float u = static_cast<float>(x) / width, v = static_cast<float>(y) / height;
+            float c[4] = {
+                255.0f * u,
+                255.0f * v,
+                127.5f + 100.0f * std::sin(u * 9.0f + v * 5.0f),
+                255.0f - 200.0f * u * v,
+            };
+            uint8_t* p = &pixels[(static_cast<size_t>(y) * width + x) * 4];
+            for (int i = 0; i < 4; ++i) p[i] = static_cast<uint8_t>(std::clamp(c[i] + noise(rng), 0.0f, 255.0f));
+        }
+    }
+    return pixels;
+}
+
+int main() {
+    // PSNR of the top level against the source for every format and quality, higher effort never does worse. BC1
+    // gets an opaque copy, its pixels under half alpha would decode to transparent black
+    std::vector<uint8_t> pixels = make_image(64, 64, 1);
+    std::vector<uint8_t> opaque = pixels;
+    for (size_t i = 3; i < opaque.size(); i += 4) opaque[i] = 255;
+    texture_view_t translucent_view = {texture_format::RGBA8_UNORM, 64, 64, {{64, 64, 64 * 4, pixels.data()}}};
+    texture_view_t opaque_view = {texture_format::RGBA8_UNORM, 64, 64, {{64, 64, 64 * 4, opaque.data()}}};
+    const struct {
+        texture_format format;
+        float min_psnr;
+    } formats[] = {
+        {texture_format::BC1_UNORM, 33.0f},
+        {texture_format::BC4_UNORM, 48.0f},
+        {texture_format::BC5_UNORM, 48.0f},
+        {texture_format::BC7_UNORM, 35.0f},
+    };
+    for (const auto& f : formats) {
+        const texture_view_t& view = f.format == texture_format::BC1_UNORM ? opaque_view : translucent_view;
+        float previous = 0.0f;
+        for (bc_quality quality : {bc_quality::FAST, bc_quality::NORMAL, bc_quality::HIGH}) {
+            compressed_texture_t result = compress_texture(view, f.format, quality);
+            float psnr = texture_psnr(view, result.view);
+            std::printf("format %u quality %u psnr %.2f dB\n", static_cast<uint32_t>(f.format), static_cast<uint32_t>(quality), psnr);
+            EXPECT(psnr >= f.min_psnr);
+            EXPECT(psnr >= previous - 0.05f);
+            previous = psnr;
+        }
+    }
+
+    // The job pool splits block rows only, the bytes match a single threaded encode
+    {
+        JobPool pool(2);
+        for (const auto& f : formats) {
+            const texture_view_t& view = f.format == texture_format::BC1_UNORM ? opaque_view : translucent_view;
+            compressed_texture_t serial = compress_texture(view, f.format, bc_quality::NORMAL);
+            compressed_texture_t pooled = compress_texture(view, f.format, bc_quality::NORMAL, &pool);
+            EXPECT(serial.storage == pooled.storage);
+        }
+    }
+
+    // Solid blocks decode to their color within the precision of the format: BC4 exactly, BC1 within 565 rounding
+    // and BC7 within its 7 bit endpoints plus p-bit
+    std::mt19937 rng(2);
+    float worst[3] = {};
+    const texture_format solid_formats[] = {texture_format::BC1_UNORM, texture_format::BC4_UNORM, texture_format::BC7_UNORM};
+    for (int t = 0; t < 500; ++t) {
+        uint8_t color[4] = {static_cast<uint8_t>(rng()), static_cast<uint8_t>(rng()), static_cast<uint8_t>(rng()), static_cast<uint8_t>(rng())};
+        uint8_t solid[16 * 4];
+        for (int i = 0; i < 16; ++i) memcpy(solid + i * 4, color, 4);
+        for (int i = 0; i < 3; ++i) {
+            const texture_format format = solid_formats[i];
+            if (format == texture_format::BC1_UNORM) {
+                for (int p = 0; p < 16; ++p) solid[p * 4 + 3] = 255;
+            } else {
+                for (int p = 0; p < 16; ++p) solid[p * 4 + 3] = color[3];
+            }
+            texture_view_t block = {texture_format::RGBA8_UNORM, 4, 4, {{4, 4, 16, solid}}};
+            compressed_texture_t result = compress_texture(block, format, bc_quality::HIGH);
+            uint8_t decoded[16][4];
+            EXPECT(bc_decode_block(format, result.storage[0].data(), decoded));
+            const uint32_t channels = format == texture_format::BC4_UNORM ? 1 : format == texture_format::BC1_UNORM ? 3 : 4;
+            for (uint32_t p = 0; p < 16; ++p) {
+                for (uint32_t c = 0; c < channels; ++c) worst[i] = std::max(worst[i], std::fabs(static_cast<float>(decoded[p][c]) - solid[p * 4 + c]));
+            }
+        }
+    }
+    std::printf("solid max error bc1 %.0f bc4 %.0f bc7 %.0f\n", worst[0], worst[1], worst[2]);
+    EXPECT(worst[0] <= 4.0f);
+    EXPECT(worst[1] == 0.0f);
+    EXPECT(worst[2] <= 1.0f);
+
+    // Levels smaller than a block take one block each, BC1 keeps pixels under half alpha transparent
+    {
+        uint8_t tiny[16] = {10, 20, 30, 0, 200, 100, 50, 255, 1, 2, 3, 255, 90, 90, 90, 255};
+        texture_view_t small = {texture_format::RGBA8_UNORM, 2, 2, {{2, 2, 8, tiny}, {1, 1, 4, tiny + 4}}};
+        compressed_texture_t bc1 = compress_texture(small, texture_format::BC1_UNORM, bc_quality::NORMAL);
+        EXPECT(bc1.view.levels.size() == 2);
+        EXPECT(bc1.storage[0].size() == 8 && bc1.storage[1].size() == 8);
+        EXPECT(bc1.view.levels[0].row_pitch == 8 && bc1.view.levels[1].row_pitch == 8);
+        uint8_t decoded[16][4];
+        bc_decode_block(texture_format::BC1_UNORM, bc1.storage[0].data(), decoded);
+        EXPECT(decoded[0][3] == 0);
+        EXPECT(decoded[1][3] == 255 && decoded[4][3] == 255 && decoded[5][3] == 255);
+        compressed_texture_t bc7 = compress_texture(small, texture_format::BC7_UNORM, bc_quality::NORMAL);
+        EXPECT(bc_decode_block(texture_format::BC7_UNORM, bc7.storage[1].data(), decoded));
+        for (uint32_t c = 0; c < 4; ++c) EXPECT(std::abs(decoded[0][c] - tiny[4 + c]) <= 1);
+        EXPECT(bc7.storage[0].size() == 16 && bc7.view.levels[1].row_pitch == 16);
+    }
+
+    // float_to_half against known encodings, rounding to nearest even, and a round trip of every finite half
+    EXPECT(float_to_half(0.0f) == 0x0000);
+    EXPECT(float_to_half(-0.0f) == 0x8000);
+    EXPECT(float_to_half(1.0f) == 0x3c00);
+    EXPECT(float_to_half(-2.0f) == 0xc000);
+    EXPECT(float_to_half(65504.0f) == 0x7bff);
+    EXPECT(float_to_half(65520.0f) == 0x7c00);
+    EXPECT(float_to_half(1e10f) == 0x7c00);
+    EXPECT(float_to_half(std::ldexp(1.0f, -24)) == 0x0001);
+    EXPECT(float_to_half(std::ldexp(1.0f, -25)) == 0x0000);
+    EXPECT(float_to_half(std::ldexp(3.0f, -26)) == 0x0001);
+    EXPECT(float_to_half(std::ldexp(1.0f, -14)) == 0x0400);
+    EXPECT(float_to_half(1.0f + std::ldexp(1.0f, -11)) == 0x3c00);
+    EXPECT(float_to_half(1.0f + std::ldexp(3.0f, -11)) == 0x3c02);
+    EXPECT((float_to_half(std::numeric_limits<float>::infinity())) == 0x7c00);
+    EXPECT((float_to_half(std::numeric_limits<float>::quiet_NaN()) & 0x7fff) > 0x7c00);
+    uint32_t mismatches = 0;
+    for (uint32_t h = 0; h < 0x10000; ++h) {
+        if ((h & 0x7c00) == 0x7c00) continue;
+        mismatches += float_to_half(half_to_float(static_cast<uint16_t>(h))) != h;
+    }
+    EXPECT(mismatches == 0);
+
+    return test_exit("bc_test");
+}
@@ -0,0 +1,65 @@
+#include <random>
+
+#include "cull_kernels.h"
+#include "simd_math.h"
+#include "test_util.h"
+
+// Every frustum culling variant the CPU runs must agree with frustum_overlaps_aabb. FMA variants round differently, so
+// boxes touching a plane within a small margin may go either way
+
+static bool near_a_plane(const frustum_t& f, const aabb_t& b) {
+    for (const auto& p : f.planes) {
+        float x = p.a >= 0.0f ? b.max.x : b.min.x;
+        float y = p.b >= 0.0f ? b.max.y : b.min.y;
+        float z = p.c >= 0.0f ? b.max.z : b.min.z;
+        if (std::fabs(p.a * x + p.b * y + p.c * z + p.d) < 1e-3f) return true;
+    }
+    return false;
+}
+
+int main() {
+    mat_t view = mat_look_at_lh(vec_set(0.0f, 5.0f, -20.0f, 0.0f), vec_set(0.0f, 0.0f, 0.0f, 0.0f), vec_set(0.0f, 1.0f, 0.0f, 0.0f));
+    float view_proj[4][4];
+    mat_store(view_proj, mat_mul(view, mat_perspective_fov_lh(1.0f, 16.0f / 9.0f, 0.1f, 80.0f)));
+    const frustum_t frustum = frustum_from_matrix(view_proj);
+
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> position(-60.0f, 60.0f);
+    std::uniform_real_distribution<float> extent(0.0f, 4.0f);
+    // An odd count leaves a tail for every vector width
+    std::vector<aabb_t> boxes(10003);
+    aabb_soa_t soa;
+    for (auto& b : boxes) {
+        b.min = {position(rng), position(rng), position(rng)};
+        b.max = {b.min.x + extent(rng), b.min.y + extent(rng), b.min.z + extent(rng)};
+        soa.push_back(b);
+    }
+
+    std::vector<uint8_t> visible(boxes.size());
+    uint32_t reference_count = 0;
+    for (const auto& b : boxes) reference_count += frustum_overlaps_aabb(frustum, b);
+    EXPECT(reference_count > 0 && reference_count < boxes.size());
+    for (uint32_t l = 0; l < cpu_level_count; ++l) {
+        const auto level = static_cast<cpu_level>(l);
+        if (level > cpu_detect_level()) break;
+        std::fill(visible.begin(), visible.end(), 2);
+        frustum_cull_aabbs.Get(level)(frustum, soa, visible.data());
+        uint32_t mismatches = 0;
+        for (size_t i = 0; i < boxes.size(); ++i) {
+            if (visible[i] != frustum_overlaps_aabb(frustum, boxes[i]) && !near_a_plane(frustum, boxes[i])) ++mismatches;
+        }
+        std::printf("%s: %u mismatches\n", cpu_level_name(level), mismatches);
+        EXPECT(mismatches == 0);
+    }
+
+    // Forcing a level rebinds the dispatched kernel, and never goes above what the CPU supports
+    cpu_force_level(cpu_level::SCALAR);
+    EXPECT(cpu_active_level() == cpu_level::SCALAR);
+    frustum_cull_aabbs(frustum, soa, visible.data());
+    uint32_t scalar_count = 0;
+    for (uint8_t v : visible) scalar_count += v;
+    EXPECT(scalar_count == reference_count);
+    cpu_force_level(cpu_level::AVX512);
+    EXPECT(cpu_active_level() == cpu_detect_level());
+    return test_exit("cull_test");
+}
@@ -0,0 +1,47 @@
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+#include "cull_kernels.h"
+
+// Runs every variant of the dispatched kernels the CPU supports and marks the one bound at startup, GERK_CPU_LEVEL only
+// moves the mark
+
+template<typename Fn>
+static double time_ms(Fn&& fn, int repeat) {
+    fn();
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeat; ++i) fn();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count() / repeat;
+}
+
+int main() {
+    std::printf("detected %s, active %s\n", cpu_level_name(cpu_detect_level()), cpu_level_name(cpu_active_level()));
+    frustum_t frustum{};
+    frustum.planes[0] = {1, 0, 0, 10};
+    frustum.planes[1] = {-1, 0, 0, 10};
+    frustum.planes[2] = {0, 1, 0, 10};
+    frustum.planes[3] = {0, -1, 0, 10};
+    frustum.planes[4] = {0, 0, 1, -1};
+    frustum.planes[5] = {0, 0, -1, 50};
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> position(-40.0f, 60.0f);
+    for (uint32_t count : {1000u, 100000u, 1000000u}) {
+        aabb_soa_t boxes;
+        for (uint32_t i = 0; i < count; ++i) {
+            float3_t p = {position(rng), position(rng), position(rng)};
+            boxes.push_back({p, {p.x + 1.0f, p.y + 2.0f, p.z + 1.0f}});
+        }
+        std::vector<uint8_t> visible(count);
+        const int repeat = std::max(1u, 10000000u / count);
+        double scalar_ms = 0.0;
+        for (uint32_t l = 0; l < cpu_level_count; ++l) {
+            const auto level = static_cast<cpu_level>(l);
+            if (level > cpu_detect_level()) break;
+            auto* kernel = frustum_cull_aabbs.Get(level);
+            double ms = time_ms([&]() { kernel(frustum, boxes, visible.data()); }, repeat);
+            if (level == cpu_level::SCALAR) scalar_ms = ms;
+            std::printf("frustum_cull_aabbs %8u boxes %-7s %9.4f ms %6.2fx%s\n", count, cpu_level_name(level), ms, scalar_ms / ms, level == cpu_active_level() ? "  active" : "");
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#include <chrono>
+#include <cstdio>
+
+#include "ecs.h"
+
+// Iterating and updating 1M entities: position += velocity * dt over every entity holding both, a quarter of them in a
+// second archetype with an extra component. Per entity and per chunk, on one thread and spread over a pool, best of a
+// few passes.
+
+struct position_t {
+    float x, y, z;
+};
+
+struct velocity_t {
+    float x, y, z;
+};
+
+struct health_t {
+    float value;
+};
+
+constexpr uint32_t entity_count = 1000000;
+constexpr int passes = 10;
+
+template<typename F>
+double best_ms(F&& body) {
+    double best = 1e30;
+    for (int p = 0; p < passes; ++p) {
+        auto t0 = std::chrono::steady_clock::now();
+        body();
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+    }
+    return best;
+}
+
+int main() {
+    EntityRegistry registry;
+    auto t0 = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < entity_count; ++i) {
+        position_t p = {static_cast<float>(i), 0.0f, 0.0f};
+        velocity_t v = {1.0f, 0.5f, 0.25f};
+        if (i % 4) registry.Create(p, v);
+        else registry.Create(p, v, health_t{100.0f});
+    }
+    double create_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    const float dt = 1.0f / 60.0f;
+    auto step = [dt](position_t& p, velocity_t& v) {
+        p.x += v.x * dt; p.y += v.y * dt; p.z += v.z * dt;
+    };
+    auto step_chunk = [dt](uint32_t count, entity_t*, position_t* p, velocity_t* v) {
+        for (uint32_t i = 0; i < count; ++i) {
+            p[i].x += v[i].x * dt; p[i].y += v[i].y * dt; p[i].z += v[i].z * dt;
+        }
+    };
+    JobPool pool;
+    double for_each = best_ms([&] { registry.ForEach<position_t, velocity_t>(step); });
+    double for_each_chunk = best_ms([&] { registry.ForEachChunk<position_t, velocity_t>(step_chunk); });
+    double parallel = best_ms([&] { registry.ParallelForEach<position_t, velocity_t>(pool, step); });
+    double parallel_chunk = best_ms([&] { registry.ParallelForEachChunk<position_t, velocity_t>(pool, step_chunk); });
+
+    float checksum = 0.0f;
+    registry.ForEach<position_t>([&](position_t& p) { checksum += p.y; });
+    std::printf("%u entities in %u archetypes, created in %.1fms\n", registry.GetEntityCount(), registry.GetArchetypeCount(), create_ms);
+    std::printf("%-22s %8s %10s\n", "update", "ms", "ns/entity");
+    std::printf("%-22s %8.2f %10.2f\n", "ForEach", for_each, for_each * 1e6 / entity_count);
+    std::printf("%-22s %8.2f %10.2f\n", "ForEachChunk", for_each_chunk, for_each_chunk * 1e6 / entity_count);
+    std::printf("%-22s %8.2f %10.2f\n", "ParallelForEach", parallel, parallel * 1e6 / entity_count);
+    std::printf("%-22s %8.2f %10.2f\n", "ParallelForEachChunk", parallel_chunk, parallel_chunk * 1e6 / entity_count);
+    std::printf("pool of %u workers and the caller, checksum %g\n", pool.GetWorkerCount(), checksum);
+}
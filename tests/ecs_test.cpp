@@ -0,0 +1,160 @@
+#include <stdexcept>
+#include <utility>
+
+#include "ecs.h"
+#include "test_util.h"
+
+// Structural changes of EntityRegistry: components added and removed move entities between archetypes with their
+// values, destroying swaps the archetype's last row into the hole, and CommandBuffer changes only land at Sync
+
+struct position_t {
+    float x, y, z;
+};
+
+struct velocity_t {
+    float x, y, z;
+};
+
+struct tag_t {
+    uint32_t id;
+};
+
+template<int N>
+struct extra_t {
+    int value;
+};
+
+// Registers extra_t<0..N-1> and returns how many registered before one threw
+template<int... Ns>
+static int register_extras(EntityRegistry& registry, std::integer_sequence<int, Ns...>) {
+    int registered = 0;
+    bool threw = false;
+    auto one = [&]<int N>() {
+        if (threw) return;
+        try {
+            registry.Destroy(registry.Create(extra_t<N>{N}));
+            ++registered;
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+    };
+    (one.template operator()<Ns>(), ...);
+    return registered;
+}
+
+int main() {
+    EntityRegistry registry;
+
+    // Enough entities for several chunks per archetype, tag_t remembers the creation order
+    constexpr uint32_t count = 3000;
+    std::vector<entity_t> entities;
+    for (uint32_t i = 0; i < count; ++i) {
+        entities.push_back(i % 2 ? registry.Create(position_t{float(i), 0, 0}, tag_t{i}) : registry.Create(position_t{float(i), 0, 0}, velocity_t{1, 2, 3}, tag_t{i}));
+    }
+    EXPECT(registry.GetEntityCount() == count);
+    EXPECT(registry.GetArchetypeCount() == 2);
+    uint32_t moving = 0, placed = 0;
+    registry.ForEach<position_t, velocity_t>([&](position_t&, velocity_t&) { ++moving; });
+    registry.ForEach<position_t>([&](position_t&) { ++placed; });
+    EXPECT(moving == count / 2 && placed == count);
+
+    // Add moves the entity to the archetype with the extra component and keeps its other values, Remove moves it back
+    entity_t e = entities[1];
+    EXPECT(!registry.Has<velocity_t>(e));
+    registry.Add(e, velocity_t{4, 5, 6});
+    EXPECT(registry.Has<velocity_t>(e) && registry.Get<velocity_t>(e).z == 6.0f);
+    EXPECT(registry.Get<position_t>(e).x == 1.0f && registry.Get<tag_t>(e).id == 1);
+    registry.Remove<position_t>(e);
+    EXPECT(!registry.Has<position_t>(e) && registry.Has<velocity_t>(e) && registry.Get<tag_t>(e).id == 1);
+    EXPECT(registry.GetArchetypeCount() == 3);
+    registry.Add(e, position_t{7, 8, 9});
+    registry.Remove<velocity_t>(e);
+    EXPECT(registry.Get<position_t>(e).x == 7.0f && registry.Get<tag_t>(e).id == 1 && !registry.Has<velocity_t>(e));
+    registry.Get<position_t>(e).x = 1.0f;
+
+    // Destroying from the front, the middle and the end keeps every other entity's values reachable
+    std::vector<bool> alive(count, true);
+    for (uint32_t i = 0; i < count; i += 7) {
+        registry.Destroy(entities[i]);
+        alive[i] = false;
+    }
+    registry.Destroy(entities[count - 1]);
+    alive[count - 1] = false;
+    registry.Destroy(entities[0]);
+    uint32_t wrong = 0, live = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        EXPECT(registry.IsAlive(entities[i]) == alive[i]);
+        if (!alive[i]) continue;
+        ++live;
+        wrong += registry.Get<tag_t>(entities[i]).id != i || registry.Get<position_t>(entities[i]).x != float(i);
+        wrong += registry.Has<velocity_t>(entities[i]) != (i % 2 == 0);
+    }
+    EXPECT(wrong == 0);
+    EXPECT(registry.GetEntityCount() == live);
+    uint32_t visited = 0;
+    registry.ForEach<tag_t>([&](tag_t& t) { visited += alive[t.id]; });
+    EXPECT(visited == live);
+
+    // A freed index is reused with a new generation, the old handle stays dead
+    entity_t reused = registry.Create(tag_t{count});
+    EXPECT(reused.index == entities[count - 1].index || !alive[reused.index]);
+    EXPECT(registry.IsAlive(reused));
+    for (uint32_t i = 0; i < count; ++i) {
+        if (!alive[i] && entities[i].index == reused.index) EXPECT(!registry.IsAlive(entities[i]));
+    }
+    registry.Destroy(reused);
+
+    // Commands recorded while iterating, here from several threads, change nothing until Sync applies them in order
+    {
+        JobPool pool(3);
+        EntityRegistry::CommandBuffer commands;
+        registry.ParallelForEachChunk<tag_t>(pool, [&](uint32_t n, entity_t* ents, tag_t* tags) {
+            for (uint32_t i = 0; i < n; ++i) {
+                uint32_t id = tags[i].id;
+                if (id % 5 == 1) commands.Destroy(ents[i]);
+                else if (id % 5 == 2) commands.Add(ents[i], velocity_t{0, 0, float(id)});
+                else if (id % 5 == 3 && id % 2 == 0) commands.Remove<velocity_t>(ents[i]);
+            }
+        });
+        commands.Create(position_t{-1, 0, 0}, tag_t{count + 1});
+        const uint32_t before = registry.GetEntityCount();
+        EXPECT(before == live && registry.IsAlive(entities[1]) && !registry.Has<velocity_t>(entities[17]));
+        commands.Sync(registry);
+        uint32_t destroyed = 0;
+        wrong = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+            if (!alive[i]) continue;
+            if (i % 5 == 1) {
+                wrong += registry.IsAlive(entities[i]);
+                ++destroyed;
+                alive[i] = false;
+                continue;
+            }
+            bool has_velocity = i % 5 == 2 || (i % 2 == 0 && i % 5 != 3);
+            wrong += registry.Has<velocity_t>(entities[i]) != has_velocity;
+            if (i % 5 == 2) wrong += registry.Get<velocity_t>(entities[i]).z != float(i);
+            wrong += registry.Get<tag_t>(entities[i]).id != i;
+        }
+        EXPECT(wrong == 0);
+        EXPECT(registry.GetEntityCount() == before - destroyed + 1);
+        uint32_t created = 0;
+        registry.ForEach<position_t, tag_t>([&](position_t& p, tag_t& t) { created += t.id == count + 1 && p.x == -1.0f; });
+        EXPECT(created == 1);
+
+        // A second Sync has nothing left to apply
+        commands.Sync(registry);
+        EXPECT(registry.GetEntityCount() == before - destroyed + 1);
+
+        // Parallel iteration visits every entity once
+        std::atomic<uint32_t> parallel{0};
+        registry.ParallelForEach<tag_t>(pool, [&](tag_t&) { parallel.fetch_add(1, std::memory_order_relaxed); });
+        EXPECT(parallel.load() == registry.GetEntityCount());
+    }
+
+    // Signatures hold 64 component types, the next one throws
+    int registered = register_extras(registry, std::make_integer_sequence<int, 64>());
+    EXPECT(registered == 64 - 3);
+    EXPECT(registry.Get<tag_t>(entities[3]).id == 3);
+
+    return test_exit("ecs_test");
+}
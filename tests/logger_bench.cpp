@@ -0,0 +1,46 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "logger.h"
+
+// Cost per call on the calling thread of a LOG_INFO whose arguments are copied raw, one whose argument is formatted on
+// the caller (a duration is neither arithmetic nor a string) and log_print. Each round times a burst of calls and
+// then sleeps so the writer thread drains the ring, the best round is reported so a writer preempting the caller on a
+// busy machine does not count. Lines go to stdout, run with >/dev/null.
+
+constexpr int burst = 32;
+constexpr int rounds = 200;
+
+template<typename F>
+double best_ns_per_call(F&& body) {
+    double best = 1e30;
+    for (int r = 0; r < rounds; ++r) {
+        auto t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < burst; ++i) body(i);
+        best = std::min(best, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count());
+        std::this_thread::sleep_for(std::chrono::milliseconds(3));
+    }
+    return best / burst;
+}
+
+int main() {
+    const std::string name = "mesh_042";
+    log_init("/dev/null");
+    double deferred = best_ns_per_call([&](int i) {
+        LOG_INFO("uploaded {} bytes for {} in {} ms", i * 64, name, 0.25f);
+    });
+    double eager = best_ns_per_call([&](int i) {
+        LOG_INFO("uploaded {} bytes for {} in {}", i * 64, name, std::chrono::microseconds(250));
+    });
+    double print = best_ns_per_call([&](int i) {
+        log_print("INFO", CLR_INFO, __FILE__, __FUNCTION__, __LINE__, "uploaded {} bytes for {} in {} ms", i * 64, name, 0.25f);
+    });
+    log_close();
+    std::fprintf(stderr, "%-10s %10s\n", "call", "ns/call");
+    std::fprintf(stderr, "%-10s %10.1f\n", "deferred", deferred);
+    std::fprintf(stderr, "%-10s %10.1f\n", "eager", eager);
+    std::fprintf(stderr, "%-10s %10.1f\n", "log_print", print);
+}
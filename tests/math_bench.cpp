@@ -0,0 +1,85 @@
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "cpu_dispatch.h"
+#include "simd_math.h"
+
+// Throughput of the simd_math.h backend this file is built for, see tests/CMakeLists.txt: matrix multiply,
+// quaternion to matrix, world matrices composed like DX12Transformation::GetObjectMatrix and camera matrices composed
+// like DX12FreeCamera. Every operation runs over the same batch, results are stored so nothing is optimized out and
+// the best of a few passes is reported.
+
+constexpr size_t batch = 100000;
+constexpr int passes = 5;
+
+template<typename F>
+double best_ns_per_item(F&& body) {
+    double best = 1e30;
+    for (int p = 0; p < passes; ++p) {
+        auto t0 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < batch; ++i) body(i);
+        best = std::min(best, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count());
+    }
+    return best / batch;
+}
+
+int main() {
+#if defined(SIMD_MATH_AVX2)
+    const char* backend = "avx2";
+    if (cpu_detect_level() < cpu_level::AVX2) {
+        std::printf("avx2 not supported by this CPU\n");
+        return 0;
+    }
+#elif defined(SIMD_MATH_SSE4)
+    const char* backend = "sse4";
+#else
+    const char* backend = "scalar";
+#endif
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> value(-4.0f, 4.0f);
+    std::uniform_real_distribution<float> angle(-3.0f, 3.0f);
+    std::vector<float4x4_t> a(batch), b(batch), out(batch);
+    std::vector<float3_t> rotation(batch), translation(batch), scaling(batch);
+    std::vector<float> quats(batch * 4);
+    for (size_t i = 0; i < batch; ++i) {
+        for (int r = 0; r < 4; ++r) {
+            for (int c = 0; c < 4; ++c) {
+                a[i].m[r][c] = value(rng);
+                b[i].m[r][c] = value(rng);
+            }
+        }
+        rotation[i] = {angle(rng), angle(rng), angle(rng)};
+        translation[i] = {value(rng), value(rng), value(rng)};
+        scaling[i] = {value(rng), value(rng), value(rng)};
+        vec_store4(&quats[i * 4], quat_rotation_roll_pitch_yaw(rotation[i].x, rotation[i].y, rotation[i].z));
+    }
+
+    double mul = best_ns_per_item([&](size_t i) {
+        mat_store(out[i].m, mat_mul(mat_load(a[i].m), mat_load(b[i].m)));
+    });
+    double quat = best_ns_per_item([&](size_t i) {
+        mat_store(out[i].m, mat_rotation_quaternion(vec_load4(&quats[i * 4])));
+    });
+    double world = best_ns_per_item([&](size_t i) {
+        mat_t r = mat_rotation_roll_pitch_yaw(rotation[i].x, rotation[i].y, rotation[i].z);
+        mat_t t = mat_translation(translation[i].x, translation[i].y, translation[i].z);
+        mat_t s = mat_scaling(scaling[i].x, scaling[i].y, scaling[i].z);
+        mat_store(out[i].m, mat_mul(mat_mul(s, r), t));
+    });
+    double camera = best_ns_per_item([&](size_t i) {
+        const float3_t& eye = translation[i];
+        mat_t view = mat_look_at_lh(vec_set(eye.x, eye.y, eye.z, 0.0f), vec_set(0.0f, 0.0f, 0.0f, 0.0f), vec_set(0.0f, 1.0f, 0.0f, 0.0f));
+        mat_store(out[i].m, mat_mul(view, mat_perspective_fov_lh(1.0f, 16.0f / 9.0f, 0.1f, 1000.0f)));
+    });
+
+    float checksum = 0.0f;
+    for (const auto& m : out) checksum += m.m[3][2];
+    std::printf("%s backend, %zu items, ns per item\n", backend, batch);
+    std::printf("%-22s %8.2f\n", "mat_mul", mul);
+    std::printf("%-22s %8.2f\n", "quaternion to matrix", quat);
+    std::printf("%-22s %8.2f\n", "world matrix", world);
+    std::printf("%-22s %8.2f\n", "camera matrix", camera);
+    std::printf("checksum %g\n", checksum);
+}
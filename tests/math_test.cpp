@@ -0,0 +1,134 @@
+#include <random>
+
+#include "cpu_dispatch.h"
+#include "simd_math.h"
+#include "test_util.h"
+
+// Checks simd_math.h against a double precision reference using the DirectXMath conventions it documents. Built once
+// per backend, see tests/CMakeLists.txt
+
+using ref_mat_t = double[4][4];
+
+static void ref_mul(const ref_mat_t& a, const ref_mat_t& b, ref_mat_t& r) {
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            r[i][j] = 0.0;
+            for (int k = 0; k < 4; ++k) r[i][j] += a[i][k] * b[k][j];
+        }
+    }
+}
+
+static void ref_rotation_x(double a, ref_mat_t& r) {
+    double c = std::cos(a), s = std::sin(a);
+    double m[4][4] = {{1, 0, 0, 0}, {0, c, s, 0}, {0, -s, c, 0}, {0, 0, 0, 1}};
+    std::copy(&m[0][0], &m[0][0] + 16, &r[0][0]);
+}
+
+static void ref_rotation_y(double a, ref_mat_t& r) {
+    double c = std::cos(a), s = std::sin(a);
+    double m[4][4] = {{c, 0, -s, 0}, {0, 1, 0, 0}, {s, 0, c, 0}, {0, 0, 0, 1}};
+    std::copy(&m[0][0], &m[0][0] + 16, &r[0][0]);
+}
+
+static void ref_rotation_z(double a, ref_mat_t& r) {
+    double c = std::cos(a), s = std::sin(a);
+    double m[4][4] = {{c, s, 0, 0}, {-s, c, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}};
+    std::copy(&m[0][0], &m[0][0] + 16, &r[0][0]);
+}
+
+static double max_error(const mat_t& m, const ref_mat_t& ref) {
+    float out[4][4];
+    mat_store(out, m);
+    double error = 0.0;
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) error = std::max(error, std::fabs(out[i][j] - ref[i][j]));
+    }
+    return error;
+}
+
+int main() {
+#if defined(SIMD_MATH_AVX2)
+    const char* backend = "math_test avx2";
+    if (cpu_detect_level() < cpu_level::AVX2) return test_skipped;
+#elif defined(SIMD_MATH_SSE4)
+    const char* backend = "math_test sse4";
+#else
+    const char* backend = "math_test scalar";
+#endif
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> value(-4.0f, 4.0f);
+    std::uniform_real_distribution<float> angle(-3.0f, 3.0f);
+
+    for (int round = 0; round < 1000; ++round) {
+        float a[4][4], b[4][4];
+        ref_mat_t ra, rb, rr;
+        for (int i = 0; i < 16; ++i) {
+            ra[i / 4][i % 4] = a[i / 4][i % 4] = value(rng);
+            rb[i / 4][i % 4] = b[i / 4][i % 4] = value(rng);
+        }
+        ref_mul(ra, rb, rr);
+        EXPECT(max_error(mat_mul(mat_load(a), mat_load(b)), rr) < 1e-4);
+
+        ref_mat_t rt;
+        for (int i = 0; i < 16; ++i) rt[i % 4][i / 4] = a[i / 4][i % 4];
+        EXPECT(max_error(mat_transpose(mat_load(a)), rt) == 0.0);
+
+        // Row vector times matrix
+        float v[4] = {value(rng), value(rng), value(rng), value(rng)};
+        float out[4];
+        vec_store4(out, vec_transform(vec_load4(v), mat_load(a)));
+        for (int j = 0; j < 4; ++j) {
+            double ref = 0.0;
+            for (int k = 0; k < 4; ++k) ref += v[k] * ra[k][j];
+            EXPECT_NEAR(out[j], ref, 1e-4);
+        }
+
+        // Roll around z, then pitch around x, then yaw around y
+        float pitch = angle(rng), yaw = angle(rng), roll = angle(rng);
+        ref_mat_t rx, ry, rz, rzx, rot;
+        ref_rotation_x(pitch, rx);
+        ref_rotation_y(yaw, ry);
+        ref_rotation_z(roll, rz);
+        ref_mul(rz, rx, rzx);
+        ref_mul(rzx, ry, rot);
+        EXPECT(max_error(mat_rotation_roll_pitch_yaw(pitch, yaw, roll), rot) < 1e-5);
+
+        // quat_mul(a, b) rotates by a, then by b
+        vec_t qa = quat_rotation_roll_pitch_yaw(pitch, 0.0f, 0.0f);
+        vec_t qb = quat_rotation_roll_pitch_yaw(0.0f, yaw, roll);
+        ref_mat_t ma, mb, mab;
+        ref_rotation_x(pitch, ma);
+        ref_mul(rz, ry, mb);
+        ref_mul(ma, mb, mab);
+        EXPECT(max_error(mat_rotation_quaternion(quat_mul(qa, qb)), mab) < 1e-5);
+
+        vec_t x = vec_set(value(rng), value(rng), value(rng), 0.0f);
+        vec_t y = vec_set(value(rng), value(rng), value(rng), 0.0f);
+        float3_t c = vec_store3(vec_cross3(x, y));
+        float3_t p = vec_store3(x), q = vec_store3(y);
+        EXPECT_NEAR(c.x, static_cast<double>(p.y) * q.z - static_cast<double>(p.z) * q.y, 1e-4);
+        EXPECT_NEAR(c.y, static_cast<double>(p.z) * q.x - static_cast<double>(p.x) * q.z, 1e-4);
+        EXPECT_NEAR(c.z, static_cast<double>(p.x) * q.y - static_cast<double>(p.y) * q.x, 1e-4);
+        EXPECT_NEAR(vec_length3(vec_normalize3(x)), 1.0, 1e-6);
+    }
+    EXPECT(vec_length3(vec_normalize3(vec_splat(0.0f))) == 0.0f);
+
+    // Camera matrices, the vertical field of view and depth range of D3D
+    mat_t proj = mat_perspective_fov_lh(1.2f, 1.5f, 0.1f, 100.0f);
+    double h = 1.0 / std::tan(0.6), range = 100.0 / (100.0 - 0.1);
+    ref_mat_t rproj = {{h / 1.5, 0, 0, 0}, {0, h, 0, 0}, {0, 0, range, 1}, {0, 0, -range * 0.1, 0}};
+    EXPECT(max_error(proj, rproj) < 1e-5);
+
+    mat_t view = mat_look_at_lh(vec_set(1.0f, 2.0f, -5.0f, 0.0f), vec_set(0.0f, 0.0f, 0.0f, 0.0f), vec_set(0.0f, 1.0f, 0.0f, 0.0f));
+    float eye_in_view[4];
+    vec_store4(eye_in_view, vec_transform(vec_set(1.0f, 2.0f, -5.0f, 1.0f), view));
+    EXPECT_NEAR(eye_in_view[0], 0.0, 1e-5);
+    EXPECT_NEAR(eye_in_view[1], 0.0, 1e-5);
+    EXPECT_NEAR(eye_in_view[2], 0.0, 1e-5);
+    float focus_in_view[4];
+    vec_store4(focus_in_view, vec_transform(vec_set(0.0f, 0.0f, 0.0f, 1.0f), view));
+    EXPECT_NEAR(focus_in_view[0], 0.0, 1e-5);
+    EXPECT_NEAR(focus_in_view[1], 0.0, 1e-5);
+    EXPECT_NEAR(focus_in_view[2], std::sqrt(30.0), 1e-5);
+    return test_exit(backend);
+}
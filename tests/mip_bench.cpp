@@ -0,0 +1,31 @@
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+#include "mip_generator.h"
+
+// Time of a full mip chain for large RGBA8 sources, per filter, with and without sRGB and on one thread or a pool
+
+int main() {
+    JobPool pool;
+    std::printf("%-10s %-8s %-6s %10s %10s\n", "size", "filter", "srgb", "1 thread", "pool");
+    for (uint32_t size : {1024u, 4096u}) {
+        std::vector<uint8_t> pixels(static_cast<size_t>(size) * size * 4);
+        std::mt19937 rng(1);
+        for (auto& b : pixels) b = static_cast<uint8_t>(rng());
+        texture_view_t view = {texture_format::RGBA8_UNORM, size, size, {{size, size, size * 4, pixels.data()}}};
+        for (mip_filter filter : {mip_filter::BOX, mip_filter::KAISER}) {
+            for (bool srgb : {false, true}) {
+                double ms[2];
+                for (int p = 0; p < 2; ++p) {
+                    generate_mips(view, {filter, srgb, 0}, p ? &pool : nullptr);
+                    auto t0 = std::chrono::steady_clock::now();
+                    generate_mips(view, {filter, srgb, 0}, p ? &pool : nullptr);
+                    ms[p] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+                }
+                std::printf("%4ux%-5u %-8s %-6s %8.1fms %8.1fms\n", size, size, filter == mip_filter::BOX ? "box" : "kaiser", srgb ? "yes" : "no", ms[0], ms[1]);
+            }
+        }
+    }
+    std::printf("pool of %u workers and the caller\n", pool.GetWorkerCount());
+}
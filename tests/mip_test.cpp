@@ -0,0 +1,132 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <random>
+
+#include "mip_generator.h"
+#include "test_util.h"
+
+// Allocations are tracked to check generate_mips_peak_bytes against what generate_mips really holds
+static std::atomic<int64_t> g_live_bytes{0};
+static std::atomic<int64_t> g_peak_bytes{0};
+
+void* operator new(size_t size) {
+    auto* p = static_cast<size_t*>(std::malloc(size + sizeof(size_t) * 2));
+    if (!p) throw std::bad_alloc();
+    p[0] = size;
+    int64_t live = g_live_bytes.fetch_add(static_cast<int64_t>(size)) + static_cast<int64_t>(size);
+    int64_t peak = g_peak_bytes.load();
+    while (live > peak && !g_peak_bytes.compare_exchange_weak(peak, live)) {}
+    return p + 2;
+}
+
+void operator delete(void* p) noexcept {
+    if (!p) return;
+    auto* base = static_cast<size_t*>(p) - 2;
+    g_live_bytes.fetch_sub(static_cast<int64_t>(base[0]));
+    std::free(base);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    operator delete(p);
+}
+
+static texture_view_t make_view(texture_format format, uint32_t width, uint32_t height, std::vector<uint8_t>& pixels) {
+    return {format, width, height, {{width, height, texture_row_bytes(format, width), pixels.data()}}};
+}
+
+int main() {
+    // A constant image stays constant down the chain for both filters and color spaces, 37x12 ends at 1x1 in 6 levels
+    for (mip_filter filter : {mip_filter::BOX, mip_filter::KAISER}) {
+        for (bool srgb : {false, true}) {
+            std::vector<uint8_t> pixels(37 * 12 * 4);
+            for (size_t i = 0; i < pixels.size(); i += 4) {
+                pixels[i] = 200; pixels[i + 1] = 17; pixels[i + 2] = 99; pixels[i + 3] = 128;
+            }
+            mip_chain_t chain = generate_mips(make_view(texture_format::RGBA8_UNORM, 37, 12, pixels), {filter, srgb, 0});
+            EXPECT(chain.view.levels.size() == 6);
+            EXPECT(chain.view.levels[1].width == 18 && chain.view.levels[1].height == 6);
+            EXPECT(chain.view.levels.back().width == 1 && chain.view.levels.back().height == 1);
+            uint32_t changed = 0;
+            for (const auto& level : chain.view.levels) {
+                for (uint32_t i = 0; i < level.width * level.height * 4; i += 4) {
+                    changed += level.data[i] != 200 || level.data[i + 1] != 17 || level.data[i + 2] != 99 || level.data[i + 3] != 128;
+                }
+            }
+            EXPECT(changed == 0);
+        }
+    }
+
+    // A black and white checkerboard averages to 50% linear light, 188 in sRGB, instead of 128
+    {
+        std::vector<uint8_t> pixels(64 * 64 * 4);
+        for (uint32_t i = 0; i < 64 * 64; ++i) {
+            uint8_t c = ((i % 64 + i / 64) & 1) ? 255 : 0;
+            pixels[i * 4] = pixels[i * 4 + 1] = pixels[i * 4 + 2] = c;
+            pixels[i * 4 + 3] = 255;
+        }
+        auto view = make_view(texture_format::RGBA8_UNORM, 64, 64, pixels);
+        mip_chain_t srgb = generate_mips(view, {mip_filter::BOX, true, 0});
+        mip_chain_t linear = generate_mips(view, {mip_filter::BOX, false, 0});
+        EXPECT_NEAR(srgb.view.levels[1].data[0], 188, 1);
+        EXPECT_NEAR(srgb.view.levels[6].data[0], 188, 1);
+        EXPECT_NEAR(linear.view.levels[1].data[0], 128, 1);
+        EXPECT(srgb.view.levels[1].data[3] == 255);
+    }
+
+    // Single and two channel formats, and half floats above 1
+    {
+        std::vector<uint8_t> r8(20 * 20, 77), rg8(20 * 20 * 2, 0);
+        for (size_t i = 0; i < rg8.size(); i += 2) {
+            rg8[i] = 10; rg8[i + 1] = 250;
+        }
+        mip_chain_t r = generate_mips(make_view(texture_format::R8_UNORM, 20, 20, r8), {mip_filter::KAISER, true, 0});
+        mip_chain_t rg = generate_mips(make_view(texture_format::RG8_UNORM, 20, 20, rg8), {mip_filter::KAISER, true, 0});
+        EXPECT(r.view.levels.back().data[0] == 77);
+        EXPECT(rg.view.levels.back().data[0] == 10 && rg.view.levels.back().data[1] == 250);
+        std::vector<uint8_t> half(16 * 16 * 2);
+        for (size_t i = 0; i < half.size(); i += 2) {
+            uint16_t h = float_to_half(3.5f);
+            memcpy(&half[i], &h, 2);
+        }
+        mip_chain_t f = generate_mips(make_view(texture_format::R16_FLOAT, 16, 16, half), {mip_filter::BOX, false, 3});
+        EXPECT(f.view.levels.size() == 3);
+        uint16_t h;
+        memcpy(&h, f.view.levels.back().data, 2);
+        EXPECT_NEAR(half_to_float(h), 3.5, 1e-3);
+    }
+
+    // Rows split over a pool give the same bytes as one thread
+    std::mt19937 rng(5);
+    std::vector<uint8_t> noise(256 * 200 * 4);
+    for (auto& b : noise) b = static_cast<uint8_t>(rng());
+    auto noise_view = make_view(texture_format::RGBA8_UNORM, 256, 200, noise);
+    {
+        JobPool pool;
+        for (mip_filter filter : {mip_filter::BOX, mip_filter::KAISER}) {
+            mip_chain_t serial = generate_mips(noise_view, {filter, true, 0});
+            mip_chain_t parallel = generate_mips(noise_view, {filter, true, 0}, &pool);
+            EXPECT(serial.storage == parallel.storage);
+        }
+    }
+
+    // generate_mips_peak_bytes covers what generate_mips holds, leaving out its per row scratch
+    for (mip_filter filter : {mip_filter::BOX, mip_filter::KAISER}) {
+        for (auto [format, width, height] : {std::tuple{texture_format::RGBA8_UNORM, 256u, 200u}, std::tuple{texture_format::R8_UNORM, 256u, 200u}}) {
+            std::vector<uint8_t> pixels(static_cast<size_t>(texture_row_bytes(format, width)) * height);
+            auto view = make_view(format, width, height, pixels);
+            int64_t before = g_live_bytes.load();
+            g_peak_bytes = before;
+            {
+                mip_chain_t chain = generate_mips(view, {filter, false, 0});
+            }
+            const int64_t measured = g_peak_bytes.load() - before;
+            const int64_t estimate = static_cast<int64_t>(generate_mips_peak_bytes(width, height, format, {filter, false, 0}));
+            const int64_t row_scratch = 2 * static_cast<int64_t>(width) * 4 * sizeof(float) + 4096;
+            std::printf("%s %s: peak %lld bytes, estimate %lld\n", texture_format_name(format), filter == mip_filter::BOX ? "box" : "kaiser", static_cast<long long>(measured), static_cast<long long>(estimate));
+            EXPECT(measured <= estimate + row_scratch);
+            EXPECT(measured * 10 >= estimate * 9);
+        }
+    }
+    return test_exit("mip_test");
+}
@@ -0,0 +1,78 @@
+#include "block_compress.h"
+#include "texture_packer.h"
+#include "test_util.h"
+
+// Packed layers must hold their texture in the top left corner with the last column and row repeated to the layer's
+// edge, on every level
+
+static std::vector<uint8_t> pattern(uint32_t width, uint32_t height, uint32_t seed) {
+    std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 4);
+    for (uint32_t i = 0; i < pixels.size(); ++i) pixels[i] = static_cast<uint8_t>(i * 7 + seed);
+    return pixels;
+}
+
+static uint32_t layer_mismatches(const texture_array_t& array, const texture_view_t& layer, const texture_view_t& source) {
+    const uint32_t unit = texture_format_pixel_bytes(array.format);
+    uint32_t mismatches = 0;
+    for (size_t l = 0; l < layer.levels.size(); ++l) {
+        const auto& dst = layer.levels[l];
+        const auto& src = source.levels[std::min(l, source.levels.size() - 1)];
+        const uint32_t row_bytes = texture_row_bytes(array.format, src.width);
+        const uint32_t rows = texture_row_count(array.format, src.height);
+        for (uint32_t r = 0; r < texture_row_count(array.format, dst.height); ++r) {
+            const uint8_t* d = dst.data + static_cast<size_t>(r) * dst.row_pitch;
+            const uint8_t* s = src.data + static_cast<size_t>(std::min(r, rows - 1)) * src.row_pitch;
+            mismatches += memcmp(d, s, row_bytes) != 0;
+            for (uint32_t x = row_bytes; x < texture_row_bytes(array.format, dst.width); x += unit) {
+                mismatches += memcmp(d + x, s + row_bytes - unit, unit) != 0;
+            }
+        }
+    }
+    return mismatches;
+}
+
+int main() {
+    const uint32_t sizes[][2] = {{64, 64}, {48, 32}, {64, 64}, {16, 16}, {128, 128}, {32, 64}, {200, 200}, {64, 64}};
+    std::vector<std::vector<uint8_t>> pixels;
+    std::vector<mip_chain_t> chains;
+    for (uint32_t i = 0; i < std::size(sizes); ++i) {
+        pixels.push_back(pattern(sizes[i][0], sizes[i][1], i));
+        texture_view_t view = {texture_format::RGBA8_UNORM, sizes[i][0], sizes[i][1], {{sizes[i][0], sizes[i][1], sizes[i][0] * 4, pixels.back().data()}}};
+        chains.push_back(generate_mips(view, {mip_filter::BOX, true, 0}));
+    }
+    std::vector<texture_view_t> views;
+    for (const auto& chain : chains) views.push_back(chain.view);
+    // Block compressed copies of two 64x64 textures form an array of their own
+    std::vector<compressed_texture_t> compressed;
+    for (int i : {0, 2}) compressed.push_back(compress_texture(chains[i].view, texture_format::BC7_UNORM, bc_quality::FAST, nullptr));
+    for (const auto& c : compressed) views.push_back(c.view);
+    // Without a full mip chain a texture stays on its own
+    const size_t partial = views.size();
+    views.push_back(chains[0].view);
+    views.back().levels.resize(3);
+    // Gray textures are never mixed with color ones of the same format
+    const size_t gray = views.size();
+    views.push_back(chains[3].view);
+    views.back().swizzle = texture_swizzle::GRAY;
+    views.push_back(chains[3].view);
+    views.back().swizzle = texture_swizzle::GRAY;
+
+    const texture_pack_t pack = pack_texture_arrays(views, {128, 2, 2048});
+    EXPECT(pack.entries.size() == views.size());
+    EXPECT(!pack.entries[partial].has_value());
+    EXPECT(!pack.entries[6].has_value());   // 200x200 is over max_size
+    EXPECT(pack.entries[8].has_value() && pack.entries[9].has_value() && pack.entries[8]->array == pack.entries[9]->array);
+    EXPECT(pack.entries[gray].has_value() && pack.entries[gray + 1].has_value() && pack.entries[gray]->array == pack.entries[gray + 1]->array);
+    EXPECT(!pack.entries[3].has_value() || pack.entries[3]->array != pack.entries[gray]->array);
+    for (size_t i = 0; i < views.size(); ++i) {
+        const auto& entry = pack.entries[i];
+        if (!entry.has_value()) continue;
+        const texture_array_t& array = pack.arrays[entry->array];
+        EXPECT(array.format == views[i].format && array.swizzle == views[i].swizzle);
+        EXPECT(array.size == texture_size_class(views[i]));
+        EXPECT_NEAR(entry->uv_scale[0], static_cast<double>(views[i].width) / array.size, 1e-6);
+        EXPECT_NEAR(entry->uv_scale[1], static_cast<double>(views[i].height) / array.size, 1e-6);
+        EXPECT(layer_mismatches(array, array.layers[entry->layer], views[i]) == 0);
+    }
+    return test_exit("packer_test");
+}
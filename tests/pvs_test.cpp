@@ -0,0 +1,146 @@
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+#include "pvs.h"
+#include "test_util.h"
+
+// A wall splits the baked region in two halves with a box on either side. Cells on one side must see their own box
+// and the wall but not the box behind it. The baked set must survive Save and Load, and Load must reject every
+// truncation and a few corruptions of the file
+
+static void add_box(PVSBaker& baker, uint32_t id, const aabb_t& b) {
+    const float3_t positions[8] = {
+        {b.min.x, b.min.y, b.min.z}, {b.max.x, b.min.y, b.min.z}, {b.min.x, b.max.y, b.min.z}, {b.max.x, b.max.y, b.min.z},
+        {b.min.x, b.min.y, b.max.z}, {b.max.x, b.min.y, b.max.z}, {b.min.x, b.max.y, b.max.z}, {b.max.x, b.max.y, b.max.z},
+    };
+    const uint32_t indices[36] = {
+        0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4,
+        2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5,
+    };
+    baker.AddObject(id, positions, indices, 36);
+}
+
+static std::vector<char> read_file(const std::filesystem::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+}
+
+static void write_file(const std::filesystem::path& path, const std::vector<char>& bytes) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+
+struct fake_drawcall_t {
+    bool visible = true;
+    void SetVisible(bool v) {
+        visible = v;
+    }
+};
+
+struct fake_pipeline_t {
+    fake_drawcall_t drawcalls[8];
+    fake_drawcall_t& GetDrawCall(uint32_t i) {
+        return drawcalls[i];
+    }
+};
+
+int main() {
+    const PVSBaker::pvs_bake_param_t param = {{{0.0f, 0.0f, 0.0f}, {20.0f, 2.0f, 4.0f}}, 2.0f, 32, 0.05f};
+    const float3_t wall[4] = {{10.0f, -100.0f, -100.0f}, {10.0f, 100.0f, -100.0f}, {10.0f, -100.0f, 100.0f}, {10.0f, 100.0f, 100.0f}};
+    const uint32_t wall_indices[6] = {0, 1, 2, 2, 1, 3};
+    auto make_baker = [&]() {
+        PVSBaker baker(param);
+        baker.AddObject(0, wall, wall_indices, 6);
+        add_box(baker, 1, {{2.0f, 0.5f, 1.0f}, {3.0f, 1.5f, 3.0f}});
+        add_box(baker, 2, {{17.0f, 0.5f, 1.0f}, {18.0f, 1.5f, 3.0f}});
+        return baker;
+    };
+
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto serial_path = dir / "pvs_test_serial.gpvs";
+    const auto pooled_path = dir / "pvs_test_pooled.gpvs";
+    const auto broken_path = dir / "pvs_test_broken.gpvs";
+    {
+        PVSBaker serial = make_baker();
+        serial.Bake();
+        EXPECT(serial.Save(serial_path.string()));
+        JobPool pool(3);
+        PVSBaker pooled = make_baker();
+        pooled.Bake(&pool);
+        EXPECT(pooled.Save(pooled_path.string()));
+        EXPECT(pooled.GetCompressedSize() > 0);
+    }
+    const std::vector<char> bytes = read_file(serial_path);
+    EXPECT(!bytes.empty() && bytes == read_file(pooled_path));
+
+    PotentiallyVisibleSet pvs;
+    EXPECT(pvs.Load(serial_path.string()));
+    EXPECT(pvs.GetObjectCount() == 3);
+    uint32_t wrong = 0;
+    for (float x = 0.5f; x < 20.0f; x += 1.0f) {
+        for (float z = 0.5f; z < 4.0f; z += 1.0f) {
+            EXPECT(pvs.UpdateCamera({x, 1.0f, z}));
+            bool left = x < 10.0f;
+            wrong += !pvs.IsVisible(0) || pvs.IsVisible(1) != left || pvs.IsVisible(2) == left;
+        }
+    }
+    EXPECT(wrong == 0);
+
+    // Apply shows and hides, so moving to the other side brings the hidden box back
+    fake_pipeline_t pipeline;
+    pvs.UpdateCamera({1.0f, 1.0f, 1.0f});
+    pvs.Apply(pipeline, 4);
+    EXPECT(pipeline.drawcalls[4].visible && pipeline.drawcalls[5].visible && !pipeline.drawcalls[6].visible);
+    pvs.UpdateCamera({19.0f, 1.0f, 1.0f});
+    pvs.Apply(pipeline, 4);
+    EXPECT(pipeline.drawcalls[4].visible && !pipeline.drawcalls[5].visible && pipeline.drawcalls[6].visible);
+
+    // Outside the baked region everything is visible
+    EXPECT(!pvs.UpdateCamera({50.0f, 1.0f, 1.0f}));
+    EXPECT(pvs.IsVisible(0) && pvs.IsVisible(1) && pvs.IsVisible(2));
+
+    // Every truncation fails to load
+    uint32_t accepted = 0;
+    for (size_t size = 0; size < bytes.size(); ++size) {
+        write_file(broken_path, std::vector<char>(bytes.begin(), bytes.begin() + size));
+        PotentiallyVisibleSet broken;
+        accepted += broken.Load(broken_path.string());
+    }
+    EXPECT(accepted == 0);
+
+    // Header: magic, region, cell size, dims and object count, then each cell's size and encoded set
+    constexpr size_t dims_offset = sizeof(uint32_t) + sizeof(aabb_t) + sizeof(float);
+    constexpr size_t first_cell = dims_offset + 3 * sizeof(uint32_t) + sizeof(uint32_t);
+    auto corrupt = [&](size_t offset, uint32_t value) {
+        std::vector<char> copy = bytes;
+        memcpy(copy.data() + offset, &value, sizeof(value));
+        write_file(broken_path, copy);
+        PotentiallyVisibleSet broken;
+        return broken.Load(broken_path.string());
+    };
+    EXPECT(!corrupt(0, 0x12345678));                            // magic
+    EXPECT(!corrupt(dims_offset - sizeof(float), 0));           // cell size of 0
+    EXPECT(!corrupt(dims_offset, 0x40000000));                  // more cells than the file holds
+    EXPECT(!corrupt(first_cell, 0xffffffff));                   // cell size past the end of the file
+    {
+        // A literal run longer than the cell
+        std::vector<char> copy = bytes;
+        copy[first_cell + sizeof(uint32_t) + 1] = 0x7f;
+        write_file(broken_path, copy);
+        PotentiallyVisibleSet broken;
+        EXPECT(!broken.Load(broken_path.string()));
+    }
+    {
+        // A zero run reaching past the object count
+        std::vector<char> copy = bytes;
+        copy[first_cell + sizeof(uint32_t)] = 0x7f;
+        write_file(broken_path, copy);
+        PotentiallyVisibleSet broken;
+        EXPECT(!broken.Load(broken_path.string()));
+    }
+
+    std::error_code ec;
+    for (const auto& path : {serial_path, pooled_path, broken_path}) std::filesystem::remove(path, ec);
+    return test_exit("pvs_test");
+}
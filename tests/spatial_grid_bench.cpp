@@ -0,0 +1,95 @@
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+#include "simd_math.h"
+#include "spatial_grid.h"
+
+// Update and query cost of SpatialHashGrid at 100k objects spread over a 1km square: batched insert, a frame of moves
+// where every object takes a small step, batched remove, and each query type at a few region sizes.
+
+constexpr uint32_t object_count = 100000;
+
+static double ms_since(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main() {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+    std::uniform_real_distribution<float> height(0.0f, 20.0f);
+    std::uniform_real_distribution<float> size(0.25f, 2.0f);
+    std::uniform_real_distribution<float> step(-0.5f, 0.5f);
+    std::vector<aabb_t> boxes(object_count);
+    for (auto& b : boxes) {
+        float3_t c = {position(rng), height(rng), position(rng)};
+        float e = size(rng);
+        b = {{c.x - e, c.y - e, c.z - e}, {c.x + e, c.y + e, c.z + e}};
+    }
+
+    SpatialHashGrid grid(4.0f);
+    std::vector<uint32_t> ids;
+    auto t0 = std::chrono::steady_clock::now();
+    grid.InsertBatch(boxes, ids);
+    double insert_ms = ms_since(t0);
+
+    std::vector<SpatialHashGrid::spatial_move_t> moves(object_count);
+    double move_ms = 1e30;
+    for (int frame = 0; frame < 10; ++frame) {
+        for (uint32_t i = 0; i < object_count; ++i) {
+            float dx = step(rng), dz = step(rng);
+            aabb_t& b = boxes[i];
+            b = {{b.min.x + dx, b.min.y, b.min.z + dz}, {b.max.x + dx, b.max.y, b.max.z + dz}};
+            moves[i] = {ids[i], b};
+        }
+        t0 = std::chrono::steady_clock::now();
+        grid.MoveBatch(moves);
+        move_ms = std::min(move_ms, ms_since(t0));
+    }
+
+    std::printf("%u objects\n", object_count);
+    std::printf("%-24s %10.2fms\n", "InsertBatch", insert_ms);
+    std::printf("%-24s %10.2fms\n", "MoveBatch, every object", move_ms);
+
+    constexpr int queries = 1000;
+    std::vector<uint32_t> found;
+    std::printf("%-24s %10s %10s\n", "query", "us/query", "hits");
+    for (float radius : {5.0f, 25.0f, 100.0f}) {
+        std::vector<float3_t> centers(queries);
+        for (auto& c : centers) c = {position(rng), height(rng), position(rng)};
+        size_t hits = 0;
+        t0 = std::chrono::steady_clock::now();
+        for (const auto& c : centers) {
+            found.clear();
+            grid.QueryAABB({{c.x - radius, c.y - radius, c.z - radius}, {c.x + radius, c.y + radius, c.z + radius}}, found);
+            hits += found.size();
+        }
+        std::printf("aabb %-19.0f %10.2f %10zu\n", radius, ms_since(t0) * 1000.0 / queries, hits / queries);
+        hits = 0;
+        t0 = std::chrono::steady_clock::now();
+        for (const auto& c : centers) {
+            found.clear();
+            grid.QuerySphere({c, radius}, found);
+            hits += found.size();
+        }
+        std::printf("sphere %-17.0f %10.2f %10zu\n", radius, ms_since(t0) * 1000.0 / queries, hits / queries);
+    }
+    for (float far_z : {50.0f, 200.0f}) {
+        constexpr int frustums = 100;
+        size_t hits = 0;
+        t0 = std::chrono::steady_clock::now();
+        for (int q = 0; q < frustums; ++q) {
+            mat_t view = mat_look_at_lh(vec_set(position(rng), 2.0f, position(rng), 0.0f), vec_set(position(rng), 2.0f, position(rng), 0.0f), vec_set(0.0f, 1.0f, 0.0f, 0.0f));
+            float view_proj[4][4];
+            mat_store(view_proj, mat_mul(view, mat_perspective_fov_lh(1.0f, 16.0f / 9.0f, 0.1f, far_z)));
+            found.clear();
+            grid.QueryFrustum(frustum_from_matrix(view_proj), found);
+            hits += found.size();
+        }
+        std::printf("frustum far %-12.0f %10.2f %10zu\n", far_z, ms_since(t0) * 1000.0 / frustums, hits / frustums);
+    }
+
+    t0 = std::chrono::steady_clock::now();
+    grid.RemoveBatch(ids);
+    std::printf("%-24s %10.2fms\n", "RemoveBatch", ms_since(t0));
+}
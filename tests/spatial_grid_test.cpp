@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <random>
+
+#include "simd_math.h"
+#include "spatial_grid.h"
+#include "test_util.h"
+
+// Every query must return exactly the objects a brute force scan finds, once each. Objects are inserted, moved across
+// cells, grown past the largest extent seen and removed with their ids reused. Regions both small enough to hash their
+// cells and large enough for the linear pass over all buckets are checked, on a grid with few buckets so cells collide
+
+struct reference_t {
+    std::vector<aabb_t> bounds;
+    std::vector<bool> alive;
+};
+
+template<typename Test>
+static std::vector<uint32_t> brute_force(const reference_t& ref, Test&& test) {
+    std::vector<uint32_t> ids;
+    for (uint32_t i = 0; i < ref.bounds.size(); ++i) {
+        if (ref.alive[i] && test(ref.bounds[i])) ids.push_back(i);
+    }
+    return ids;
+}
+
+static bool same_ids(std::vector<uint32_t> found, const std::vector<uint32_t>& expected) {
+    std::sort(found.begin(), found.end());
+    return found == expected;
+}
+
+int main() {
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> position(-200.0f, 200.0f);
+    std::uniform_real_distribution<float> size(0.1f, 4.0f);
+    std::uniform_real_distribution<float> step(-6.0f, 6.0f);
+    auto random_box = [&](float scale) {
+        float3_t c = {position(rng), position(rng) * 0.25f, position(rng)};
+        float3_t e = {size(rng) * scale, size(rng) * scale, size(rng) * scale};
+        return aabb_t{{c.x - e.x, c.y - e.y, c.z - e.z}, {c.x + e.x, c.y + e.y, c.z + e.z}};
+    };
+
+    for (uint32_t bucket_bits : {6u, 16u}) {
+        SpatialHashGrid grid(4.0f, bucket_bits);
+        reference_t ref;
+        std::vector<aabb_t> boxes(5000);
+        for (auto& b : boxes) b = random_box(1.0f);
+        std::vector<uint32_t> ids;
+        grid.InsertBatch(boxes, ids);
+        EXPECT(ids.size() == boxes.size() && grid.GetObjectCount() == boxes.size());
+        ref.bounds.resize(boxes.size());
+        ref.alive.resize(boxes.size());
+        for (size_t i = 0; i < ids.size(); ++i) {
+            ref.bounds[ids[i]] = boxes[i];
+            ref.alive[ids[i]] = true;
+        }
+
+        uint32_t mismatches = 0;
+        auto check = [&]() {
+            for (int q = 0; q < 40; ++q) {
+                // Alternate small regions, which hash their cells, with large ones covering most buckets
+                float scale = q % 2 ? 30.0f : 1.0f;
+                aabb_t box = random_box(scale);
+                std::vector<uint32_t> found;
+                grid.QueryAABB(box, found);
+                mismatches += !same_ids(found, brute_force(ref, [&](const aabb_t& b) { return aabb_overlaps(box, b); }));
+
+                sphere_t sphere = {{position(rng), position(rng) * 0.25f, position(rng)}, size(rng) * scale};
+                found.clear();
+                grid.QuerySphere(sphere, found);
+                mismatches += !same_ids(found, brute_force(ref, [&](const aabb_t& b) { return sphere_overlaps_aabb(sphere, b); }));
+
+                float3_t eye = {position(rng), position(rng) * 0.25f, position(rng)};
+                mat_t view = mat_look_at_lh(vec_load3(eye), vec_set(position(rng), 0.0f, position(rng), 0.0f), vec_set(0.0f, 1.0f, 0.0f, 0.0f));
+                float view_proj[4][4];
+                mat_store(view_proj, mat_mul(view, mat_perspective_fov_lh(0.8f, 16.0f / 9.0f, 0.5f, 10.0f * scale)));
+                frustum_t frustum = frustum_from_matrix(view_proj);
+                found.clear();
+                grid.QueryFrustum(frustum, found);
+                // The plane test alone passes some boxes near the frustum's corners that lie outside it, the grid
+                // never visits those since it only looks inside frustum_bounds
+                const aabb_t frustum_box = frustum_bounds(frustum);
+                mismatches += !same_ids(found, brute_force(ref, [&](const aabb_t& b) { return frustum_overlaps_aabb(frustum, b) && aabb_overlaps(frustum_box, b); }));
+            }
+        };
+        check();
+
+        // Small steps mostly stay in their cell, some objects jump far and a few grow past the largest extent so far
+        std::vector<SpatialHashGrid::spatial_move_t> moves;
+        for (uint32_t id = 0; id < ref.bounds.size(); id += 2) {
+            aabb_t b = ref.bounds[id];
+            if (id % 50 == 0) {
+                b = random_box(id % 100 == 0 ? 6.0f : 1.0f);
+            } else {
+                float3_t d = {step(rng), step(rng), step(rng)};
+                b = {{b.min.x + d.x, b.min.y + d.y, b.min.z + d.z}, {b.max.x + d.x, b.max.y + d.y, b.max.z + d.z}};
+            }
+            moves.push_back({id, b});
+            ref.bounds[id] = b;
+        }
+        grid.MoveBatch(moves);
+        check();
+
+        // Removed ids are reused by later inserts
+        std::vector<uint32_t> removed;
+        for (uint32_t id = 1; id < ref.bounds.size(); id += 3) {
+            removed.push_back(id);
+            ref.alive[id] = false;
+        }
+        grid.RemoveBatch(removed);
+        EXPECT(grid.GetObjectCount() == ref.bounds.size() - removed.size());
+        grid.Move(removed[0], random_box(1.0f));
+        grid.Remove(removed[0]);
+        EXPECT(grid.GetObjectCount() == ref.bounds.size() - removed.size());
+        check();
+        for (int i = 0; i < 100; ++i) {
+            aabb_t b = random_box(1.0f);
+            uint32_t id = grid.Insert(b);
+            EXPECT(id < ref.bounds.size() && !ref.alive[id]);
+            ref.bounds[id] = b;
+            ref.alive[id] = true;
+        }
+        check();
+        EXPECT(mismatches == 0);
+    }
+
+    return test_exit("spatial_grid_test");
+}
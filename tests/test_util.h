@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+
+/* Checks for the test executables. A failed check prints where it failed and the test goes on, test_exit turns the
+ * failure count into the exit code */
+inline int& test_failures() {
+    static int failures = 0;
+    return failures;
+}
+
+inline bool test_expect(bool ok, const char* what, const char* file, int line) {
+    if (!ok) {
+        ++test_failures();
+        std::printf("%s:%d: check failed: %s\n", file, line, what);
+    }
+    return ok;
+}
+
+inline bool test_expect_near(double a, double b, double tolerance, const char* what, const char* file, int line) {
+    bool ok = std::fabs(a - b) <= tolerance;
+    if (!ok) {
+        ++test_failures();
+        std::printf("%s:%d: check failed: %s, %g vs %g\n", file, line, what, a, b);
+    }
+    return ok;
+}
+
+#define EXPECT(cond) test_expect((cond), #cond, __FILE__, __LINE__)
+#define EXPECT_NEAR(a, b, tolerance) test_expect_near((a), (b), (tolerance), #a " near " #b, __FILE__, __LINE__)
+
+// Exit code ctest reports as skipped, see SKIP_RETURN_CODE in tests/CMakeLists.txt
+constexpr int test_skipped = 77;
+
+inline int test_exit(const char* name) {
+    std::printf("%s %s\n", name, test_failures() ? "FAILED" : "passed");
+    return test_failures() ? 1 : 0;
+}